@@ -0,0 +1,1071 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "integrity.h"
+
+using namespace std;
+
+/*
+* Micro benchmarks for every public check, each compared against the equivalent hand written if statement.
+*
+* Build with optimisation on, e.g.
+*     g++ -std=c++14 -O2 benchmark.cpp -o benchmark
+* and run as
+*     ./benchmark [filter]
+* where the optional filter only runs the benchmarks whose name contains it.
+*
+* The results are written to stdout as JSON, so runs against two versions of integrity.h can be diffed.
+* For each benchmark it reports the time per operation, the heap allocations per operation (counted by
+* replacing the global operator new) and the throughput in operations per second.
+*/
+
+// ******************************************************************************************************************
+// * ------------------------------------------- allocation counting ---------------------------------------------- *
+// ******************************************************************************************************************
+
+static atomic<size_t> allocationCount(0);
+
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+// g++ does not realise that the operator new below is the one that goes with free
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t size) {
+    allocationCount.fetch_add(1, memory_order_relaxed);
+    void* p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw bad_alloc();
+    }
+    return p;
+}
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+void operator delete(void* p) noexcept {
+    free(p);
+}
+void operator delete[](void* p) noexcept {
+    free(p);
+}
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+void operator delete[](void* p, size_t) noexcept {
+    free(p);
+}
+
+// ******************************************************************************************************************
+// * ------------------------------------------------- harness ---------------------------------------------------- *
+// ******************************************************************************************************************
+
+// Stops the compiler from optimising away a value, or hoisting work out of the timed loop
+template<typename T> inline void doNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+static const size_t dataSize = 1024; // power of 2 so the index can be masked
+static const size_t passIterations = 20000000;
+static const size_t failIterations = 200000;
+
+static const char* filter = nullptr;
+static bool firstResult = true;
+
+// itemsPerOp is for the bulk checks, where one op checks many items, so that their throughput can be given per item
+template<typename F> void run(const char* group, const char* name, size_t iterations, size_t itemsPerOp, F&& body) {
+    if (filter != nullptr && strstr(name, filter) == nullptr && strstr(group, filter) == nullptr) {
+        return;
+    }
+    // warm up
+    for (size_t i = 0; i < iterations / 10; ++i) {
+        body(i);
+    }
+    size_t allocationsBefore = allocationCount.load(memory_order_relaxed);
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        body(i);
+    }
+    auto end = chrono::steady_clock::now();
+    size_t allocations = allocationCount.load(memory_order_relaxed) - allocationsBefore;
+
+    double ns = chrono::duration<double, nano>(end - start).count() / iterations;
+    cout << (firstResult ? "\n" : ",\n");
+    cout << "    { \"group\": \"" << group << "\", \"name\": \"" << name << "\""
+        << ", \"iterations\": " << iterations
+        << ", \"ns_per_op\": " << ns
+        << ", \"allocs_per_op\": " << (double) allocations / iterations
+        << ", \"ops_per_sec\": " << (ns > 0 ? 1e9 / ns : 0);
+    if (itemsPerOp != 1) {
+        cout << ", \"items_per_op\": " << itemsPerOp << ", \"items_per_sec\": " << (ns > 0 ? 1e9 * itemsPerOp / ns : 0);
+    }
+    cout << " }";
+    firstResult = false;
+}
+
+template<typename F> void run(const char* group, const char* name, size_t iterations, F&& body) {
+    run(group, name, iterations, 1, body);
+}
+
+// Runs a failing check and swallows the exception, keeping hold of the message so it is not optimised away
+template<typename F> inline void expectThrow(F&& func) {
+    try {
+        func();
+    }
+    catch (const logic_error& e) {
+        doNotOptimize(e.what()[0]);
+    }
+}
+
+#define MASK(i) ((i) & (dataSize - 1))
+
+// ******************************************************************************************************************
+// * ----------------------------------------------- pass paths --------------------------------------------------- *
+// ******************************************************************************************************************
+
+void benchmark_pass() {
+    vector<int> ints(dataSize);
+    vector<double> doubles(dataSize);
+    vector<const int*> pointers(dataSize);
+    vector<string> strings(dataSize);
+    vector<wstring> wstrings(dataSize);
+    vector<const char*> charStars(dataSize);
+    for (size_t i = 0; i < dataSize; ++i) {
+        ints[i] = (int) i;
+        doubles[i] = i * 1.5;
+        pointers[i] = &ints[i];
+        strings[i] = "string " + to_string(i);
+        wstrings[i] = L"wstring";
+        charStars[i] = strings[i].c_str();
+    }
+    doNotOptimize(ints.data());
+    doNotOptimize(doubles.data());
+    string name = "a string captured by the lambda";
+    const char* group = "pass";
+
+    run(group, "if", passIterations, [&](size_t i) {
+        int value = ints[MASK(i)];
+        if (value < 0) {
+            throw logic_error("value was " + to_string(value));
+        }
+        doNotOptimize(value);
+        });
+    run(group, "check", passIterations, [&](size_t i) {
+        int value = ints[MASK(i)];
+        Integrity::check(value >= 0);
+        doNotOptimize(value);
+        });
+    run(group, "check message", passIterations, [&](size_t i) {
+        int value = ints[MASK(i)];
+        Integrity::check(value >= 0, "value was negative");
+        doNotOptimize(value);
+        });
+    run(group, "check {} int", passIterations, [&](size_t i) {
+        int value = ints[MASK(i)];
+        Integrity::check(value >= 0, "value was {}", value);
+        doNotOptimize(value);
+        });
+    run(group, "check {} int string", passIterations, [&](size_t i) {
+        int value = ints[MASK(i)];
+        Integrity::check(value >= 0, "value was {} for {}", value, strings[MASK(i)]);
+        doNotOptimize(value);
+        });
+    run(group, "check INTEGRITY_FORMAT", passIterations, [&](size_t i) {
+        int value = ints[MASK(i)];
+        Integrity::check(value >= 0, INTEGRITY_FORMAT("value was {} for {}"), value, strings[MASK(i)]);
+        doNotOptimize(value);
+        });
+    run(group, "checkM lambda", passIterations, [&](size_t i) {
+        int value = ints[MASK(i)];
+        Integrity::checkM(value >= 0, [&](Integrity::out out) { out << name << " " << value; });
+        doNotOptimize(value);
+        });
+    run(group, "checkM std::function", passIterations, [&](size_t i) {
+        int value = ints[MASK(i)];
+        Integrity::checkM(value >= 0, function<void(stringstream&)>([=](stringstream& out) { out << name << " " << value; }));
+        doNotOptimize(value);
+        });
+    // an audit which is compiled in but switched off at run time only pays for loading the level flag
+    Integrity::Level level = Integrity::activeLevel();
+    Integrity::setActiveLevel(Integrity::Level::debug);
+    run(group, "audit switched off", passIterations, [&](size_t i) {
+        int value = ints[MASK(i)];
+        Integrity::audit<true>([&]() { return std::all_of(ints.begin(), ints.end(), [](int v) { return v >= 0; }); }, "value was {}", value);
+        doNotOptimize(value);
+        });
+    Integrity::setActiveLevel(level);
+    // a message arg which costs something to work out: the function form pays for it on every call, the macro only on failure
+    run(group, "check expensive arg", passIterations, [&](size_t i) {
+        int value = ints[MASK(i)];
+        Integrity::check(value >= 0, "value was {} for {}", value, name + strings[MASK(i)]);
+        doNotOptimize(value);
+        });
+    run(group, "INTEGRITY_CHECK expensive arg", passIterations, [&](size_t i) {
+        int value = ints[MASK(i)];
+        INTEGRITY_CHECK(value >= 0, "value was {} for {}", value, name + strings[MASK(i)]);
+        doNotOptimize(value);
+        });
+
+    run(group, "checkEveryN skipped", passIterations, [&](size_t i) {
+        int value = ints[MASK(i)];
+        Integrity::checkEveryN(1000000, [&]() { return std::all_of(ints.begin(), ints.end(), [](int v) { return v >= 0; }); }, "value was {}", value);
+        doNotOptimize(value);
+        });
+
+    run(group, "if pointer", passIterations, [&](size_t i) {
+        const int* p = pointers[MASK(i)];
+        if (p == nullptr) {
+            throw logic_error("Null pointer");
+        }
+        doNotOptimize(p);
+        });
+    run(group, "tryCheckNotNull", passIterations, [&](size_t i) {
+        const int* p = pointers[MASK(i)];
+        if (!Integrity::tryCheckNotNull(p)) {
+            throw logic_error("Null pointer");
+        }
+        doNotOptimize(p);
+        });
+    run(group, "checkNotNull", passIterations, [&](size_t i) {
+        const int* p = pointers[MASK(i)];
+        Integrity::checkNotNull(p);
+        doNotOptimize(p);
+        });
+    run(group, "checkNotNull {} int", passIterations, [&](size_t i) {
+        const int* p = pointers[MASK(i)];
+        Integrity::checkNotNull(p, "pointer {} was null", i);
+        doNotOptimize(p);
+        });
+    run(group, "checkNotNullM", passIterations, [&](size_t i) {
+        const int* p = pointers[MASK(i)];
+        Integrity::checkNotNullM(p, [&](Integrity::out out) { out << "pointer " << i; });
+        doNotOptimize(p);
+        });
+
+    run(group, "if number", passIterations, [&](size_t i) {
+        double d = doubles[MASK(i)];
+        if (std::isnan(d) || std::isinf(d)) {
+            throw logic_error("NaN");
+        }
+        doNotOptimize(d);
+        });
+    run(group, "checkIsValidNumber", passIterations, [&](size_t i) {
+        double d = doubles[MASK(i)];
+        Integrity::checkIsValidNumber(d);
+        doNotOptimize(d);
+        });
+    run(group, "checkIsValidNumber {} int", passIterations, [&](size_t i) {
+        double d = doubles[MASK(i)];
+        Integrity::checkIsValidNumber(d, "element {}", i);
+        doNotOptimize(d);
+        });
+    run(group, "checkIsValidNumberM", passIterations, [&](size_t i) {
+        double d = doubles[MASK(i)];
+        Integrity::checkIsValidNumberM(d, [&](Integrity::out out) { out << "element " << i; });
+        doNotOptimize(d);
+        });
+
+    run(group, "if string", passIterations, [&](size_t i) {
+        const string& s = strings[MASK(i)];
+        if (s.empty()) {
+            throw logic_error("Empty string");
+        }
+        doNotOptimize(s);
+        });
+    run(group, "checkStringNotNullOrEmpty string", passIterations, [&](size_t i) {
+        const string& s = strings[MASK(i)];
+        Integrity::checkStringNotNullOrEmpty(s);
+        doNotOptimize(s);
+        });
+    run(group, "checkStringNotNullOrEmpty string*", passIterations, [&](size_t i) {
+        const string* s = &strings[MASK(i)];
+        Integrity::checkStringNotNullOrEmpty(s, "row {}", i);
+        doNotOptimize(s);
+        });
+    run(group, "checkStringNotNullOrEmpty wstring", passIterations, [&](size_t i) {
+        const wstring& s = wstrings[MASK(i)];
+        Integrity::checkStringNotNullOrEmpty(s);
+        doNotOptimize(s);
+        });
+    run(group, "if char*", passIterations, [&](size_t i) {
+        const char* s = charStars[MASK(i)];
+        if (s == nullptr || *s == '\0') {
+            throw logic_error("Empty string");
+        }
+        doNotOptimize(s);
+        });
+    run(group, "checkStringNotNullOrEmpty char*", passIterations, [&](size_t i) {
+        const char* s = charStars[MASK(i)];
+        Integrity::checkStringNotNullOrEmpty(s, "row {}", i);
+        doNotOptimize(s);
+        });
+    run(group, "checkStringNotNullOrEmptyM char*", passIterations, [&](size_t i) {
+        const char* s = charStars[MASK(i)];
+        Integrity::checkStringNotNullOrEmptyM(s, [&](Integrity::out out) { out << "row " << i; });
+        doNotOptimize(s);
+        });
+}
+
+// ******************************************************************************************************************
+// * ----------------------------------------------- fail paths --------------------------------------------------- *
+// ******************************************************************************************************************
+
+void benchmark_fail() {
+    int x = 1;
+    int y = 2;
+    string aString = "a string";
+    const char* aCharStar = "a char*";
+    double nan = std::nan("");
+    const int* nullPointer = nullptr;
+    string emptyString;
+    doNotOptimize(nan);
+    const char* group = "fail";
+
+    run(group, "if throw", failIterations, [&](size_t) {
+        expectThrow([&]() {
+            if (x == y) return;
+            throw logic_error("Integrity check failed");
+            });
+        });
+    run(group, "if throw hand built message", failIterations, [&](size_t) {
+        expectThrow([&]() {
+            if (x == y) return;
+            throw logic_error("Expected " + to_string(x) + " to be same as " + to_string(y));
+            });
+        });
+    run(group, "check", failIterations, [&](size_t) {
+        expectThrow([&]() { Integrity::check(x == y); });
+        });
+    run(group, "check message", failIterations, [&](size_t) {
+        expectThrow([&]() { Integrity::check(x == y, "x was not y"); });
+        });
+    run(group, "fail", failIterations, [&](size_t) {
+        expectThrow([&]() { Integrity::fail(); });
+        });
+
+    // message args, both the {} substitution and the appending
+    run(group, "check {} int int", failIterations, [&](size_t) {
+        expectThrow([&]() { Integrity::check(x == y, "Expected {} to be same as {}", x, y); });
+        });
+    run(group, "check {} int int caught without what()", failIterations, [&](size_t) {
+        try {
+            Integrity::check(x == y, "Expected {} to be same as {}", x, y);
+        }
+        catch (const logic_error& e) {
+            doNotOptimize(&e);
+        }
+        });
+    run(group, "check INTEGRITY_FORMAT int int", failIterations, [&](size_t) {
+        expectThrow([&]() { Integrity::check(x == y, INTEGRITY_FORMAT("Expected {} to be same as {}"), x, y); });
+        });
+    run(group, "check {} string char* double", failIterations, [&](size_t) {
+        expectThrow([&]() { Integrity::check(x == y, "{} and {} and {}", aString, aCharStar, 1.5); });
+        });
+    run(group, "check appended int bool char", failIterations, [&](size_t) {
+        expectThrow([&]() { Integrity::check(x == y, x, x == y, 'c'); });
+        });
+    run(group, "fail {} int", failIterations, [&](size_t) {
+        expectThrow([&]() { Integrity::fail("failed with {}", x); });
+        });
+    run(group, "checkM lambda", failIterations, [&](size_t) {
+        expectThrow([&]() { Integrity::checkM(x == y, [&](Integrity::out out) { out << x << " != " << y; }); });
+        });
+    run(group, "failM lambda", failIterations, [&](size_t) {
+        expectThrow([&]() { Integrity::failM([&](Integrity::out out) { out << x << " != " << y; }); });
+        });
+    // a message longer than a std::string keeps without allocating, written to the thread's reused Writer and to a std::stringstream
+    run(group, "checkM lambda long message", failIterations, [&](size_t) {
+        expectThrow([&]() { Integrity::checkM(x == y, [&](Integrity::out out) { out << "Expected x to be the same as y, but x was " << x << " and y was " << y << " at " << 1.5; }); });
+        });
+    run(group, "checkM stringstream lambda long message", failIterations, [&](size_t) {
+        expectThrow([&]() { Integrity::checkM(x == y, [&](stringstream& out) { out << "Expected x to be the same as y, but x was " << x << " and y was " << y << " at " << 1.5; }); });
+        });
+
+    run(group, "checkNotNull", failIterations, [&](size_t) {
+        expectThrow([&]() { Integrity::checkNotNull(nullPointer); });
+        });
+    run(group, "checkNotNull {} int", failIterations, [&](size_t) {
+        expectThrow([&]() { Integrity::checkNotNull(nullPointer, "pointer {}", x); });
+        });
+    run(group, "checkIsValidNumber", failIterations, [&](size_t) {
+        expectThrow([&]() { Integrity::checkIsValidNumber(nan); });
+        });
+    run(group, "checkIsValidNumber {} int", failIterations, [&](size_t) {
+        expectThrow([&]() { Integrity::checkIsValidNumber(nan, "element {}", x); });
+        });
+    run(group, "checkStringNotNullOrEmpty", failIterations, [&](size_t) {
+        expectThrow([&]() { Integrity::checkStringNotNullOrEmpty(emptyString); });
+        });
+    run(group, "checkStringNotNullOrEmpty {} int", failIterations, [&](size_t) {
+        expectThrow([&]() { Integrity::checkStringNotNullOrEmpty(emptyString, "row {}", x); });
+        });
+}
+
+// ******************************************************************************************************************
+// * ------------------------------------------ wide string conversion -------------------------------------------- *
+// ******************************************************************************************************************
+
+void benchmark_wide() {
+    wstring aWString = L"a wide string";
+    u16string aU16String = u"a u16 string";
+    u32string aU32String = U"a u32 string";
+    char16_t c16 = 0x0BCD;
+    char32_t c32 = 0xFEDCBA;
+    wchar_t wc = 0xFCD;
+    const char* group = "wide";
+
+    run(group, "fail wstring", failIterations, [&](size_t) {
+        expectThrow([&]() { Integrity::fail(aWString); });
+        });
+    run(group, "fail u16string", failIterations, [&](size_t) {
+        expectThrow([&]() { Integrity::fail(aU16String); });
+        });
+    run(group, "fail u32string", failIterations, [&](size_t) {
+        expectThrow([&]() { Integrity::fail(aU32String); });
+        });
+    run(group, "fail char16_t", failIterations, [&](size_t) {
+        expectThrow([&]() { Integrity::fail(c16); });
+        });
+    run(group, "fail char32_t", failIterations, [&](size_t) {
+        expectThrow([&]() { Integrity::fail(c32); });
+        });
+    run(group, "fail wchar_t", failIterations, [&](size_t) {
+        expectThrow([&]() { Integrity::fail(wc); });
+        });
+}
+
+// ******************************************************************************************************************
+// * ---------------------------------------------- number formatting --------------------------------------------- *
+// ******************************************************************************************************************
+
+// Formats millions of values with the formatting behind the messages, against what it replaced
+void benchmark_format() {
+    const size_t iterations = 4000000;
+    vector<long long> ints(dataSize);
+    vector<double> doubles(dataSize);
+    vector<float> floats(dataSize);
+    vector<char16_t> chars(dataSize);
+    for (size_t i = 0; i < dataSize; ++i) {
+        ints[i] = (long long) (rand() - RAND_MAX / 2) * rand();
+        doubles[i] = (rand() - RAND_MAX / 2) / 7.0 * rand();
+        floats[i] = (float) rand() / 3;
+        chars[i] = (char16_t) (0x100 + rand() % 0xFE00);
+    }
+    char buffer[Integrity::numberTextSize];
+    const char* group = "format";
+
+    run(group, "formatNumber long long", iterations, [&](size_t i) {
+        doNotOptimize(Integrity::formatNumber(buffer, ints[MASK(i)]));
+        doNotOptimize(buffer);
+        });
+    run(group, "std::to_string long long", iterations, [&](size_t i) {
+        doNotOptimize(to_string(ints[MASK(i)]));
+        });
+    run(group, "formatNumber double", iterations, [&](size_t i) {
+        doNotOptimize(Integrity::formatNumber(buffer, doubles[MASK(i)]));
+        doNotOptimize(buffer);
+        });
+    run(group, "std::to_string double", iterations, [&](size_t i) {
+        doNotOptimize(to_string(doubles[MASK(i)]));
+        });
+    run(group, "snprintf %.17g double", iterations, [&](size_t i) {
+        doNotOptimize(snprintf(buffer, sizeof(buffer), "%.17g", doubles[MASK(i)]));
+        doNotOptimize(buffer);
+        });
+    run(group, "formatNumber float", iterations, [&](size_t i) {
+        doNotOptimize(Integrity::formatNumber(buffer, floats[MASK(i)]));
+        doNotOptimize(buffer);
+        });
+    run(group, "std::to_string float", iterations, [&](size_t i) {
+        doNotOptimize(to_string(floats[MASK(i)]));
+        });
+    run(group, "formatWideChar char16_t", iterations, [&](size_t i) {
+        doNotOptimize(Integrity::formatWideChar(buffer, chars[MASK(i)], 2 * sizeof(char16_t)));
+        doNotOptimize(buffer);
+        });
+    run(group, "stringstream hex char16_t", iterations / 10, [&](size_t i) {
+        stringstream ss;
+        ss << "0x" << hex << setfill('0') << setw(2 * sizeof(char16_t)) << uppercase << (long) chars[MASK(i)];
+        doNotOptimize(ss.str());
+        });
+}
+
+// ******************************************************************************************************************
+// * ----------------------------------------------- bulk checks -------------------------------------------------- *
+// ******************************************************************************************************************
+
+void benchmark_bulk() {
+    const size_t count = 4 * 1024 * 1024;
+    const size_t iterations = 50;
+    vector<float> floats(count, 1.5f);
+    vector<double> doubles(count, 2.5);
+    const char* group = "bulk";
+
+    run(group, "if loop float", iterations, count, [&](size_t) {
+        for (size_t i = 0; i < count; ++i) {
+            if (std::isnan(floats[i]) || std::isinf(floats[i])) {
+                throw logic_error("NaN");
+            }
+        }
+        doNotOptimize(floats.data());
+        });
+    run(group, "checkIsValidNumber loop float", iterations, count, [&](size_t) {
+        for (size_t i = 0; i < count; ++i) {
+            Integrity::checkIsValidNumber(floats[i]);
+        }
+        doNotOptimize(floats.data());
+        });
+    run(group, "checkAllValidNumbers float", iterations, count, [&](size_t) {
+        Integrity::checkAllValidNumbers(floats);
+        doNotOptimize(floats.data());
+        });
+    run(group, "if loop double", iterations, count, [&](size_t) {
+        for (size_t i = 0; i < count; ++i) {
+            if (std::isnan(doubles[i]) || std::isinf(doubles[i])) {
+                throw logic_error("NaN");
+            }
+        }
+        doNotOptimize(doubles.data());
+        });
+    run(group, "checkIsValidNumber loop double", iterations, count, [&](size_t) {
+        for (size_t i = 0; i < count; ++i) {
+            Integrity::checkIsValidNumber(doubles[i]);
+        }
+        doNotOptimize(doubles.data());
+        });
+    run(group, "checkAllValidNumbers double", iterations, count, [&](size_t) {
+        Integrity::checkAllValidNumbers(doubles);
+        doNotOptimize(doubles.data());
+        });
+
+    // each kernel on its own, so the gain from the wider instruction sets can be seen
+    run(group, "scalar kernel double", iterations, count, [&](size_t) {
+        doNotOptimize(Integrity::findFirstInvalidNumberScalar(doubles.data(), 0, count));
+        });
+#ifdef INTEGRITY_X86_SIMD
+    run(group, "SSE2 kernel double", iterations, count, [&](size_t) {
+        doNotOptimize(Integrity::findFirstInvalidNumberSSE2(doubles.data(), count));
+        });
+#endif
+#ifdef INTEGRITY_X86_RUNTIME_DISPATCH
+    if (__builtin_cpu_supports("avx2")) {
+        run(group, "AVX2 kernel double", iterations, count, [&](size_t) {
+            doNotOptimize(Integrity::findFirstInvalidNumberAVX2(doubles.data(), count));
+            });
+    }
+    if (__builtin_cpu_supports("avx512f")) {
+        run(group, "AVX-512 kernel double", iterations, count, [&](size_t) {
+            doNotOptimize(Integrity::findFirstInvalidNumberAVX512(doubles.data(), count));
+            });
+    }
+#endif
+
+    vector<int> ints(count / 4);
+    vector<const int*> pointers(count / 4);
+    for (size_t i = 0; i < pointers.size(); ++i) {
+        pointers[i] = &ints[i];
+    }
+    run(group, "if loop pointers", iterations, pointers.size(), [&](size_t) {
+        for (size_t i = 0; i < pointers.size(); ++i) {
+            if (pointers[i] == nullptr) {
+                throw logic_error("Null pointer");
+            }
+        }
+        doNotOptimize(pointers.data());
+        });
+    run(group, "checkNotNull loop pointers", iterations, pointers.size(), [&](size_t) {
+        for (size_t i = 0; i < pointers.size(); ++i) {
+            Integrity::checkNotNull(pointers[i]);
+        }
+        doNotOptimize(pointers.data());
+        });
+    run(group, "checkAllNotNull pointers", iterations, pointers.size(), [&](size_t) {
+        Integrity::checkAllNotNull(pointers);
+        doNotOptimize(pointers.data());
+        });
+
+    vector<string> strings(count / 16, "a string");
+    run(group, "checkStringNotNullOrEmpty loop strings", iterations, strings.size(), [&](size_t) {
+        for (size_t i = 0; i < strings.size(); ++i) {
+            Integrity::checkStringNotNullOrEmpty(strings[i]);
+        }
+        doNotOptimize(strings.data());
+        });
+    run(group, "checkAllStringsNotEmpty strings", iterations, strings.size(), [&](size_t) {
+        Integrity::checkAllStringsNotEmpty(strings);
+        doNotOptimize(strings.data());
+        });
+
+    vector<int> keys(count);
+    for (size_t i = 0; i < count; ++i) {
+        keys[i] = (int) i;
+    }
+    run(group, "if loop sorted ints", iterations, count, [&](size_t) {
+        for (size_t i = 1; i < count; ++i) {
+            if (keys[i] < keys[i - 1]) {
+                throw logic_error("Out of order");
+            }
+        }
+        doNotOptimize(keys.data());
+        });
+    run(group, "checkSorted ints", iterations, count, [&](size_t) {
+        Integrity::checkSorted(keys);
+        doNotOptimize(keys.data());
+        });
+    run(group, "checkAllInRange ints", iterations, count, [&](size_t) {
+        Integrity::checkAllInRange(keys, 0, (int) count);
+        doNotOptimize(keys.data());
+        });
+    run(group, "checkAllInRange doubles", iterations, count, [&](size_t) {
+        Integrity::checkAllInRange(doubles, 0.0, 10.0);
+        doNotOptimize(doubles.data());
+        });
+    run(group, "checkUnique ints", 10, count, [&](size_t) {
+        Integrity::checkUnique(keys);
+        doNotOptimize(keys.data());
+        });
+
+    vector<int> counts(count, 1);
+    run(group, "check loop counts", iterations, count, [&](size_t) {
+        for (size_t i = 0; i < count; ++i) {
+            Integrity::check(counts[i] > 0);
+        }
+        doNotOptimize(counts.data());
+        });
+    run(group, "checkEach counts", iterations, count, [&](size_t) {
+        Integrity::checkEach(counts, [](int value) { return value > 0; });
+        doNotOptimize(counts.data());
+        });
+    // a range just big enough to be shared, checked again and again, where starting threads each time would dominate
+    Integrity::setParallelThreads(4);
+    run(group, "checkEach 100000 counts on 4 threads", 2000, 100000, [&](size_t) {
+        Integrity::checkAllOf(counts.begin(), counts.begin() + 100000, [](int value) { return value > 0; });
+        doNotOptimize(counts.data());
+        });
+    Integrity::setParallelThreads(0);
+
+    floats[count / 2] = std::nanf("");
+    run(group, "checkAllValidNumbers float fails half way", iterations, count / 2, [&](size_t) {
+        expectThrow([&]() { Integrity::checkAllValidNumbers(floats, "floats"); });
+        });
+}
+
+void benchmark_collect() {
+    // a batch of rows where every 10th one is bad, validated by catching each failure or by collecting them
+    const size_t rows = 1000;
+    const size_t iterations = 500;
+    vector<double> prices(rows, 9.99);
+    for (size_t i = 0; i < rows; i += 10) {
+        prices[i] = -1;
+    }
+    const char* group = "collect";
+
+    run(group, "try/catch per row", iterations, rows, [&](size_t) {
+        size_t bad = 0;
+        for (size_t i = 0; i < rows; ++i) {
+            try {
+                Integrity::check(prices[i] > 0, "row {} has price {}", i, prices[i]);
+            }
+            catch (const logic_error&) {
+                ++bad;
+            }
+        }
+        doNotOptimize(bad);
+        });
+    Integrity::Collector collector(rows);
+    run(group, "Collector", iterations, rows, [&](size_t) {
+        collector.clear();
+        Integrity::Collector::Scope scope(collector);
+        for (size_t i = 0; i < rows; ++i) {
+            Integrity::check(prices[i] > 0, "row {} has price {}", i, prices[i]);
+        }
+        doNotOptimize(collector.size());
+        });
+    run(group, "Collector with messages", iterations, rows, [&](size_t) {
+        collector.clear();
+        {
+            Integrity::Collector::Scope scope(collector);
+            for (size_t i = 0; i < rows; ++i) {
+                Integrity::check(prices[i] > 0, "row {} has price {}", i, prices[i]);
+            }
+        }
+        for (size_t i = 0; i < collector.size(); ++i) {
+            doNotOptimize(collector.message(i));
+        }
+        });
+}
+
+// ******************************************************************************************************************
+// * ----------------------------------------------- call sites --------------------------------------------------- *
+// ******************************************************************************************************************
+
+void benchmark_sites() {
+    vector<int> ints(dataSize);
+    const char* group = "sites";
+
+    run(group, "if", passIterations, [&](size_t i) {
+        if (ints[MASK(i)] < 0) {
+            throw logic_error("Integrity check failed");
+        }
+        });
+    run(group, "checkAt", passIterations, [&](size_t i) {
+        Integrity::checkAt(INTEGRITY_SITE("{} is negative"), ints[MASK(i)] >= 0, "{} is negative", ints[MASK(i)]);
+        });
+    run(group, "checkAt counting evaluations", passIterations, [&](size_t i) {
+        Integrity::checkAt<true>(INTEGRITY_SITE("{} is negative"), ints[MASK(i)] >= 0, "{} is negative", ints[MASK(i)]);
+        });
+
+    // every thread counting against the same site, compared with every thread adding to one shared atomic
+    const size_t perThread = 1000000;
+    static atomic<unsigned long long> shared(0);
+    for (size_t threads : { 1, 4, 16, 64 }) {
+        string name = "checkAt counting evaluations " + to_string(threads) + " threads";
+        run(group, name.c_str(), 3, threads * perThread, [&](size_t) {
+            vector<thread> running;
+            for (size_t t = 0; t < threads; ++t) {
+                running.emplace_back([&]() {
+                    for (size_t i = 0; i < perThread; ++i) {
+                        Integrity::checkAt<true>(INTEGRITY_SITE("threaded"), ints[MASK(i)] >= 0);
+                    }
+                    });
+            }
+            for (thread& t : running) {
+                t.join();
+            }
+            });
+        name = "one shared atomic " + to_string(threads) + " threads";
+        run(group, name.c_str(), 3, threads * perThread, [&](size_t) {
+            vector<thread> running;
+            for (size_t t = 0; t < threads; ++t) {
+                running.emplace_back([&]() {
+                    for (size_t i = 0; i < perThread; ++i) {
+                        shared.fetch_add(1, memory_order_relaxed);
+                        if (ints[MASK(i)] < 0) {
+                            throw logic_error("Integrity check failed");
+                        }
+                    }
+                    });
+            }
+            for (thread& t : running) {
+                t.join();
+            }
+            });
+    }
+}
+
+// ******************************************************************************************************************
+// * ---------------------------------------------- checked arithmetic -------------------------------------------- *
+// ******************************************************************************************************************
+
+// The overflow and narrowing checks, against the hand written guards they replace
+void benchmark_overflow() {
+    vector<size_t> sizes(dataSize);
+    vector<int> ints(dataSize);
+    for (size_t i = 0; i < dataSize; ++i) {
+        sizes[i] = i + 1;
+        ints[i] = (int) (i & 0x7F);
+    }
+    const char* group = "overflow";
+
+    // g++ compiles this to the same mul and jo as checkedMul
+    run(group, "divide back mul", passIterations, [&](size_t i) {
+        size_t a = sizes[MASK(i)];
+        size_t b = sizes[MASK(i + 1)];
+        size_t product = a * b;
+        if (a != 0 && product / a != b) {
+            throw logic_error("Overflow");
+        }
+        doNotOptimize(product);
+        });
+    run(group, "checkedMul", passIterations, [&](size_t i) {
+        size_t product = Integrity::checkedMul(sizes[MASK(i)], sizes[MASK(i + 1)]);
+        doNotOptimize(product);
+        });
+    run(group, "compare limit add", passIterations, [&](size_t i) {
+        size_t a = sizes[MASK(i)];
+        size_t b = sizes[MASK(i + 1)];
+        if (a > SIZE_MAX - b) {
+            throw logic_error("Overflow");
+        }
+        size_t sum = a + b;
+        doNotOptimize(sum);
+        });
+    run(group, "checkedAdd", passIterations, [&](size_t i) {
+        size_t sum = Integrity::checkedAdd(sizes[MASK(i)], sizes[MASK(i + 1)]);
+        doNotOptimize(sum);
+        });
+    run(group, "round trip narrow", passIterations, [&](size_t i) {
+        int value = ints[MASK(i)];
+        unsigned char narrowed = (unsigned char) value;
+        if ((int) narrowed != value || value < 0) {
+            throw logic_error("Narrowing");
+        }
+        doNotOptimize(narrowed);
+        });
+    run(group, "narrow", passIterations, [&](size_t i) {
+        unsigned char narrowed = Integrity::narrow<unsigned char>(ints[MASK(i)]);
+        doNotOptimize(narrowed);
+        });
+
+    // a span at a time: checkedSum branches on every add like the loop does, narrowAll once for the span
+    run(group, "compare limit add loop", 1000, dataSize, [&](size_t) {
+        size_t total = 0;
+        for (size_t i = 0; i < dataSize; ++i) {
+            if (total > SIZE_MAX - sizes[i]) {
+                throw logic_error("Overflow");
+            }
+            total += sizes[i];
+        }
+        doNotOptimize(total);
+        });
+    run(group, "checkedSum", 1000, dataSize, [&](size_t) {
+        size_t total = Integrity::checkedSum(sizes);
+        doNotOptimize(total);
+        });
+    vector<unsigned char> bytes(dataSize);
+    run(group, "round trip narrow loop", 1000, dataSize, [&](size_t) {
+        for (size_t i = 0; i < dataSize; ++i) {
+            bytes[i] = (unsigned char) ints[i];
+            if ((int) bytes[i] != ints[i]) {
+                throw logic_error("Narrowing");
+            }
+        }
+        doNotOptimize(bytes.data());
+        });
+    run(group, "narrowAll", 1000, dataSize, [&](size_t) {
+        Integrity::narrowAll(ints.data(), dataSize, bytes.data());
+        doNotOptimize(bytes.data());
+        });
+}
+
+// ******************************************************************************************************************
+// * ------------------------------------------------ checked span ------------------------------------------------ *
+// ******************************************************************************************************************
+
+// y += 3 * x over a window of two arrays. Checking each index stops the compiler vectorising the loop, where a
+// checked_span window is checked once and its loop is the raw pointer loop, which g++ and clang vectorise at -O3.
+void benchmark_span() {
+    vector<int> xs(dataSize + 1, 1);
+    vector<int> ys(dataSize + 1, 2);
+    const char* group = "span";
+
+    run(group, "raw pointers", 10000, dataSize, [&](size_t i) {
+        size_t offset = i & 1;
+        const int* x = xs.data() + offset;
+        int* y = ys.data() + offset;
+        for (size_t j = 0; j < dataSize; ++j) {
+            y[j] += 3 * x[j];
+        }
+        doNotOptimize(ys.data());
+        });
+    run(group, "check each index", 10000, dataSize, [&](size_t i) {
+        size_t offset = i & 1;
+        for (size_t j = 0; j < dataSize; ++j) {
+            Integrity::check(offset + j < xs.size() && offset + j < ys.size());
+            ys[offset + j] += 3 * xs[offset + j];
+        }
+        doNotOptimize(ys.data());
+        });
+    run(group, "checked_span window", 10000, dataSize, [&](size_t i) {
+        size_t offset = i & 1;
+        auto x = Integrity::checked_span<const int>(xs).window(offset, dataSize);
+        auto y = Integrity::checked_span<int>(ys).window(offset, dataSize);
+        for (size_t j = 0; j < x.size(); ++j) {
+            y[j] += 3 * x[j];
+        }
+        doNotOptimize(ys.data());
+        });
+    run(group, "checked_span debug", 10000, dataSize, [&](size_t i) {
+        size_t offset = i & 1;
+        auto x = Integrity::debug_checked_span<const int>(xs).window(offset, dataSize);
+        auto y = Integrity::debug_checked_span<int>(ys).window(offset, dataSize);
+        for (size_t j = 0; j < x.size(); ++j) {
+            y[j] += 3 * x[j];
+        }
+        doNotOptimize(ys.data());
+        });
+
+    // down a column of a square matrix, which is not vectorised, so the saving is only the checks
+    const size_t side = 32;
+    run(group, "check each column index", 10000, side, [&](size_t i) {
+        size_t column = i & (side - 1);
+        int total = 0;
+        for (size_t row = 0; row < side; ++row) {
+            Integrity::check(row * side + column < xs.size());
+            total += xs[row * side + column];
+        }
+        doNotOptimize(total);
+        });
+    run(group, "checked_span strided", 10000, side, [&](size_t i) {
+        auto column = Integrity::checked_span<const int>(xs).strided(i & (side - 1), side, side);
+        int total = 0;
+        for (size_t row = 0; row < column.size(); ++row) {
+            total += column[row];
+        }
+        doNotOptimize(total);
+        });
+}
+
+// ******************************************************************************************************************
+// * ----------------------------------------------- async sink --------------------------------------------------- *
+// ******************************************************************************************************************
+
+// Producers pushing failures into an AsyncSink writing to /dev/null, against formatting and writing each one inline
+void benchmark_async() {
+    const size_t perThread = 20000;
+    const char* group = "async";
+    FILE* devNull = fopen("/dev/null", "w");
+    if (devNull == nullptr) {
+        return;
+    }
+    for (size_t threads : { 1, 2, 4, 8, 16, 32, 64 }) {
+        for (Integrity::AsyncSink::Overflow overflow : { Integrity::AsyncSink::Overflow::drop, Integrity::AsyncSink::Overflow::block }) {
+            Integrity::AsyncSink sink(INTEGRITY_ASYNC_CAPACITY, fileno(devNull));
+            sink.setOverflow(overflow);
+            string name = string(overflow == Integrity::AsyncSink::Overflow::drop ? "push drop " : "push block ") + to_string(threads) + " producers";
+            run(group, name.c_str(), 3, threads * perThread, [&](size_t) {
+                vector<thread> producers;
+                for (size_t t = 0; t < threads; ++t) {
+                    producers.emplace_back([&sink, t]() {
+                        for (size_t i = 0; i < perThread; ++i) {
+                            sink.push(nullptr, "Integrity check failed", "row {} of {} has price {}", i, t, 1.5);
+                        }
+                        });
+                }
+                for (thread& t : producers) {
+                    t.join();
+                }
+                });
+            sink.flush();
+        }
+        string name = "format and write inline " + to_string(threads) + " producers";
+        run(group, name.c_str(), 3, threads * perThread, [&](size_t) {
+            vector<thread> producers;
+            for (size_t t = 0; t < threads; ++t) {
+                producers.emplace_back([devNull, t]() {
+                    for (size_t i = 0; i < perThread; ++i) {
+                        string line = Integrity::makeMessage("Integrity check failed", "row {} of {} has price {}", i, t, 1.5) + "\n";
+                        fwrite(line.data(), 1, line.size(), devNull);
+                    }
+                    });
+            }
+            for (thread& t : producers) {
+                t.join();
+            }
+            });
+    }
+    fclose(devNull);
+}
+
+// ******************************************************************************************************************
+// * --------------------------------------------- failure policy ------------------------------------------------- *
+// ******************************************************************************************************************
+
+#if INTEGRITY_FAILURE_POLICY == INTEGRITY_THROW
+static const char* policyName = "throw";
+#elif INTEGRITY_FAILURE_POLICY == INTEGRITY_ABORT
+static const char* policyName = "abort";
+#elif INTEGRITY_FAILURE_POLICY == INTEGRITY_LOG
+static const char* policyName = "log";
+#elif INTEGRITY_FAILURE_POLICY == INTEGRITY_COUNT
+static const char* policyName = "count";
+#else
+static const char* policyName = "ignore";
+#endif
+
+// The same failing checks under whichever policy benchmark.cpp was built with, e.g. -DINTEGRITY_FAILURE_POLICY=INTEGRITY_COUNT.
+// INTEGRITY_ABORT can only have its pass paths measured, so the failing benchmarks are left out for it.
+void benchmark_policy() {
+#if INTEGRITY_FAILURE_POLICY != INTEGRITY_ABORT
+    static size_t logged = 0;
+    Integrity::logHandler() = [](const char* message) { logged += message[0] != 0; };
+    int x = 1;
+    int y = 2;
+    vector<float> floats(dataSize, 1.5f);
+    floats[dataSize / 2] = std::nanf("");
+    string group = string("policy ") + policyName;
+
+    run(group.c_str(), "check", failIterations, [&](size_t) {
+        expectThrow([&]() { Integrity::check(x == y); });
+        });
+    run(group.c_str(), "check message with args", failIterations, [&](size_t i) {
+        expectThrow([&]() { Integrity::check(x == y, "Expected {} to be same as {}", x, i); });
+        });
+    run(group.c_str(), "checkM lambda", failIterations, [&](size_t i) {
+        expectThrow([&]() { Integrity::checkM(x == y, [&](Integrity::out out) { out << "Expected " << x << " to be same as " << i; }); });
+        });
+    run(group.c_str(), "checkAllValidNumbers", failIterations, dataSize, [&](size_t) {
+        expectThrow([&]() { Integrity::checkAllValidNumbers(floats); });
+        });
+#if INTEGRITY_FAILURE_POLICY == INTEGRITY_LOG
+    // one check failing over and over, with every failure logged and then with reportLimit() cutting them down
+    run(group.c_str(), "checkAt every failure logged", failIterations, [&](size_t i) {
+        Integrity::checkAt(INTEGRITY_SITE("Expected {} to be same as {}"), x == y, "Expected {} to be same as {}", x, i);
+        });
+    Integrity::reportLimit().perInterval = 10;
+    run(group.c_str(), "checkAt 10 per second logged", failIterations, [&](size_t i) {
+        Integrity::checkAt(INTEGRITY_SITE("Expected {} to be same as {}"), x == y, "Expected {} to be same as {}", x, i);
+        });
+    Integrity::reportLimit().perInterval = 0;
+    Integrity::reportLimit().sampleEvery = 1000;
+    run(group.c_str(), "checkAt 1 in 1000 logged", failIterations, [&](size_t i) {
+        Integrity::checkAt(INTEGRITY_SITE("Expected {} to be same as {}"), x == y, "Expected {} to be same as {}", x, i);
+        });
+    Integrity::reportLimit().sampleEvery = 0;
+#endif
+    doNotOptimize(logged);
+#endif
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1) {
+        filter = argv[1];
+    }
+    cout << "{\n  \"integrity_version\": \"" << Integrity::VERSION << "\",\n";
+#if defined(__clang__)
+    cout << "  \"compiler\": \"clang++ " << __VERSION__ << "\",\n";
+#elif defined(__GNUC__)
+    cout << "  \"compiler\": \"g++ " << __VERSION__ << "\",\n";
+#elif defined(_MSC_VER)
+    cout << "  \"compiler\": \"msvc " << _MSC_VER << "\",\n";
+#endif
+    cout << "  \"failure_policy\": \"" << policyName << "\",\n";
+#ifdef INTEGRITY_TO_CHARS
+    cout << "  \"number_formatting\": \"to_chars\",\n";
+#else
+    cout << "  \"number_formatting\": \"snprintf\",\n";
+#endif
+    cout << "  \"benchmarks\": [";
+
+    benchmark_pass();
+#if INTEGRITY_FAILURE_POLICY == INTEGRITY_THROW
+    // these expect the failing checks to throw
+    benchmark_fail();
+    benchmark_wide();
+#endif
+    benchmark_format();
+    benchmark_bulk();
+#if INTEGRITY_FAILURE_POLICY != INTEGRITY_ABORT
+    benchmark_collect();
+#endif
+    benchmark_sites();
+    benchmark_overflow();
+    benchmark_span();
+    benchmark_async();
+    benchmark_policy();
+
+    cout << "\n  ]\n}" << endl;
+}
@@ -0,0 +1,52 @@
+#include <string>
+#include "integrity.h"
+
+/*
+* Representative checks for codegen_test.sh, which compiles this file at -O2 and counts the instructions each probe
+* leaves on its pass path. Each probe is extern "C" so that the script can find it by name, and takes everything it
+* checks as a parameter so that the compiler cannot fold the check away.
+*/
+
+extern "C" void probe_check(bool condition) {
+    Integrity::check(condition);
+}
+
+extern "C" void probe_check_message(bool condition) {
+    Integrity::check(condition, "message");
+}
+
+extern "C" void probe_check_int(bool condition, int value) {
+    Integrity::check(condition, "value is {}", value);
+}
+
+extern "C" void probe_check_string(bool condition, const std::string& name) {
+    Integrity::check(condition, "name is {}", name);
+}
+
+extern "C" void probe_check_mixed(bool condition, const char* name, double value, long long count) {
+    Integrity::check(condition, "{} is {} after {}", name, value, count);
+}
+
+extern "C" void probe_checkNotNull(const void* pointer) {
+    Integrity::checkNotNull(pointer, "pointer");
+}
+
+extern "C" void probe_checkIsValidNumber(double value) {
+    Integrity::checkIsValidNumber(value, "value");
+}
+
+extern "C" void probe_checkStringNotNullOrEmpty(const char* text) {
+    Integrity::checkStringNotNullOrEmpty(text, "text");
+}
+
+extern "C" std::size_t probe_checkedAdd(std::size_t a, std::size_t b) {
+    return Integrity::checkedAdd(a, b);
+}
+
+extern "C" std::size_t probe_checkedMul(std::size_t a, std::size_t b) {
+    return Integrity::checkedMul(a, b);
+}
+
+extern "C" unsigned char probe_narrow(int value) {
+    return Integrity::narrow<unsigned char>(value);
+}
@@ -0,0 +1,39 @@
+#!/bin/sh
+# Compiles codegen_probe.cpp at -O2 and checks that each probe's pass path is still a test, a branch to the cold failure
+# path and a return, i.e. that no message arg is copied or converted and no failure work is inlined before the branch.
+# The pass path is counted as the instructions up to the first ret, or the function's cold part (.text.unlikely) or end.
+#     ./codegen_test.sh [compiler]
+CXX=${1:-${CXX:-g++}}
+ASM=$(mktemp) || exit 1
+trap 'rm -f "$ASM"' EXIT
+
+"$CXX" -std=c++14 -O2 -S -o "$ASM" codegen_probe.cpp || exit 1
+
+status=0
+for probe in $(sed -n 's/^extern "C" [A-Za-z_: ]* \(probe_[A-Za-z_]*\)(.*/\1/p' codegen_probe.cpp); do
+    case $probe in
+        # fabs is an and with a mask, which has to be loaded along with the limit it is compared with
+        probe_checkIsValidNumber) max=6 ;;
+        # a null test, then a test of the first character
+        probe_checkStringNotNullOrEmpty) max=5 ;;
+        # the result is moved into the return register, then the operation, the branch on its flag and the return
+        probe_checkedAdd | probe_checkedMul | probe_narrow) max=4 ;;
+        *) max=3 ;;
+    esac
+    count=$(awk -v label="$probe:" '
+        $1 == label { inside = 1; next }
+        inside && ($1 ~ /^\.section/ || $1 == ".cfi_endproc" || $1 == ".size") { exit }
+        inside && $1 !~ /^\./ && $1 !~ /:$/ { count++ }
+        inside && $1 == "ret" { exit }
+        END { print count + 0 }' "$ASM")
+    if [ "$count" -eq 0 ]; then
+        echo "FAIL $probe: not found in the assembly"
+        status=1
+    elif [ "$count" -gt "$max" ]; then
+        echo "FAIL $probe: $count instructions on the pass path, expected at most $max"
+        status=1
+    else
+        echo "ok   $probe: $count instructions"
+    fi
+done
+exit $status
@@ -4,11 +4,145 @@
 #include <string>
 #include <stdexcept>
 #include <vector>
+#include <array>
+#include <tuple>
+#include <utility>
 #include <sstream>
-#include <iomanip> // for the string formating functions like setfill 
+#include <iomanip> // so that message lambdas can use std::setw, std::setfill and the like
 #include <cstring>
 #include <cmath>
+#include <cstdint>
+#include <type_traits>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <iterator>
+#include <limits>
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+// std::to_chars writes the numbers in messages when the library has it for floating point (g++ 11, MSVC 2019 and on)
+#if ((defined(_MSVC_LANG) && _MSVC_LANG >= 201703L) || __cplusplus >= 201703L) && defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+#define INTEGRITY_TO_CHARS
+#endif
+// The single value checks are constexpr. The bulk ones can only be from C++20, where they can tell that they are being
+// evaluated at compile time and use a plain loop instead of the SIMD kernels.
+#if defined(__cpp_lib_is_constant_evaluated) && __cpp_lib_is_constant_evaluated >= 201811L
+#define INTEGRITY_CONSTANT_EVALUATED() std::is_constant_evaluated()
+#define INTEGRITY_CONSTEXPR_BULK constexpr
+#else
+#define INTEGRITY_CONSTANT_EVALUATED() false
+#define INTEGRITY_CONSTEXPR_BULK inline
+#endif
  
+// The bulk checks have SSE2, AVX2 and AVX-512 kernels, picked at runtime, on x86 with g++ and clang.
+// MSVC on x64 always has SSE2 so uses that. Define INTEGRITY_NO_SIMD to only use the plain C++ loops.
+#if !defined(INTEGRITY_NO_SIMD) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define INTEGRITY_X86_SIMD
+#define INTEGRITY_X86_RUNTIME_DISPATCH
+#include <immintrin.h>
+#elif !defined(INTEGRITY_NO_SIMD) && defined(_MSC_VER) && (defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define INTEGRITY_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define INTEGRITY_COLD __attribute__((cold, noinline))
+#elif defined(_MSC_VER)
+#define INTEGRITY_COLD __declspec(noinline)
+#else
+#define INTEGRITY_COLD
+#endif
+
+// What a failing check does. Define INTEGRITY_FAILURE_POLICY as one of these before including integrity.h to choose it
+// for that translation unit; only the chosen one is compiled in. The checks are in an inline namespace named after the
+// policy, so translation units with different policies can be linked together without breaking the one definition rule.
+#define INTEGRITY_THROW 1  // raise a std::logic_error (the default)
+#define INTEGRITY_ABORT 2  // pass the message to Integrity::logHandler() then abort
+#define INTEGRITY_LOG 3    // pass the message to Integrity::logHandler() and carry on
+#define INTEGRITY_COUNT 4  // add one to Integrity::failureCount() and carry on, without building the message
+#define INTEGRITY_IGNORE 5 // do nothing, so the checks compile down to evaluating their arguments
+#define INTEGRITY_ASYNC 6  // queue the failure for Integrity::asyncSink() to write out on its own thread, and carry on
+
+// Whether exceptions are on. With -fno-exceptions (or /EHs- on MSVC) the default policy is INTEGRITY_ABORT instead, and
+// the tryCheck functions, which return a Result rather than raising, are how to notice a failure and carry on.
+#ifndef INTEGRITY_EXCEPTIONS
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+#define INTEGRITY_EXCEPTIONS 1
+#else
+#define INTEGRITY_EXCEPTIONS 0
+#endif
+#endif
+#ifndef INTEGRITY_FAILURE_POLICY
+#if INTEGRITY_EXCEPTIONS
+#define INTEGRITY_FAILURE_POLICY INTEGRITY_THROW
+#else
+#define INTEGRITY_FAILURE_POLICY INTEGRITY_ABORT
+#endif
+#endif
+#if INTEGRITY_FAILURE_POLICY == INTEGRITY_THROW && !INTEGRITY_EXCEPTIONS
+#error INTEGRITY_THROW needs exceptions; choose another INTEGRITY_FAILURE_POLICY, or use the tryCheck functions
+#endif
+
+#if INTEGRITY_FAILURE_POLICY == INTEGRITY_THROW
+#define INTEGRITY_POLICY_NAMESPACE throwing
+#elif INTEGRITY_FAILURE_POLICY == INTEGRITY_ABORT
+#define INTEGRITY_POLICY_NAMESPACE aborting
+#elif INTEGRITY_FAILURE_POLICY == INTEGRITY_LOG
+#define INTEGRITY_POLICY_NAMESPACE logging
+#elif INTEGRITY_FAILURE_POLICY == INTEGRITY_COUNT
+#define INTEGRITY_POLICY_NAMESPACE counting
+#elif INTEGRITY_FAILURE_POLICY == INTEGRITY_IGNORE
+#define INTEGRITY_POLICY_NAMESPACE ignoring
+#elif INTEGRITY_FAILURE_POLICY == INTEGRITY_ASYNC
+#define INTEGRITY_POLICY_NAMESPACE asyncLogging
+#else
+#error INTEGRITY_FAILURE_POLICY has to be one of INTEGRITY_THROW, INTEGRITY_ABORT, INTEGRITY_LOG, INTEGRITY_COUNT, INTEGRITY_IGNORE or INTEGRITY_ASYNC
+#endif
+
+#if INTEGRITY_FAILURE_POLICY == INTEGRITY_IGNORE
+#define INTEGRITY_FAILURE_PATH inline
+#else
+#define INTEGRITY_FAILURE_PATH INTEGRITY_COLD
+#endif
+
+// Which levels of check are compiled in. Integrity::check and the other plain checks are always in, Integrity::debug and
+// INTEGRITY_DEBUG are in from INTEGRITY_LEVEL_DEBUG up, and Integrity::audit and INTEGRITY_AUDIT, for checks too slow for
+// most builds (such as re-validating a whole index), only at INTEGRITY_LEVEL_AUDIT. Of the levels compiled in, only those
+// up to Integrity::activeLevel() run, which can be changed while the program runs. It is one flag shared by every translation
+// unit, whatever their INTEGRITY_LEVEL, so it starts with every level on (only those compiled in can run) unless a
+// translation unit defines INTEGRITY_RUNTIME_LEVEL, which sets the flag when that translation unit is initialised.
+#define INTEGRITY_LEVEL_ALWAYS 0
+#define INTEGRITY_LEVEL_DEBUG 1
+#define INTEGRITY_LEVEL_AUDIT 2
+#ifndef INTEGRITY_LEVEL
+#ifdef NDEBUG
+#define INTEGRITY_LEVEL INTEGRITY_LEVEL_ALWAYS
+#else
+#define INTEGRITY_LEVEL INTEGRITY_LEVEL_DEBUG
+#endif
+#endif
+#if INTEGRITY_LEVEL == INTEGRITY_LEVEL_ALWAYS
+#define INTEGRITY_LEVEL_NAMESPACE alwaysLevel
+#elif INTEGRITY_LEVEL == INTEGRITY_LEVEL_DEBUG
+#define INTEGRITY_LEVEL_NAMESPACE debugLevel
+#elif INTEGRITY_LEVEL == INTEGRITY_LEVEL_AUDIT
+#define INTEGRITY_LEVEL_NAMESPACE auditLevel
+#else
+#error INTEGRITY_LEVEL has to be one of INTEGRITY_LEVEL_ALWAYS, INTEGRITY_LEVEL_DEBUG or INTEGRITY_LEVEL_AUDIT
+#endif
 
 /*
 * Notes
@@ -23,495 +157,5223 @@ namespace Integrity {
 	static constexpr const char* defaultNullPointerMessage = "Null pointer";
 	static constexpr const char* defaultEmptyStringMessage = "Empty string";
 
-	enum class DispType;
-	struct TypeValue;
-	static std::string makeString(const char* defaultMessage, const std::vector<TypeValue>& items);
-	static std::string makeString(const std::function<void(std::stringstream&)>& messageFunc);
-	static void throwWithMessage(const char* defaultMessage, const std::vector<Integrity::TypeValue>& items);
-	template<typename T> static const char* getFloatAppropriateMessage(T value);
-	template<typename T> TypeValue toTypeValue(T primitive);
-
-	using out = std::stringstream &;
+	/// <summary>
+	/// What a failed check found, so that a handler can tell failures apart without looking at their messages
+	/// </summary>
+	enum class FailureKind : unsigned char {
+		condition, // check, checkAt, fail and anything else not listed below
+		nullPointer,
+		emptyString,
+		notANumber,
+		positiveInfinity,
+		negativeInfinity,
+		outOfOrder, // checkSorted and checkStrictlyIncreasing
+		outOfRange, // checkAllInRange
+		duplicate, // checkUnique
+		overflow, // checkedAdd, checkedSub, checkedMul and checkedSum
+		narrowing, // narrow and narrowAll
+		outOfBounds, // checked_span and checked_stride
+	};
 
+	/// <summary>
+	/// The message a failure of this kind has when it was not given any message args
+	/// </summary>
+	constexpr const char* defaultMessageFor(FailureKind kind) {
+		return kind == FailureKind::nullPointer ? defaultNullPointerMessage :
+			kind == FailureKind::emptyString ? defaultEmptyStringMessage :
+			kind == FailureKind::notANumber ? "NaN" :
+			kind == FailureKind::positiveInfinity ? "+Infinity" :
+			kind == FailureKind::negativeInfinity ? "-Infinity" :
+			kind == FailureKind::outOfOrder ? "Out of order" :
+			kind == FailureKind::outOfRange ? "Out of range" :
+			kind == FailureKind::duplicate ? "Duplicate" :
+			kind == FailureKind::overflow ? "Overflow" :
+			kind == FailureKind::narrowing ? "Narrowing" :
+			kind == FailureKind::outOfBounds ? "Out of bounds" : defaultExceptionMessage;
+	}
 
+	// the index of a failure which was not found by one of the bulk checks
+	static constexpr std::size_t noFailureIndex = ~(std::size_t) 0;
 
-	class NonType {
-	private:
-		NonType() {};
+	enum class DispType;
+	struct TypeValue;
+	class Writer;
+	class Collector;
+	class Site;
+	class Result;
+	static std::string makeString(const char* defaultMessage, const TypeValue* items, std::size_t count);
+	static std::string makeString(const std::function<void(std::stringstream&)>& messageFunc);
+	template<typename F> static std::string makeStringFromLambda(F& messageFunc);
+	inline namespace INTEGRITY_POLICY_NAMESPACE {
+	INTEGRITY_FAILURE_PATH static void failWithMessage(FailureKind kind, const char* message);
+	INTEGRITY_FAILURE_PATH static void failWithMessage(FailureKind kind, const std::function<void(std::stringstream&)>& messageFunc);
+	template<typename F> INTEGRITY_FAILURE_PATH void failWithLambda(FailureKind kind, F& messageFunc);
+	template<typename... M>
+	INTEGRITY_FAILURE_PATH void failWithArgs(FailureKind kind, M... m);
+	template<typename N, typename... M>
+	INTEGRITY_FAILURE_PATH void failWithInvalidNumber(const N value, M... m);
+	template<typename... M>
+	INTEGRITY_FAILURE_PATH void failAtIndex(FailureKind kind, std::size_t index, M... m);
+	template<typename... M>
+	INTEGRITY_FAILURE_PATH void failAtSite(Site& site, const char* function, M... m);
+	template<typename N, typename... M>
+	INTEGRITY_FAILURE_PATH void failWithInvalidNumberAt(const N value, std::size_t index, M... m);
+	template<typename... M>
+	INTEGRITY_FAILURE_PATH void failWithResult(const Result& result, M... m);
+	template<typename A, typename B, typename... M>
+	INTEGRITY_FAILURE_PATH void failWithOperands(FailureKind kind, Site& operation, A a, B b, std::size_t index, M... m);
+	template<typename... M>
+	INTEGRITY_FAILURE_PATH void failWindowOutOfBounds(std::size_t offset, std::size_t length, std::size_t stride, std::size_t size, M... m);
+	template<typename T, typename... M>
+	INTEGRITY_FAILURE_PATH T& failIndexOutOfBounds(std::size_t index, std::size_t size, M... m);
+	template<typename T, typename... M>
+	INTEGRITY_FAILURE_PATH T failSumOverflow(T total, const T* data, std::size_t index, std::size_t count, M... m);
+	}
+	template<typename T> inline FailureKind invalidNumberKind(T value);
+	inline std::size_t findFirstInvalidNumber(const float* data, std::size_t count);
+	inline std::size_t findFirstInvalidNumber(const double* data, std::size_t count);
+	inline std::size_t findFirstInvalidNumber(const long double* data, std::size_t count);
+	inline std::size_t findFirstNull(const void* const* pointers, std::size_t count);
+	template<typename C> std::size_t findFirstNullInRange(const C& pointers);
+	template<typename C> std::size_t findFirstNullOrEmptyString(const C& strings, std::size_t count, const char*& problem);
+	template<bool Strict, typename T> std::size_t findFirstUnsorted(const T* data, std::size_t count);
+	template<typename T> std::size_t findFirstOutOfRange(const T* data, std::size_t count, const T& lo, const T& hi);
+	template<typename I> std::size_t findFirstDuplicate(I first, std::size_t count);
 
-	public:
-		static NonType& Singleton()
-		{
-			static NonType Singleton;
-			return Singleton;
+	// How a message argument is handed to the out of line failure functions: primitives and char*s by value
+	// (so that a passing check never has to spill them to the stack to take their address), anything else by const&
+	template<typename M> using PassArg = typename std::conditional<std::is_scalar<typename std::decay<M>::type>::value,
+		typename std::decay<M>::type, const typename std::remove_reference<M>::type&>::type;
+	// std::isfinite is not constexpr before C++23. The builtin is, and compiles to the same single compare.
+	// Without it, a finite number is the only kind for which value - value is 0 (NaN and Infinity give NaN).
+	template<typename N> constexpr typename std::enable_if<std::is_floating_point<N>::value, bool>::type isFiniteNumber(N value) {
+#if defined(__GNUC__) || defined(__clang__)
+		return __builtin_isfinite(value);
+#else
+		return value - value == 0;
+#endif
+	}
+	template<typename N> constexpr typename std::enable_if<!std::is_floating_point<N>::value, bool>::type isFiniteNumber(N) {
+		return true;
+	}
+	// the bulk number search for when it is evaluated at compile time
+	template<typename N> constexpr std::size_t findFirstInvalidNumberConstant(const N* data, std::size_t count) {
+		for (std::size_t i = 0; i < count; ++i) {
+			if (!isFiniteNumber(data[i])) {
+				return i;
+			}
 		}
+		return count;
+	}
+	// The condition of one of the levelled checks, which is either a bool or a predicate that is only called if the level is on
+	template<typename C> constexpr typename std::enable_if<std::is_same<typename std::decay<C>::type, bool>::value, bool>::type holds(C condition) {
+		return condition;
+	}
+	template<typename P> constexpr auto holds(P& predicate) -> decltype(static_cast<bool>(predicate())) {
+		return static_cast<bool>(predicate());
+	}
+	// Calls f on each message argument in order. C++14 has no fold expressions, so the pack is expanded
+	// inside an array initialiser instead, which the language guarantees is evaluated left to right.
+	template<typename F, typename... M> inline void forEachArg(F&& f, const M&... m) {
+		int expand[] = { 0, (f(m), 0)... };
+		(void) expand;
+	}
+	// Calls f with the operands of a failed operation, e.g. the 3 and 5 of 'Overflow in 3 + 5', as separate arguments
+	template<typename F, typename... O, std::size_t... I>
+	inline auto applyOperands(F&& f, const std::tuple<O...>& operands, std::index_sequence<I...>) -> decltype(f(std::get<I>(operands)...)) {
+		return f(std::get<I>(operands)...);
+	}
+	template<typename F, typename... O>
+	inline auto applyOperands(F&& f, const std::tuple<O...>& operands) -> decltype(applyOperands(f, operands, std::index_sequence_for<O...>())) {
+		return applyOperands(f, operands, std::index_sequence_for<O...>());
+	}
+	// Whether a message lambda takes an Integrity::out (a Writer&), or was written for a std::stringstream&
+	template<typename F, typename = void> struct TakesWriter : std::false_type {
 	};
+	template<typename F> struct TakesWriter<F, decltype(std::declval<F&>()(std::declval<Writer&>()), void())> : std::true_type {
+	};
+	template<typename F, typename = void> struct TakesStringStream : std::false_type {
+	};
+	template<typename F> struct TakesStringStream<F, decltype(std::declval<F&>()(std::declval<std::stringstream&>()), void())> : std::true_type {
+	};
+	// Enables the overloads of the ...M functions which take the lambda as it is, rather than as a std::function which would
+	// type erase it (and for larger captures heap allocate it) on every call. A std::function or nullptr goes to the original overloads.
+	template<typename F> using EnableIfMessageLambda = typename std::enable_if<
+		!std::is_same<typename std::decay<F>::type, std::function<void(std::stringstream&)>>::value &&
+		!std::is_same<typename std::decay<F>::type, std::nullptr_t>::value &&
+		(TakesWriter<F>::value || TakesStringStream<F>::value)>::type;
+	template<typename T> inline FailureKind invalidNumberKind(T value);
+	template<typename T> TypeValue toTypeValue(T primitive);
+	inline TypeValue toTypeValue(const std::string& value);
+
+	using out = Writer&;
 
 	// ******************************************************************************************************************
-	// * -------------------------------------------------- check------------------------------------------------------ *
+	// * ------------------------------------------------- Format ----------------------------------------------------- *
 	// ******************************************************************************************************************
 
 	/// <summary>
-	/// Checks whether a condition is true, if not raises a logic_error with default message
+	/// Counts the {} placeholders in a format string, usable at compile time
 	/// </summary>
-	/// <param name="condition">The condition to check is true.</param>
-	/// <exception cref="logic_error">Raised if condition is false</exception>
-	inline void check(bool condition) {
-		if (!condition) {
-			throw std::logic_error(defaultExceptionMessage);
+	constexpr std::size_t countPlaceholders(const char* text) {
+		std::size_t count = 0;
+		for (std::size_t i = 0; text[i] != '\0'; ++i) {
+			if (text[i] == '{' && text[i + 1] == '}') {
+				++count;
+				++i;
+			}
 		}
+		return count;
 	}
 
 	/// <summary>
-	/// Checks whether a condition is true, if not raises a logic_error with given message
+	/// A format string whose {} placeholders are found at compile time. Create one with INTEGRITY_FORMAT.
 	/// </summary>
-	/// <param name="condition">The condition to check is true.</param>
-	/// <exception cref="logic_error">Raised if condition is false</exception>
-	inline void check(bool condition, const char* message) {
-		if (!condition) {
-			throw std::logic_error(message);
+	/// <remarks>
+	/// When passed as the first message argument the number of remaining message arguments must equal
+	/// the number of placeholders, otherwise there is a compile error. The text between the placeholders
+	/// is kept as a table of segments so the message is filled in one pass when the check fails.
+	/// </remarks>
+	template<std::size_t Placeholders>
+	class Format {
+	public:
+		struct Segment {
+			std::size_t offset;
+			std::size_t length;
+		};
+
+		template<std::size_t L>
+		constexpr Format(const char(&text)[L]) : text(text), literalLength(0), segments{} {
+			std::size_t segment = 0;
+			std::size_t start = 0;
+			for (std::size_t i = 0; i + 1 < L; ++i) {
+				if (text[i] == '{' && text[i + 1] == '}' && segment < Placeholders) {
+					segments[segment].offset = start;
+					segments[segment].length = i - start;
+					++segment;
+					start = i + 2;
+					++i;
+				}
+			}
+			segments[segment].offset = start;
+			segments[segment].length = L - 1 - start;
+			for (std::size_t i = 0; i <= Placeholders; ++i) {
+				literalLength += segments[i].length;
+			}
 		}
+
+		const char* text;
+		std::size_t literalLength; // total length of the text with the placeholders taken out
+		Segment segments[Placeholders + 1];
+	};
+
+	template<typename T> struct IsFormat : std::false_type {
+	};
+	template<std::size_t Placeholders> struct IsFormat<Format<Placeholders>> : std::true_type {
+	};
+	template<typename... M> struct AnyFormat : std::false_type {
+	};
+	template<typename M, typename... Rest> struct AnyFormat<M, Rest...> : std::integral_constant<bool, IsFormat<M>::value || AnyFormat<Rest...>::value> {
+	};
+	template<typename... M> struct FormatNotAfterFirst : std::true_type {
+	};
+	template<typename M, typename... Rest> struct FormatNotAfterFirst<M, Rest...> : std::integral_constant<bool, !AnyFormat<Rest...>::value> {
+	};
+	// Whether the message arguments match the number of {} in their Integrity::Format, when the first of them is one
+	template<typename... M> struct FormatMatchesArgs : std::true_type {
+	};
+	template<std::size_t Placeholders, typename... M> struct FormatMatchesArgs<Format<Placeholders>, M...>
+		: std::integral_constant<bool, Placeholders == sizeof...(M)> {
+	};
+	// Checked by every failure path, whatever the policy, so a mistake is a compile error even where the message is never built
+	template<typename... M> inline void checkFormatArgs() {
+		static_assert(FormatNotAfterFirst<M...>::value, "An Integrity::Format has to be the first message argument");
+		static_assert(FormatMatchesArgs<M...>::value, "The number of message arguments does not match the number of {} in the Integrity::Format");
 	}
 
 	/// <summary>
-	/// Placeholder to prevent non-bool being passed in as first parameter.
+	/// Makes a compile time parsed Integrity::Format from a string literal
 	/// </summary>
-	/// <param name="youNeedABool">Did you accidentally do = instead of ==?</param>
-	/// <remarks>If this is not here then common errors like check(a = b) instead of check(a == b) do not get caught by compiler</remarks>
-	template<typename NONBOOL, typename M1 = NonType, typename M2 = NonType, typename M3 = NonType, typename M4 = NonType>
-	inline void check(NONBOOL youNeedABoolHere, M1 m1 = NonType::Singleton(), M2 m2 = NonType::Singleton(), M3 m3 = NonType::Singleton(), M4 m4 = NonType::Singleton()) = delete;
+	/// <example>Integrity::check(a == b, INTEGRITY_FORMAT("Expected {} to be {}"), a, b);</example>
+	/// <remarks>The Format is a static constant, so a passing check only passes its address</remarks>
+#define INTEGRITY_FORMAT(text) \
+	([]() -> const ::Integrity::Format<::Integrity::countPlaceholders(text)>& { \
+		static constexpr ::Integrity::Format<::Integrity::countPlaceholders(text)> format(text); \
+		return format; \
+	}())
 
-	/// <summary>
-	/// Checks whether a condition is true, if not raises a logic_error
-	/// </summary>
-	/// <param name="condition">The condition to check is true.</param>
-	/// <param name="M1">Optional string or primitive</param>
-	/// <param name="M2">Optional string or primitive</param>
-	/// <param name="M3">Optional string or primitive</param>
-	/// <param name="M4">Optional string or primitive</param>
-	/// <exception cref="logic_error">Raised if condition is false</exception>
-	template<typename M1 = NonType, typename M2 = NonType, typename M3 = NonType, typename M4 = NonType>
-	inline void check(bool condition, M1 m1 = NonType::Singleton(), M2 m2 = NonType::Singleton(), M3 m3 = NonType::Singleton(), M4 m4 = NonType::Singleton()) {
-		if (!condition) {
-			throwWithMessage(defaultExceptionMessage, { toTypeValue(m1), toTypeValue(m2), toTypeValue(m3), toTypeValue(m4) });
+	// ******************************************************************************************************************
+	// * ------------------------------------------- number formatting ------------------------------------------------ *
+	// ******************************************************************************************************************
+
+	/*
+	* The numbers in messages are written into a char buffer of at least numberTextSize, without a stream or a std::string.
+	* Integers come out the same as std::to_string writes them. Floating point numbers are written in the shortest form
+	* which reads back as the same value, so 0.1f is 0.1 and 1.5 is 1.5, where std::to_string wrote 0.100000 and 1.500000
+	* and lost anything past six decimal places. std::to_chars does that when the library has it for floating point,
+	* otherwise the precision is raised from the number of digits the type always keeps until the text reads back the same.
+	*/
+	static constexpr std::size_t numberTextSize = 48;
+
+	template<typename T>
+	inline typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, std::size_t>::type formatNumber(char* buffer, T value) {
+#ifdef INTEGRITY_TO_CHARS
+		return (std::size_t) (std::to_chars(buffer, buffer + numberTextSize, value).ptr - buffer);
+#else
+		// two digits at a time, from a table of 00 to 99, working back from the end
+		static constexpr char pairs[] =
+			"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+			"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+			"8081828384858687888990919293949596979899";
+		typedef typename std::make_unsigned<T>::type Unsigned;
+		char digits[24];
+		char* start = digits + sizeof(digits);
+		Unsigned magnitude = value < 0 ? (Unsigned) (0 - (Unsigned) value) : (Unsigned) value;
+		while (magnitude >= 100) {
+			std::size_t pair = (std::size_t) (magnitude % 100) * 2;
+			magnitude /= 100;
+			*--start = pairs[pair + 1];
+			*--start = pairs[pair];
 		}
+		if (magnitude >= 10) {
+			*--start = pairs[magnitude * 2 + 1];
+			*--start = pairs[magnitude * 2];
+		}
+		else {
+			*--start = (char) ('0' + magnitude);
+		}
+		if (value < 0) {
+			*--start = '-';
+		}
+		std::size_t length = (std::size_t) (digits + sizeof(digits) - start);
+		std::memcpy(buffer, start, length);
+		return length;
+#endif
 	}
 
-	template<typename B> inline void checkM(B condition, const std::function<void(std::stringstream&)>& messageFunc)=delete;
+#ifndef INTEGRITY_TO_CHARS
+	inline float readNumber(const char* text, float) {
+		return std::strtof(text, nullptr);
+	}
+	inline double readNumber(const char* text, double) {
+		return std::strtod(text, nullptr);
+	}
+	inline long double readNumber(const char* text, long double) {
+		return std::strtold(text, nullptr);
+	}
+	// any number with up to digits significant digits reads back the same, so the first precision which reads back is the shortest
+	template<typename T> inline std::size_t formatShortest(char* buffer, T value, const char* format, int digits, int maxDigits) {
+		int length = 0;
+		for (int precision = digits; precision <= maxDigits; ++precision) {
+			length = std::snprintf(buffer, numberTextSize, format, precision, value);
+			if (!std::isfinite(value) || readNumber(buffer, value) == value) {
+				break;
+			}
+		}
+		return length < 0 ? 0 : (std::size_t) length;
+	}
+#endif
+
+	inline std::size_t formatNumber(char* buffer, float value) {
+#ifdef INTEGRITY_TO_CHARS
+		return (std::size_t) (std::to_chars(buffer, buffer + numberTextSize, value).ptr - buffer);
+#else
+		return formatShortest(buffer, value, "%.*g", 6, 9);
+#endif
+	}
+	inline std::size_t formatNumber(char* buffer, double value) {
+#ifdef INTEGRITY_TO_CHARS
+		return (std::size_t) (std::to_chars(buffer, buffer + numberTextSize, value).ptr - buffer);
+#else
+		return formatShortest(buffer, value, "%.*g", 15, 17);
+#endif
+	}
+	inline std::size_t formatNumber(char* buffer, long double value) {
+#ifdef INTEGRITY_TO_CHARS
+		return (std::size_t) (std::to_chars(buffer, buffer + numberTextSize, value).ptr - buffer);
+#else
+		return formatShortest(buffer, value, "%.*Lg", 18, 21);
+#endif
+	}
 
 	/// <summary>
-	/// Checks whether a condition is true, if not raises a logic_error where you can pass a lambda function to build the message
+	/// A character beyond 0xff as 0x and width upper case hex digits, e.g. '0x0BCD' for a char16_t, else the character itself
 	/// </summary>
-	/// <param name="condition">The condition to check is true.</param>
-	/// <param name="messageFunc">Example: [=](Integrity::out out) { out &lt;&lt; whateverYouWant; }</param>
-	/// <exception cref="logic_error">Raised if condition is false</exception>
-	/// <remarks>
-	/// This function exists so that you can control the deferred message building by passing in a lambda function which is called if the condition fails.
-	/// </remarks> 
-	template<> inline void checkM<bool>(bool condition, const std::function<void(std::stringstream&)>& messageFunc) {
-		if (!condition) {
-			throw std::logic_error(makeString(messageFunc));
+	inline std::size_t formatWideChar(char* buffer, char32_t value, std::size_t width) {
+		if (value <= 0xff) {
+			buffer[0] = (char) value;
+			return 1;
 		}
+		static constexpr char hexDigits[] = "0123456789ABCDEF";
+		buffer[0] = '0';
+		buffer[1] = 'x';
+		for (std::size_t i = 0; i < width; ++i) {
+			buffer[1 + width - i] = hexDigits[(value >> (4 * i)) & 0xF];
+		}
+		return 2 + width;
 	}
 
 	// ******************************************************************************************************************
-	// * -------------------------------------------------- fail ------------------------------------------------------ *
+	// * ------------------------------------------------- Writer ----------------------------------------------------- *
 	// ******************************************************************************************************************
-			
+
 	/// <summary>
-	/// Raises a logic_error with a default message
+	/// A std::streambuf which appends straight onto a string, so a std::ostream can write into a Writer's buffer
 	/// </summary>
-	/// <exception cref="logic_error"></exception>
-	inline void fail() {
-		throw std::logic_error(defaultExceptionMessage);
-	}
+	class StringAppendBuffer : public std::streambuf {
+	public:
+		explicit StringAppendBuffer(std::string& text) : text(text) {
+		}
 
-	inline void fail(const char* message) {
-		throw std::logic_error(message);
-	}
+	protected:
+		int_type overflow(int_type c) override {
+			if (!traits_type::eq_int_type(c, traits_type::eof())) {
+				text += traits_type::to_char_type(c);
+			}
+			return traits_type::not_eof(c);
+		}
+		std::streamsize xsputn(const char* s, std::streamsize count) override {
+			text.append(s, (std::size_t) count);
+			return count;
+		}
+
+	private:
+		std::string& text;
+	};
 
 	/// <summary>
-	/// Raises a logic_error where you can pass a lambda function to build the message
+	/// What the message lambdas of the ...M functions write to. Integrity::out is a Writer&amp;.
 	/// </summary>
-	/// <param name="messageFunc">Example: [=](Integrity::out out) { out &lt;&lt; whateverYouWant; }</param>
-	/// <exception cref="logic_error">Raised if condition is false</exception>
 	/// <remarks>
-	/// This function exists so that you can control the deferred message building by passing in a lambda function which is called if the condition fails.
+	/// Strings, characters, bools and numbers are appended to a growable buffer directly, without the virtual calls and
+	/// locale lookups of a std::stringstream, and come out the same as a std::ostream with its default settings would
+	/// write them. Each thread reuses one Writer, so once its buffer has grown to fit the messages nothing is allocated.
+	/// Anything else, such as manipulators like std::hex or std::setw and types with their own operator&lt;&lt;, goes to a
+	/// std::ostream adapter which writes into the same buffer, and from then on the rest of the message goes through the
+	/// adapter too, so that the manipulators still apply. stream() gives the adapter for code which needs a std::ostream&amp;.
 	/// </remarks>
-	inline void failM(const std::function<void(std::stringstream&)>& messageFunc) {
-		throw std::logic_error(makeString(messageFunc));
-	}
+	class Writer {
+	public:
+		Writer() : streaming(false), leased(false) {
+		}
+		Writer(const Writer&) = delete; // the adapter holds on to the buffer
+		Writer& operator=(const Writer&) = delete;
 
-	/// <summary>
-	/// Raises a logic_error
-	/// </summary>
-	/// <param name="M1">Optional string or primitive</param>
-	/// <param name="M2">Optional string or primitive</param>
-	/// <param name="M3">Optional string or primitive</param>
-	/// <param name="M4">Optional string or primitive</param>
-	/// <exception cref="logic_error"></exception>
-	template<typename M1 = NonType, typename M2 = NonType, typename M3 = NonType, typename M4 = NonType>
-	inline void fail(const M1& m1 = NonType::Singleton(), const M2& m2 = NonType::Singleton(), const M3& m3 = NonType::Singleton(), const M4& m4 = NonType::Singleton()) {
-		throwWithMessage(defaultExceptionMessage, { toTypeValue(m1), toTypeValue(m2), toTypeValue(m3), toTypeValue(m4) });
-	}
+		Writer& operator<<(const char* s) {
+			if (streaming) {
+				*adapter << s;
+			}
+			else if (s != nullptr) { // a std::ostream writes nothing for a null char* either
+				text += s;
+			}
+			return *this;
+		}
+		Writer& operator<<(const std::string& s) {
+			return write(s.data(), s.length());
+		}
+		Writer& operator<<(char c) {
+			if (streaming) {
+				*adapter << c;
+			}
+			else {
+				text += c;
+			}
+			return *this;
+		}
+		Writer& operator<<(signed char c) {
+			return *this << (char) c;
+		}
+		Writer& operator<<(unsigned char c) {
+			return *this << (char) c;
+		}
+		Writer& operator<<(bool value) {
+			return streaming ? streamed(value) : *this << (value ? '1' : '0');
+		}
+		Writer& operator<<(short value) {
+			return integer(value);
+		}
+		Writer& operator<<(unsigned short value) {
+			return integer(value);
+		}
+		Writer& operator<<(int value) {
+			return integer(value);
+		}
+		Writer& operator<<(unsigned value) {
+			return integer(value);
+		}
+		Writer& operator<<(long value) {
+			return integer(value);
+		}
+		Writer& operator<<(unsigned long value) {
+			return integer(value);
+		}
+		Writer& operator<<(long long value) {
+			return integer(value);
+		}
+		Writer& operator<<(unsigned long long value) {
+			return integer(value);
+		}
+		// %g with 6 significant digits is what a std::ostream does by default
+		Writer& operator<<(float value) {
+			return *this << (double) value;
+		}
+		Writer& operator<<(double value) {
+			return streaming ? streamed(value) : printed("%g", value);
+		}
+		Writer& operator<<(long double value) {
+			return streaming ? streamed(value) : printed("%Lg", value);
+		}
+		Writer& operator<<(std::ostream& (*manipulator)(std::ostream&)) {
+			manipulator(stream());
+			return *this;
+		}
+		Writer& operator<<(std::ios_base& (*manipulator)(std::ios_base&)) {
+			manipulator(stream());
+			return *this;
+		}
+		// everything else, e.g. pointers, std::setw or a class with its own operator<<
+		template<typename T> Writer& operator<<(const T& value) {
+			stream() << value;
+			return *this;
+		}
 
-	// ******************************************************************************************************************
-	// * -------------------------------------- checkIsValidNumber ---------------------------------------------------- *
-	// ******************************************************************************************************************
+		Writer& write(const char* s, std::size_t length) {
+			if (streaming) {
+				adapter->write(s, (std::streamsize) length);
+			}
+			else {
+				text.append(s, length);
+			}
+			return *this;
+		}
 
+		/// <summary>
+		/// A std::ostream which writes into this Writer, for lambdas written for a std::stringstream
+		/// </summary>
+		std::ostream& stream() {
+			if (!adapter) {
+				adapter.reset(new Adapter(text));
+			}
+			streaming = true;
+			return *adapter;
+		}
+		operator std::ostream&() {
+			return stream();
+		}
 
-	template<typename N>
-	inline void checkIsValidNumber(const N value, const char* message) {
-		if (std::isnan(value) || std::isinf(value)) {
-			throw std::logic_error(message);
+		const char* c_str() const {
+			return text.c_str();
+		}
+		std::size_t size() const {
+			return text.size();
+		}
+		std::string str() const {
+			return text;
+		}
+		/// <summary>
+		/// Empties the Writer, keeping its buffer, and puts the adapter back to the default settings
+		/// </summary>
+		void clear() {
+			text.clear();
+			if (streaming) {
+				adapter->clear();
+				adapter->flags(std::ios_base::skipws | std::ios_base::dec);
+				adapter->precision(6);
+				adapter->width(0);
+				adapter->fill(' ');
+				streaming = false;
+			}
+		}
+
+		/// <summary>
+		/// The calling thread's Writer, emptied, for as long as the Lease lives. If the thread's Writer is already lent out,
+		/// e.g. because a check failed inside a message lambda, the Lease has a Writer of its own.
+		/// </summary>
+		class Lease {
+		public:
+			Lease() : writer(&forThisThread()) {
+				if (writer->leased) {
+					own.reset(new Writer());
+					writer = own.get();
+				}
+				writer->leased = true;
+				writer->clear();
+			}
+			Lease(const Lease&) = delete;
+			Lease& operator=(const Lease&) = delete;
+			~Lease() {
+				writer->leased = false;
+			}
+			Writer& operator*() const {
+				return *writer;
+			}
+
+		private:
+			Writer* writer;
+			std::unique_ptr<Writer> own;
+		};
+
+	private:
+		struct Adapter : public std::ostream {
+			explicit Adapter(std::string& text) : std::ostream(nullptr), buffer(text) {
+				rdbuf(&buffer);
+			}
+			StringAppendBuffer buffer;
+		};
+
+		static Writer& forThisThread() {
+			static thread_local Writer writer;
+			return writer;
+		}
+		template<typename T> Writer& streamed(T value) {
+			*adapter << value;
+			return *this;
+		}
+		template<typename T> Writer& integer(T value) {
+			if (streaming) {
+				return streamed(value);
+			}
+			char digits[numberTextSize];
+			text.append(digits, formatNumber(digits, value));
+			return *this;
+		}
+		template<typename T> Writer& printed(const char* format, T value) {
+			char digits[64]; // %g never needs more than this
+			int length = std::snprintf(digits, sizeof(digits), format, value);
+			if (length > 0) {
+				text.append(digits, (std::size_t) length < sizeof(digits) ? (std::size_t) length : sizeof(digits) - 1);
+			}
+			return *this;
 		}
-	}
+
+		std::string text;
+		std::unique_ptr<Adapter> adapter;
+		bool streaming; // once the adapter has been used everything goes through it, so its settings apply
+		bool leased;
+	};
+
+	// ******************************************************************************************************************
+	// * -------------------------------------------- failure policy -------------------------------------------------- *
+	// ******************************************************************************************************************
 
 	/// <summary>
-	/// Raises a logic_error if the number is NaN or +-Infinity
+	/// Where INTEGRITY_ABORT and INTEGRITY_LOG send the message of a failing check; by default it is written to stderr
 	/// </summary>
-	/// <param name="value">float, double or long double</param>
-	/// <param name="M1">Optional string or primitive</param>
-	/// <param name="M2">Optional string or primitive</param>
-	/// <param name="M3">Optional string or primitive</param>
-	/// <param name="M4">Optional string or primitive</param>
-	/// <exception cref="logic_error"></exception>
-	template<typename N, typename M1 = NonType, typename M2 = NonType, typename M3 = NonType, typename M4 = NonType>
-	inline void checkIsValidNumber(const N value, const M1& m1 = NonType::Singleton(), const M2& m2 = NonType::Singleton(), const M3& m3 = NonType::Singleton(), const M4& m4 = NonType::Singleton()) {
-		if (std::isnan(value) || std::isinf(value)) {
-			const char* defaultMessage = getFloatAppropriateMessage(value);
-			throwWithMessage(defaultMessage, { toTypeValue(m1), toTypeValue(m2), toTypeValue(m3), toTypeValue(m4) });
-		}
+	/// <example>Integrity::logHandler() = [](const char* message) { myLogger.error(message); };</example>
+	using LogHandler = void (*)(const char* message);
+	inline LogHandler& logHandler() {
+		static LogHandler handler = [](const char* message) {
+			std::fprintf(stderr, "%s\n", message);
+		};
+		return handler;
+	}
+
+	inline std::atomic<unsigned long long>& failureCounter() {
+		static std::atomic<unsigned long long> counter(0);
+		return counter;
 	}
 
 	/// <summary>
-	/// Raises a logic_error if the number is NaN or +-Infinity
+	/// How many checks have failed with INTEGRITY_COUNT, over all threads and translation units
 	/// </summary>
-	/// <param name="value">float, double or long double</param>
-	/// <param name="messageFunc">Example: [=](Integrity::out out) { out &lt;&lt; whateverYouWant; }</param>
-	/// <exception cref="logic_error"></exception>
-	/// <remarks>
-	/// This function exists so that you can control the deferred message building by passing in a lambda function which is called if the condition fails.
-	/// </remarks>
-	template<typename N> 
-	inline void checkIsValidNumberM(const N value, const std::function<void(std::stringstream&)>& messageFunc) {
-		if (std::isnan(value) || std::isinf(value)) {
-			throw std::logic_error(makeString(messageFunc));
-		}
+	inline unsigned long long failureCount() {
+		return failureCounter().load(std::memory_order_relaxed);
 	}
 
 	// ******************************************************************************************************************
-	// * ---------------------------------------------- checkNotNull -------------------------------------------------- *
+	// * ------------------------------------------------- levels ----------------------------------------------------- *
 	// ******************************************************************************************************************
 
 	/// <summary>
-	/// Raises a logic_error if the pointer is null (i.e. 0)
+	/// How expensive a check is, and so which builds it runs in. See INTEGRITY_LEVEL.
 	/// </summary>
-	/// <param name="pointer">a pointer to check for nullness</param>
-	/// <exception cref="logic_error">message will be 'Null pointer'</exception>
-	inline void checkNotNull(const void* pointer) {
-		if (pointer == nullptr) {
-			throw std::logic_error("Null pointer");
-		}
+	enum class Level : unsigned char {
+		always = INTEGRITY_LEVEL_ALWAYS,
+		debug = INTEGRITY_LEVEL_DEBUG,
+		audit = INTEGRITY_LEVEL_AUDIT,
+	};
+
+	inline std::atomic<unsigned char>& activeLevelFlag() {
+		// the same in every translation unit, as a different starting level per INTEGRITY_LEVEL would break the one definition rule
+		static std::atomic<unsigned char> level(INTEGRITY_LEVEL_AUDIT);
+		return level;
 	}
 
 	/// <summary>
-	/// Raises a logic_error if the pointer is null (i.e. 0)
+	/// The highest level of check which runs, of those compiled in by INTEGRITY_LEVEL
 	/// </summary>
-	/// <param name="pointer">a pointer to check for nullness</param>
-	/// <param name="message">message to use in the exception</param>
-	/// <exception cref="logic_error"></exception>
-	inline void checkNotNull(const void* pointer, const char* message) {
-		if (pointer == nullptr) {
-			throw std::logic_error(message);
-		}
+	inline Level activeLevel() {
+		return (Level) activeLevelFlag().load(std::memory_order_relaxed);
 	}
 
 	/// <summary>
-	/// Raises a logic_error if the pointer is null (i.e. 0)
+	/// Switches levels of check on or off for the whole process, over all threads and translation units. It is a relaxed
+	/// atomic, so a passing levelled check pays for one load of it, and other threads see the change soon after rather than at once.
+	/// A level which INTEGRITY_LEVEL left out cannot be switched on, as its checks are not there.
 	/// </summary>
-	/// <param name="pointer">a pointer to check for nullness</param>
-	/// <param name="M1">Optional string or primitive</param>
-	/// <param name="M2">Optional string or primitive</param>
-	/// <param name="M3">Optional string or primitive</param>
-	/// <param name="M4">Optional string or primitive</param>
-	/// <exception cref="logic_error"></exception>
-	template<typename M1 = NonType, typename M2 = NonType, typename M3 = NonType, typename M4 = NonType>
-	inline void checkNotNull(const void* pointer, const M1 & m1 = NonType::Singleton(), const M2 & m2 = NonType::Singleton(), const M3 & m3 = NonType::Singleton(), const M4 & m4 = NonType::Singleton()) {
-		if (pointer == nullptr) {
-			throwWithMessage(defaultNullPointerMessage, { toTypeValue(m1), toTypeValue(m2), toTypeValue(m3), toTypeValue(m4) });
-		}
+	/// <example>if (std::getenv("RUN_AUDITS") != nullptr) Integrity::setActiveLevel(Integrity::Level::audit);</example>
+	inline void setActiveLevel(Level level) {
+		activeLevelFlag().store((unsigned char) level, std::memory_order_relaxed);
 	}
 
 	/// <summary>
-	/// Raises a logic_error if the pointer is null (i.e. 0)
+	/// Whether checks of this level run, if they were compiled in
 	/// </summary>
-	/// <param name="pointer">a pointer to check for nullness</param>
-	/// <param name="messageFunc">Example: [=](Integrity::out out) { out &lt;&lt; whateverYouWant; }</param>
-	/// <exception cref="logic_error"></exception>
-	/// <remarks>
-	/// This function exists so that you can control the deferred message building by passing in a lambda function which is called if the condition fails.
-	/// </remarks>
-	inline void checkNotNullM(const void* pointer, std::function<void(std::stringstream&)> messageFunc) {
-		if (pointer == nullptr) {
-			throw std::logic_error(makeString(messageFunc));
-		}
+	inline bool isActive(Level level) {
+		return level == Level::always || (unsigned char) level <= activeLevelFlag().load(std::memory_order_relaxed);
+	}
+
+#ifdef INTEGRITY_RUNTIME_LEVEL
+#if INTEGRITY_RUNTIME_LEVEL < INTEGRITY_LEVEL_ALWAYS || INTEGRITY_RUNTIME_LEVEL > INTEGRITY_LEVEL_AUDIT
+#error INTEGRITY_RUNTIME_LEVEL has to be one of INTEGRITY_LEVEL_ALWAYS, INTEGRITY_LEVEL_DEBUG or INTEGRITY_LEVEL_AUDIT
+#endif
+	namespace {
+		// local to the translation unit, so that only the one which defines INTEGRITY_RUNTIME_LEVEL sets the shared flag
+		const bool runtimeLevelSet = (setActiveLevel((Level) INTEGRITY_RUNTIME_LEVEL), true);
 	}
+#endif
 
 	// ******************************************************************************************************************
-	// * ---------------------------------------- checkStringNotNullOrEmpty ------------------------------------------- *
+	// * ------------------------------------------------ call sites -------------------------------------------------- *
 	// ******************************************************************************************************************
 
+#ifndef INTEGRITY_SITE_SHARDS
+#define INTEGRITY_SITE_SHARDS 16 // how many copies of each call site's counters there are for the threads to share out
+#endif
+#ifndef INTEGRITY_COUNT_EVALUATIONS
+#define INTEGRITY_COUNT_EVALUATIONS 0 // 1 to have checkAt count passes as well as failures
+#endif
+
 	/// <summary>
-	/// Checks whether a string is null or zero length.
+	/// Which of a Site's counter shards the calling thread uses. Threads are dealt out to the shards in turn.
 	/// </summary>
-	/// <param name="s">The (wstring, std::string, u16string, u32string) to check for zero length.</param>
-	/// <exception cref="logic_error">Raised if s is empty</exception>
-	/// <remarks>
-	/// Note that an exception is only raised if the string has exactly zero length; a string with a single space (for example) would be fine
-	/// </remarks>
-	template<typename M1 = NonType, typename M2 = NonType, typename M3 = NonType, typename M4 = NonType>
-	inline void checkStringNotNullOrEmpty(const char* s, const M1& m1 = NonType::Singleton(), const M2& m2 = NonType::Singleton(), const M3& m3 = NonType::Singleton(), const M4& m4 = NonType::Singleton()) {
-		if (s == nullptr) {
-			throwWithMessage(defaultNullPointerMessage, { toTypeValue(m1), toTypeValue(m2), toTypeValue(m3), toTypeValue(m4) });
-		} else if(std::strlen(s) == 0) {
-			throwWithMessage(defaultEmptyStringMessage, { toTypeValue(m1), toTypeValue(m2), toTypeValue(m3), toTypeValue(m4) });
-		}
-	}
-	template<typename M1 = NonType, typename M2 = NonType, typename M3 = NonType, typename M4 = NonType>
-	inline void checkStringNotNullOrEmpty(char* s, const M1& m1 = NonType::Singleton(), const M2& m2 = NonType::Singleton(), const M3& m3 = NonType::Singleton(), const M4& m4 = NonType::Singleton()) {
-		if (s == nullptr) {
-			throwWithMessage(defaultNullPointerMessage, { toTypeValue(m1), toTypeValue(m2), toTypeValue(m3), toTypeValue(m4) });
-		}
-		else if (std::strlen(s) == 0) {
-			throwWithMessage(defaultEmptyStringMessage, { toTypeValue(m1), toTypeValue(m2), toTypeValue(m3), toTypeValue(m4) });
+	inline std::size_t siteShard() {
+		static std::atomic<std::size_t> nextThread(0);
+		// constant initialised, rather than initialised with the fetch_add, so that reading it does not go through a TLS init function
+		static thread_local std::size_t shard = INTEGRITY_SITE_SHARDS;
+		if (shard == INTEGRITY_SITE_SHARDS) {
+			shard = nextThread.fetch_add(1, std::memory_order_relaxed) % INTEGRITY_SITE_SHARDS;
 		}
+		return shard;
 	}
 
-	template<typename S, typename M1 = NonType, typename M2 = NonType, typename M3 = NonType, typename M4 = NonType>
-	inline void checkStringNotNullOrEmpty(const S& s, const M1& m1 = NonType::Singleton(), const M2& m2 = NonType::Singleton(), const M3& m3 = NonType::Singleton(), const M4& m4 = NonType::Singleton()) {
-		// If you get a compiler error like: left of .empty must have class/struct/union
-		// in the line below, then you have not passed a string as firt param to checkStringNotNullOrEmpty 
+	/// <summary>
+	/// How many of each call site's failures are reported by the policies which carry on after a failure (INTEGRITY_LOG).
+	/// The rest are only counted, and one summary line per interval says how many were left out.
+	/// </summary>
+	/// <example>
+	/// Integrity::reportLimit().perInterval = 10; // the first 10 failures of a check in each second
+	/// Integrity::reportLimit().sampleEvery = 1000; // or 1 in every 1000 failures of a check
+	/// </example>
+	/// <remarks>Only failures of checkAt and of the checked operations (checkedAdd, narrow, checked_span::at and the like) can
+	/// be limited, as the other checks have no Site to keep count in</remarks>
+	struct ReportLimit {
+		std::atomic<unsigned> perInterval{ 0 }; // 0 for no limit
+		std::atomic<unsigned> sampleEvery{ 0 }; // 0 or 1 for every failure; used instead of perInterval if set
+		std::atomic<unsigned> intervalMilliseconds{ 1000 };
+	};
+	inline ReportLimit& reportLimit() {
+		static ReportLimit limit;
+		return limit;
+	}
+
+	/// <summary>
+	/// A static descriptor of one check in the source, with counts of how often it failed and (optionally) was evaluated
+	/// </summary>
+	/// <remarks>
+	/// Make one with INTEGRITY_SITE. The constructor is constexpr so that the static Site is constant initialised, and a
+	/// passing check does not have to test a static initialisation guard. The counters are split into shards, each on its
+	/// own cache line, and a thread only ever adds to its own shard with a relaxed atomic add, so counting never takes a
+	/// lock and threads rarely share a cache line. The first time a Site counts anything it adds itself to a lock-free
+	/// list, which is what snapshot() reads.
+	/// </remarks>
+	class Site {
+	public:
+		const char* const file;
+		const int line;
+		const char* const format;
+
+		constexpr Site(const char* file, int line, const char* format) : Site(file, line, format, nullptr) {
+		}
+		constexpr Site(const char* file, int line, const char* format, const char* function) : file(file), line(line), format(format), functionName(function),
+			next(nullptr), listed(false), reportWindow(0), sampled(0), suppressed(0), summarised(0), shards{} {
+		}
+		Site(const Site&) = delete;
+		Site& operator=(const Site&) = delete;
+
+		/// <summary>
+		/// The function the check is in, or nullptr if the Site was not given it and has not counted anything yet
+		/// </summary>
+		const char* function() const {
+			return functionName;
+		}
+
+		void countFailure(const char* function) {
+			list(function);
+			shards[siteShard()].failures.fetch_add(1, std::memory_order_relaxed);
+		}
+		void countEvaluation(const char* function) {
+			list(function);
+			shards[siteShard()].evaluations.fetch_add(1, std::memory_order_relaxed);
+		}
+		// for checkEveryN and checkSampled, which only count when they run, along with the calls skipped since the last run
+		void countSampled(const char* function, unsigned long long skippedSince) {
+			list(function);
+			Shard& shard = shards[siteShard()];
+			shard.evaluations.fetch_add(1, std::memory_order_relaxed);
+			if (skippedSince != 0) {
+				shard.skipped.fetch_add(skippedSince, std::memory_order_relaxed);
+			}
+		}
+		unsigned long long failures() const {
+			unsigned long long total = 0;
+			for (const Shard& shard : shards) {
+				total += shard.failures.load(std::memory_order_relaxed);
+			}
+			return total;
+		}
+		unsigned long long evaluations() const {
+			unsigned long long total = 0;
+			for (const Shard& shard : shards) {
+				total += shard.evaluations.load(std::memory_order_relaxed);
+			}
+			return total;
+		}
+		unsigned long long skipped() const {
+			unsigned long long total = 0;
+			for (const Shard& shard : shards) {
+				total += shard.skipped.load(std::memory_order_relaxed);
+			}
+			return total;
+		}
+
+		/// <summary>
+		/// How many failures reportLimit() has kept from being reported
+		/// </summary>
+		unsigned long long suppressedFailures() const {
+			return summarised.load(std::memory_order_relaxed) + suppressed.load(std::memory_order_relaxed);
+		}
+
+		/// <summary>
+		/// Whether a failure should be reported, or only counted as suppressed, under reportLimit(). Lock-free and formats nothing.
+		/// </summary>
+		/// <param name="summarise">set to how many failures were suppressed before, when this failure is the first of a new interval</param>
+		bool shouldReport(unsigned long long& summarise) {
+			const ReportLimit& limit = reportLimit();
+			unsigned perInterval = limit.perInterval.load(std::memory_order_relaxed);
+			unsigned sampleEvery = limit.sampleEvery.load(std::memory_order_relaxed);
+			summarise = 0;
+			if (perInterval == 0 && sampleEvery <= 1) {
+				return true;
+			}
+			unsigned interval = limit.intervalMilliseconds.load(std::memory_order_relaxed);
+			std::uint64_t now = (std::uint64_t) std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+			std::uint32_t window = (std::uint32_t) (now / (interval == 0 ? 1 : interval));
+
+			// taken once, before the loop, so that a retry does not count this failure again and change whether it is the 1 in N
+			bool sampledIn = sampleEvery > 1 && sampled.fetch_add(1, std::memory_order_relaxed) % sampleEvery == 0;
+
+			// the window number and how many have been reported in it are kept in the one atomic, so a new window is started
+			// and counted in with a single compare and swap
+			bool report;
+			bool newWindow;
+			std::uint64_t state = reportWindow.load(std::memory_order_relaxed);
+			for (;;) {
+				newWindow = (std::uint32_t) (state >> 32) != window;
+				std::uint32_t reported = newWindow ? 0 : (std::uint32_t) state;
+				report = sampleEvery > 1 ? sampledIn : reported < perInterval;
+				if (!report && !newWindow) {
+					break;
+				}
+				std::uint64_t next = ((std::uint64_t) window << 32) | (reported + (report ? 1 : 0));
+				if (reportWindow.compare_exchange_weak(state, next, std::memory_order_relaxed)) {
+					break;
+				}
+			}
+			if (newWindow) {
+				summarise = takeSuppressed();
+			}
+			if (!report) {
+				suppressed.fetch_add(1, std::memory_order_relaxed);
+			}
+			return report;
+		}
+
+		/// <summary>
+		/// How many failures have been suppressed since the last summary, which are then counted as summarised
+		/// </summary>
+		unsigned long long takeSuppressed() {
+			unsigned long long taken = suppressed.exchange(0, std::memory_order_relaxed);
+			summarised.fetch_add(taken, std::memory_order_relaxed);
+			return taken;
+		}
+
+		/// <summary>
+		/// The most recently listed Site; the rest follow on from its nextSite()
+		/// </summary>
+		static Site* first() {
+			return head().load(std::memory_order_acquire);
+		}
+		const Site* nextSite() const {
+			return next;
+		}
+		Site* nextSite() {
+			return next;
+		}
+
+	private:
+		struct alignas(64) Shard {
+			std::atomic<unsigned long long> failures{ 0 };
+			std::atomic<unsigned long long> evaluations{ 0 };
+			std::atomic<unsigned long long> skipped{ 0 };
+		};
+
+		static std::atomic<Site*>& head() {
+			static std::atomic<Site*> site(nullptr);
+			return site;
+		}
+
+		void list(const char* function) {
+			if (listed.load(std::memory_order_relaxed) || listed.exchange(true, std::memory_order_relaxed)) {
+				return;
+			}
+			// only the one thread which set listed gets here, and what it writes is published by the release below
+			functionName = function;
+			next = head().load(std::memory_order_relaxed);
+			while (!head().compare_exchange_weak(next, this, std::memory_order_release, std::memory_order_relaxed)) {
+			}
+		}
+
+		const char* functionName;
+		Site* next;
+		std::atomic<bool> listed;
+		std::atomic<std::uint64_t> reportWindow; // the interval number in the top 32 bits, the failures reported in it in the bottom
+		std::atomic<std::uint64_t> sampled;
+		std::atomic<unsigned long long> suppressed; // since the last summary
+		std::atomic<unsigned long long> summarised;
+		Shard shards[INTEGRITY_SITE_SHARDS];
+	};
+
+	/// <summary>
+	/// A Site and the name of the function it is in, which is what INTEGRITY_SITE gives
+	/// </summary>
+	struct SiteRef {
+		Site& site;
+		const char* function;
+	};
+
+	/// <summary>
+	/// The static Site for the line it is used on
+	/// </summary>
+	/// <param name="format">A string literal describing the check, normally its message</param>
+	/// <example>Integrity::checkAt(INTEGRITY_SITE("Expected {} to be positive"), x > 0, "Expected {} to be positive", x);</example>
+	/// <remarks>__func__ is taken outside the lambda, as inside it would be "operator()"</remarks>
+#define INTEGRITY_SITE(format) \
+	(::Integrity::SiteRef{ []() -> ::Integrity::Site& { \
+		static ::Integrity::Site site(__FILE__, __LINE__, format); \
+		return site; \
+	}(), __func__ })
+
+	/*
+	* The Sites of the checked operations, whose format is the template of their failure message. A failing checkedAdd and
+	* the like has no call site of its own, so it counts its failures in its operation's Site, which is what snapshot()
+	* shows and reportLimit() limits them by. The Site is not given to the failure as its site(), as its file and line
+	* would only point in here.
+	*/
+	inline Site& additionSite() {
+		static Site site(__FILE__, __LINE__, "Overflow in {} + {}", "checkedAdd");
+		return site;
+	}
+	inline Site& subtractionSite() {
+		static Site site(__FILE__, __LINE__, "Overflow in {} - {}", "checkedSub");
+		return site;
+	}
+	inline Site& multiplicationSite() {
+		static Site site(__FILE__, __LINE__, "Overflow in {} * {}", "checkedMul");
+		return site;
+	}
+	inline Site& sumSite() {
+		static Site site(__FILE__, __LINE__, "Overflow in {} + {}", "checkedSum");
+		return site;
+	}
+	inline Site& narrowSite() {
+		static Site site(__FILE__, __LINE__, "Narrowing {} to {}", "narrow");
+		return site;
+	}
+	inline Site& narrowAllSite() {
+		static Site site(__FILE__, __LINE__, "Narrowing {} to {}", "narrowAll");
+		return site;
+	}
+	inline Site& indexSite() {
+		static Site site(__FILE__, __LINE__, "Index {} out of bounds for size {}", "checked_span::at");
+		return site;
+	}
+	inline Site& windowSite() {
+		static Site site(__FILE__, __LINE__, "Window {} + {} out of bounds for size {}", "checked_span::window");
+		return site;
+	}
+	inline Site& strideSite() {
+		static Site site(__FILE__, __LINE__, "Window {} + {} x {} out of bounds for size {}", "checked_span::strided");
+		return site;
+	}
+
+	/// <summary>
+	/// One call site's counts at the time of a snapshot()
+	/// </summary>
+	struct SiteCount {
+		const char* file;
+		int line;
+		const char* function;
+		const char* format;
+		unsigned long long failures;
+		unsigned long long evaluations; // only counted by checkAt&lt;true&gt;, with INTEGRITY_COUNT_EVALUATIONS, or by checkEveryN and checkSampled
+		unsigned long long suppressed; // failures which were not reported because of reportLimit()
+		unsigned long long skipped; // calls of checkEveryN and checkSampled which did not run their predicate
+	};
+
+	/// <summary>
+	/// The counts of every call site that has counted something so far, over all threads
+	/// </summary>
+	/// <remarks>
+	/// The checks carry on counting while this reads, so each count is a relaxed read of a moving total rather than
+	/// all the counts at a single instant.
+	/// </remarks>
+	inline std::vector<SiteCount> snapshot() {
+		std::vector<SiteCount> counts;
+		for (const Site* site = Site::first(); site != nullptr; site = site->nextSite()) {
+			counts.push_back(SiteCount{ site->file, site->line, site->function(), site->format, site->failures(), site->evaluations(), site->suppressedFailures(), site->skipped() });
+		}
+		return counts;
+	}
+
+	// ******************************************************************************************************************
+	// * ------------------------------------------------- sampling --------------------------------------------------- *
+	// ******************************************************************************************************************
+
+	/// <summary>
+	/// One thread's countdown for one checkEveryN or checkSampled, which is found by the type of its predicate, so that
+	/// each lambda (and so each call site) has its own without any lookup, lock or shared atomic.
+	/// </summary>
+	struct SampleState {
+		std::uint32_t countdown; // calls to go until the predicate next runs, counting that one
+		std::uint32_t gap; // what countdown was last set to, so gap - 1 calls were skipped before it got to 0
+		std::uint64_t random; // checkSampled's xorshift state, seeded on first use
+	};
+	template<typename P> inline SampleState& sampleState() {
+		// constant initialised so that it needs no TLS init function; the first call on each thread runs the predicate
+		static thread_local SampleState state = { 1, 1, 0 };
+		return state;
+	}
+
+	/// <summary>
+	/// How many calls until checkSampled next runs its predicate: a geometric distribution, so each call runs with
+	/// probability rate, but the calls in between only have to count down rather than draw a random number each
+	/// </summary>
+	inline std::uint32_t sampleGap(SampleState& state, double rate) {
+		if (rate >= 1) {
+			return 1;
+		}
+		if (!(rate > 0)) {
+			return UINT32_MAX;
+		}
+		if (state.random == 0) {
+			state.random = (std::uint64_t) std::hash<std::thread::id>()(std::this_thread::get_id()) ^ (std::uint64_t) (std::uintptr_t) &state;
+			state.random |= 1;
+		}
+		// xorshift64*
+		state.random ^= state.random >> 12;
+		state.random ^= state.random << 25;
+		state.random ^= state.random >> 27;
+		std::uint64_t bits = state.random * 0x2545F4914F6CDD1DULL;
+		double uniform = (double) ((bits >> 11) + 1) / 9007199254740992.0; // (0, 1]
+		double gap = 1 + std::floor(std::log(uniform) / std::log1p(-rate));
+		return gap >= (double) UINT32_MAX ? UINT32_MAX : (std::uint32_t) gap;
+	}
+
+	// ******************************************************************************************************************
+	// * ---------------------------------------------- parallel checks ----------------------------------------------- *
+	// ******************************************************************************************************************
+
+#ifndef INTEGRITY_PARALLEL_MIN
+#define INTEGRITY_PARALLEL_MIN 65536 // checkEach and checkAllOf only share out ranges of at least this many elements
+#endif
+#ifndef INTEGRITY_PARALLEL_CHUNK
+#define INTEGRITY_PARALLEL_CHUNK 8192 // how many elements a thread takes at a time
+#endif
+
+	inline std::atomic<unsigned>& parallelThreadsFlag() {
+		static std::atomic<unsigned> threads(0);
+		return threads;
+	}
+
+	/// <summary>
+	/// The threads checkEach and checkAllOf share large ranges with. They are started the first time they are needed and then
+	/// wait for the next range, so a check which is run again and again does not start and join threads each time.
+	/// </summary>
+	class ParallelPool {
+	public:
+		ParallelPool() : job(nullptr), jobContext(nullptr), generation(0), openSlots(0), running(0), limit(0) {
+		}
+		~ParallelPool() {
+			resize(0);
+		}
+		ParallelPool(const ParallelPool&) = delete;
+		ParallelPool& operator=(const ParallelPool&) = delete;
+
+		/// <summary>
+		/// Calls work(context) on the calling thread and on up to helpers of the pool's threads, and returns once every call
+		/// has returned. work must not throw. While the pool is busy, e.g. with a check on another thread or one made inside
+		/// a predicate, work is only called on the calling thread.
+		/// </summary>
+		void run(std::size_t helpers, void (*work)(void*), void* context) {
+			std::unique_lock<std::mutex> busy(runMutex, std::try_to_lock);
+			if (!busy.owns_lock()) {
+				work(context);
+				return;
+			}
+			grow(helpers);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				job = work;
+				jobContext = context;
+				openSlots = helpers < threads.size() ? helpers : threads.size();
+				++generation;
+			}
+			wake.notify_all();
+			work(context);
+			std::unique_lock<std::mutex> lock(mutex);
+			// the work has all been taken by now, so a thread which has not woken up yet need not join in
+			openSlots = 0;
+			done.wait(lock, [&]() { return running == 0; });
+		}
+
+		/// <summary>
+		/// Stops all but the first count threads
+		/// </summary>
+		void resize(std::size_t count) {
+			std::lock_guard<std::mutex> busy(runMutex);
+			if (count >= threads.size()) {
+				return;
+			}
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				limit = count;
+			}
+			wake.notify_all();
+			for (std::size_t i = count; i < threads.size(); ++i) {
+				threads[i].join();
+			}
+			threads.erase(threads.begin() + (std::ptrdiff_t) count, threads.end());
+		}
+
+	private:
+		// called while holding runMutex, so nothing else changes generation
+		void grow(std::size_t count) {
+			if (threads.size() >= count) {
+				return;
+			}
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				limit = count;
+			}
+			while (threads.size() < count) {
+#if INTEGRITY_EXCEPTIONS
+				try {
+					threads.emplace_back(&ParallelPool::workLoop, this, threads.size(), generation);
+				}
+				catch (const std::system_error&) {
+					break; // carry on with the threads there are
+				}
+#else
+				threads.emplace_back(&ParallelPool::workLoop, this, threads.size(), generation);
+#endif
+			}
+		}
+
+		void workLoop(std::size_t id, std::uint64_t seen) {
+			std::unique_lock<std::mutex> lock(mutex);
+			for (;;) {
+				wake.wait(lock, [&]() { return id >= limit || generation != seen; });
+				if (id >= limit) {
+					return;
+				}
+				seen = generation;
+				if (openSlots == 0) {
+					continue;
+				}
+				--openSlots;
+				++running;
+				void (*work)(void*) = job;
+				void* context = jobContext;
+				lock.unlock();
+				work(context);
+				lock.lock();
+				if (--running == 0) {
+					done.notify_one();
+				}
+			}
+		}
+
+		std::mutex runMutex; // held by the check the pool is working for
+		std::mutex mutex; // guards everything below
+		std::condition_variable wake;
+		std::condition_variable done;
+		void (*job)(void*);
+		void* jobContext;
+		std::uint64_t generation; // moved on for each run, to wake the threads
+		std::size_t openSlots; // how many more threads may join in the current run
+		std::size_t running; // how many threads are in the current run
+		std::size_t limit; // threads from this id on stop
+		std::vector<std::thread> threads;
+	};
+
+	inline ParallelPool& parallelPool() {
+		static ParallelPool pool;
+		return pool;
+	}
+
+	/// <summary>
+	/// How many threads checkEach and checkAllOf share a large range between, counting the one that called them
+	/// </summary>
+	inline unsigned parallelThreads() {
+		unsigned threads = parallelThreadsFlag().load(std::memory_order_relaxed);
+		if (threads == 0) {
+			threads = std::thread::hardware_concurrency();
+		}
+		return threads == 0 ? 1 : threads;
+	}
+
+	/// <summary>
+	/// Sets how many threads checkEach and checkAllOf use, for the whole process. 0, the default, is one per hardware thread,
+	/// and 1 checks every range on the calling thread. Pooled threads beyond the new count are stopped.
+	/// </summary>
+	inline void setParallelThreads(unsigned threads) {
+		parallelThreadsFlag().store(threads, std::memory_order_relaxed);
+		parallelPool().resize(parallelThreads() - 1);
+	}
+
+	/// <summary>
+	/// The index of the first element of [first, first + count) which the predicate is false for, or count if there is none.
+	/// A large range is cut into chunks, which the calling thread and the ones it starts take in order from a shared counter,
+	/// so a thread which gets through its chunks quickly takes more of them. The first failure found lowers a shared latch,
+	/// and chunks past it are not started, so the threads stop soon after. Chunks before it are still finished, as they may
+	/// hold an earlier failure, so the index found is always the lowest, the same as a plain loop would find.
+	/// The threads are parallelPool()'s. An exception from the predicate on any of them stops the rest taking chunks, and the
+	/// first one thrown is rethrown on the calling thread.
+	/// </summary>
+	template<typename I, typename P>
+	inline std::size_t findFirstFailure(I first, std::size_t count, P& predicate, std::random_access_iterator_tag) {
+		const std::size_t chunk = INTEGRITY_PARALLEL_CHUNK;
+		std::size_t chunks = (count + chunk - 1) / chunk;
+		std::size_t threads = parallelThreads();
+		if (count < INTEGRITY_PARALLEL_MIN || threads < 2 || chunks < 2) {
+			for (std::size_t i = 0; i < count; ++i) {
+				if (!predicate(first[i])) {
+					return i;
+				}
+			}
+			return count;
+		}
+		std::atomic<std::size_t> nextChunk(0);
+		std::atomic<std::size_t> latch(count);
+		std::atomic<bool> thrown(false);
+		auto scan = [&]() {
+			for (;;) {
+				std::size_t start = nextChunk.fetch_add(1, std::memory_order_relaxed) * chunk;
+				if (start >= count || start > latch.load(std::memory_order_relaxed) || thrown.load(std::memory_order_relaxed)) {
+					return;
+				}
+				std::size_t end = count - start < chunk ? count : start + chunk;
+				for (std::size_t i = start; i < end; ++i) {
+					if (!predicate(first[i])) {
+						// every chunk after this one starts past i, so this thread has nothing earlier left to find
+						std::size_t lowest = latch.load(std::memory_order_relaxed);
+						while (i < lowest && !latch.compare_exchange_weak(lowest, i, std::memory_order_relaxed)) {
+						}
+						return;
+					}
+				}
+			}
+		};
+#if INTEGRITY_EXCEPTIONS
+		std::exception_ptr error;
+		auto work = [&]() {
+			try {
+				scan();
+			}
+			catch (...) {
+				if (!thrown.exchange(true, std::memory_order_relaxed)) {
+					error = std::current_exception();
+				}
+			}
+		};
+#else
+		auto work = [&]() { scan(); };
+#endif
+		std::size_t helpers = (threads < chunks ? threads : chunks) - 1;
+		parallelPool().run(helpers, [](void* context) { (*static_cast<decltype(work)*>(context))(); }, &work);
+#if INTEGRITY_EXCEPTIONS
+		// the pool has finished with every thread by now, which publishes error to this one
+		if (error) {
+			std::rethrow_exception(error);
+		}
+#endif
+		return latch.load(std::memory_order_relaxed);
+	}
+	// anything without random access, such as a std::list, is looped over on the calling thread
+	template<typename I, typename P>
+	inline std::size_t findFirstFailure(I first, std::size_t count, P& predicate, std::input_iterator_tag) {
+		for (std::size_t i = 0; i < count; ++i, ++first) {
+			if (!predicate(*first)) {
+				return i;
+			}
+		}
+		return count;
+	}
+
+	// ******************************************************************************************************************
+	// * ------------------------------------------------- overflow --------------------------------------------------- *
+	// ******************************************************************************************************************
+
+	// g++ from 5 and clang have builtins which do the arithmetic and say whether it overflowed, from the CPU's overflow or
+	// carry flag. Anything else gets the portable checks, which test the operands against the limits first.
+#if defined(__has_builtin)
+#if __has_builtin(__builtin_add_overflow)
+#define INTEGRITY_OVERFLOW_BUILTINS
+#endif
+#elif defined(__GNUC__) && __GNUC__ >= 5
+#define INTEGRITY_OVERFLOW_BUILTINS
+#endif
+
+	template<typename T> using EnableIfInteger = typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type;
+
+	// Each works out a op b into result, wrapping as unsigned arithmetic would, and returns true if it did not fit in T
+	template<typename T> inline bool addOverflows(T a, T b, T& result) {
+#ifdef INTEGRITY_OVERFLOW_BUILTINS
+		return __builtin_add_overflow(a, b, &result);
+#else
+		typedef typename std::make_unsigned<T>::type U;
+		typedef decltype((U) 0 + 0u) W; // so that short types are not promoted to int, which could overflow
+		result = (T) (U) ((W) a + (W) b);
+		return std::is_signed<T>::value ? (b > 0 ? a > std::numeric_limits<T>::max() - b : a < std::numeric_limits<T>::min() - b) : result < a;
+#endif
+	}
+	template<typename T> inline bool subOverflows(T a, T b, T& result) {
+#ifdef INTEGRITY_OVERFLOW_BUILTINS
+		return __builtin_sub_overflow(a, b, &result);
+#else
+		typedef typename std::make_unsigned<T>::type U;
+		typedef decltype((U) 0 + 0u) W; // so that short types are not promoted to int, which could overflow
+		result = (T) (U) ((W) a - (W) b);
+		return std::is_signed<T>::value ? (b < 0 ? a > std::numeric_limits<T>::max() + b : a < std::numeric_limits<T>::min() + b) : a < b;
+#endif
+	}
+	template<typename T> inline bool mulOverflows(T a, T b, T& result) {
+#ifdef INTEGRITY_OVERFLOW_BUILTINS
+		return __builtin_mul_overflow(a, b, &result);
+#else
+		typedef typename std::make_unsigned<T>::type U;
+		typedef decltype((U) 0 + 0u) W; // so that short types are not promoted to int, which could overflow
+		result = (T) (U) ((W) a * (W) b);
+		if (a == 0 || b == 0) {
+			return false;
+		}
+		if (!std::is_signed<T>::value) {
+			return a > std::numeric_limits<T>::max() / b;
+		}
+		if (a > 0) {
+			return b > 0 ? a > std::numeric_limits<T>::max() / b : b < std::numeric_limits<T>::min() / a;
+		}
+		return b > 0 ? a < std::numeric_limits<T>::min() / b : a < std::numeric_limits<T>::max() / b;
+#endif
+	}
+
+	// Whether a floating point value is inside the range of the integer type T, so that converting it is defined.
+	// max + 1 is a power of two, so it is exact as a floating point number even when max is not.
+	template<typename T, typename F> constexpr bool inIntegerRange(F value) {
+		return value >= (F) std::numeric_limits<T>::min() && value < (F) (std::numeric_limits<T>::max() / 2 + 1) * 2;
+	}
+	// Converts value to T into result, and returns true if that changed it: out of range, a fraction lost, or for integers
+	// a change of sign. Converting a NaN to another floating point type is not a change.
+	template<typename T, typename F> inline bool narrowingChanges(F value, T& result, std::true_type, std::true_type) {
+		result = static_cast<T>(value);
+		return static_cast<F>(result) != value || (std::is_signed<T>::value != std::is_signed<F>::value && (result < T()) != (value < F()));
+	}
+	template<typename T, typename F> inline bool narrowingChanges(F value, T& result, std::true_type, std::false_type) {
+		if (!inIntegerRange<T>(value)) {
+			result = T();
+			return true;
+		}
+		result = static_cast<T>(value);
+		return static_cast<F>(result) != value;
+	}
+	template<typename T, typename F> inline bool narrowingChanges(F value, T& result, std::false_type, std::true_type) {
+		result = static_cast<T>(value);
+		return !inIntegerRange<F>(result) || static_cast<F>(result) != value;
+	}
+	template<typename T, typename F> inline bool narrowingChanges(F value, T& result, std::false_type, std::false_type) {
+		result = static_cast<T>(value);
+		return static_cast<F>(result) != value && value == value;
+	}
+	template<typename T, typename F> inline bool narrowingChanges(F value, T& result) {
+		static_assert(std::is_arithmetic<T>::value && std::is_arithmetic<F>::value && !std::is_same<T, bool>::value && !std::is_same<F, bool>::value,
+			"narrow converts between integer and floating point types");
+		return narrowingChanges(value, result, std::is_integral<T>(), std::is_integral<F>());
+	}
+	// The second operand of checkedAdd, checkedSub and checkedMul as a T. One which does not fit counts as an overflow, with
+	// or without the builtins, rather than being cut down to T first and the cut down value checked.
+	template<typename T, typename B> inline bool operandOverflows(B b, T& converted) {
+		return narrowingChanges(b, converted);
+	}
+
+	// A short name for an arithmetic type, for the message of a failed narrow
+	template<typename T> constexpr const char* numberTypeName() {
+		return std::is_floating_point<T>::value ? (sizeof(T) == sizeof(float) ? "float" : sizeof(T) == sizeof(double) ? "double" : "long double") :
+			std::is_signed<T>::value ? (sizeof(T) == 1 ? "int8" : sizeof(T) == 2 ? "int16" : sizeof(T) == 4 ? "int32" : "int64") :
+			(sizeof(T) == 1 ? "uint8" : sizeof(T) == 2 ? "uint16" : sizeof(T) == 4 ? "uint32" : "uint64");
+	}
+
+	inline namespace INTEGRITY_POLICY_NAMESPACE {
+
+	// ******************************************************************************************************************
+	// * -------------------------------------------------- check------------------------------------------------------ *
+	// ******************************************************************************************************************
+
+	/// <summary>
+	/// Checks whether a condition is true, if not raises a logic_error with default message
+	/// </summary>
+	/// <param name="condition">The condition to check is true.</param>
+	/// <exception cref="logic_error">Raised if condition is false</exception>
+	constexpr void check(bool condition) {
+		if (!condition) {
+			failWithMessage(FailureKind::condition, defaultExceptionMessage);
+		}
+	}
+
+	/// <summary>
+	/// Checks whether a condition is true, if not raises a logic_error with given message
+	/// </summary>
+	/// <param name="condition">The condition to check is true.</param>
+	/// <exception cref="logic_error">Raised if condition is false</exception>
+	constexpr void check(bool condition, const char* message) {
+		if (!condition) {
+			failWithMessage(FailureKind::condition, message);
+		}
+	}
+
+	/// <summary>
+	/// Placeholder to prevent non-bool being passed in as first parameter.
+	/// </summary>
+	/// <param name="youNeedABool">Did you accidentally do = instead of ==?</param>
+	/// <remarks>If this is not here then common errors like check(a = b) instead of check(a == b) do not get caught by compiler</remarks>
+	template<typename NONBOOL, typename... M>
+	inline void check(NONBOOL youNeedABoolHere, M&&... m) = delete;
+
+	/// <summary>
+	/// Checks whether a condition is true, if not raises a logic_error
+	/// </summary>
+	/// <param name="condition">The condition to check is true.</param>
+	/// <param name="m">Optional strings or primitives, as many as needed</param>
+	/// <exception cref="logic_error">Raised if condition is false</exception>
+	/// <remarks>
+	/// The message arguments are taken by reference and are only converted to text if the condition fails
+	/// </remarks>
+	template<typename... M>
+	constexpr void check(bool condition, M&&... m) {
+		if (!condition) {
+			failWithArgs<PassArg<M>...>(FailureKind::condition, m...);
+		}
+	}
+
+	template<typename B> inline void checkM(B condition, const std::function<void(std::stringstream&)>& messageFunc)=delete;
+
+	/// <summary>
+	/// Checks whether a condition is true, if not raises a logic_error where you can pass a lambda function to build the message
+	/// </summary>
+	/// <param name="condition">The condition to check is true.</param>
+	/// <param name="messageFunc">Example: [=](Integrity::out out) { out &lt;&lt; whateverYouWant; }</param>
+	/// <exception cref="logic_error">Raised if condition is false</exception>
+	/// <remarks>
+	/// This function exists so that you can control the deferred message building by passing in a lambda function which is called if the condition fails.
+	/// </remarks> 
+	template<> inline void checkM<bool>(bool condition, const std::function<void(std::stringstream&)>& messageFunc) {
+		if (!condition) {
+			failWithMessage(FailureKind::condition, messageFunc);
+		}
+	}
+
+	template<typename B, typename F, typename = EnableIfMessageLambda<F>> inline void checkM(B condition, F&& messageFunc) = delete;
+
+	/// <summary>
+	/// Checks whether a condition is true, if not raises a logic_error where you can pass a lambda function to build the message
+	/// </summary>
+	/// <param name="condition">The condition to check is true.</param>
+	/// <param name="messageFunc">Example: [&amp;](Integrity::out out) { out &lt;&lt; whateverYouWant; }</param>
+	/// <exception cref="logic_error">Raised if condition is false</exception>
+	/// <remarks>
+	/// The lambda is passed through as it is, so a passing check costs the same as an if statement.
+	/// </remarks> 
+	template<typename F, typename = EnableIfMessageLambda<F>> constexpr void checkM(bool condition, F&& messageFunc) {
+		if (!condition) {
+			failWithLambda(FailureKind::condition, messageFunc);
+		}
+	}
+
+	/// <summary>
+	/// The same as check, at the always level. The condition can be a predicate instead of a bool, as for debug and audit.
+	/// </summary>
+	template<typename C, typename... M>
+	constexpr void always(C&& condition, M&&... m) {
+		if (!holds(condition)) {
+			failWithArgs<PassArg<M>...>(FailureKind::condition, m...);
+		}
+	}
+
+	// debug and audit default to what INTEGRITY_LEVEL says, so each level has a namespace of its own, as each policy does,
+	// and translation units built at different levels call different functions rather than one the linker picks
+	inline namespace INTEGRITY_LEVEL_NAMESPACE {
+
+	/// <summary>
+	/// A check at the debug level, which fails only when the level is compiled in, from INTEGRITY_LEVEL_DEBUG up, and
+	/// isActive(Level::debug)
+	/// </summary>
+	/// <param name="condition">A bool, or a predicate returning one, which is not called when the level is off</param>
+	/// <param name="m">Optional strings or primitives, as many as needed</param>
+	/// <param name="Compiled">Whether the level is compiled in; defaults to what INTEGRITY_LEVEL says</param>
+	/// <remarks>
+	/// This is a function, so a bool condition and the message args are still evaluated by the caller when the level is
+	/// compiled out or switched off; only the check itself is skipped. Use INTEGRITY_DEBUG, which evaluates nothing then,
+	/// for a check that should cost nothing when it is off.
+	/// </remarks>
+	template<bool Compiled = (INTEGRITY_LEVEL >= INTEGRITY_LEVEL_DEBUG), typename C, typename... M>
+	inline void debug(C&& condition, M&&... m) {
+		if (Compiled && isActive(Level::debug) && !holds(condition)) {
+			failWithArgs<PassArg<M>...>(FailureKind::condition, m...);
+		}
+	}
+
+	/// <summary>
+	/// A check at the audit level, for invariants too expensive for most builds, which fails only when the level is compiled
+	/// in, at INTEGRITY_LEVEL_AUDIT, and isActive(Level::audit)
+	/// </summary>
+	/// <param name="condition">A bool, or a predicate returning one, which is not called when the level is off</param>
+	/// <param name="m">Optional strings or primitives, as many as needed</param>
+	/// <param name="Compiled">Whether the level is compiled in; defaults to what INTEGRITY_LEVEL says</param>
+	/// <example>Integrity::audit([&amp;]() { return index.isConsistent(); }, "index after insert of {}", key);</example>
+	/// <remarks>
+	/// As with debug, the message args and a bool condition are evaluated even when the level is off; INTEGRITY_AUDIT is not.
+	/// </remarks>
+	template<bool Compiled = (INTEGRITY_LEVEL >= INTEGRITY_LEVEL_AUDIT), typename C, typename... M>
+	inline void audit(C&& condition, M&&... m) {
+		if (Compiled && isActive(Level::audit) && !holds(condition)) {
+			failWithArgs<PassArg<M>...>(FailureKind::condition, m...);
+		}
+	}
+
+	} // inline namespace INTEGRITY_LEVEL_NAMESPACE
+
+	/// <summary>
+	/// Integrity::check at the debug and audit levels, which evaluate neither the condition nor the message args when the
+	/// level is compiled out or switched off. The arguments are those of check.
+	/// </summary>
+	/// <example>INTEGRITY_AUDIT(index.isConsistent(), "index after insert of {}", key);</example>
+	/// <remarks>A level which is compiled out still has its arguments compiled, so they cannot go stale, but they are never run</remarks>
+#define INTEGRITY_DEBUG(...) \
+	do { \
+		if (INTEGRITY_LEVEL >= INTEGRITY_LEVEL_DEBUG && ::Integrity::isActive(::Integrity::Level::debug)) { \
+			::Integrity::check(__VA_ARGS__); \
+		} \
+	} while (false)
+#define INTEGRITY_AUDIT(...) \
+	do { \
+		if (INTEGRITY_LEVEL >= INTEGRITY_LEVEL_AUDIT && ::Integrity::isActive(::Integrity::Level::audit)) { \
+			::Integrity::check(__VA_ARGS__); \
+		} \
+	} while (false)
+
+	template<bool CountEvaluations = (INTEGRITY_COUNT_EVALUATIONS != 0), typename NONBOOL, typename... M>
+	inline void checkAt(SiteRef at, NONBOOL youNeedABoolHere, M&&... m) = delete;
+
+	/// <summary>
+	/// The same as check, but the failure is also counted against the call site, for snapshot() to report
+	/// </summary>
+	/// <param name="at">The Site of the check, from INTEGRITY_SITE</param>
+	/// <param name="condition">The condition to check is true.</param>
+	/// <param name="CountEvaluations">Whether to count every time the check runs as well; defaults to INTEGRITY_COUNT_EVALUATIONS</param>
+	/// <exception cref="logic_error">Raised if condition is false</exception>
+	/// <example>Integrity::checkAt(INTEGRITY_SITE("Expected {} to be positive"), x > 0, "Expected {} to be positive", x);</example>
+	template<bool CountEvaluations = (INTEGRITY_COUNT_EVALUATIONS != 0), typename... M>
+	inline void checkAt(SiteRef at, bool condition, M&&... m) {
+		if (CountEvaluations) {
+			at.site.countEvaluation(at.function);
+		}
+		if (!condition) {
+			failAtSite<PassArg<M>...>(at.site, at.function, m...);
+		}
+	}
+
+	// INTEGRITY_CHECK's failure, with the message args it evaluated once the condition had failed. They end with an
+	// EndOfArgs, which is how the macro gets by without a ", __VA_ARGS__" that would be left dangling when there are none.
+	struct EndOfArgs {
+	};
+	template<typename Args, std::size_t... I>
+	inline void failAtSiteWith(Site& site, Args& args, std::index_sequence<I...>) {
+		failAtSite<PassArg<typename std::tuple_element<I, Args>::type>...>(site, site.function(), std::get<I>(args)...);
+	}
+	template<typename... M>
+	inline void failAtSiteWith(Site& site, std::tuple<M...>&& args) {
+		failAtSiteWith(site, args, std::make_index_sequence<sizeof...(M) - 1>());
+	}
+
+	/// <summary>
+	/// The same as checkAt, but the message args are only evaluated if the condition fails, so an expensive one
+	/// costs nothing while the check passes. The message is built from them the same way as for check.
+	/// </summary>
+	/// <param name="condition">The first argument, a bool; anything else (such as a = b instead of a == b) does not compile, as with check</param>
+	/// <example>INTEGRITY_CHECK(table.isSorted(), "table {} is out of order: {}", table.name(), table.dump());</example>
+	/// <remarks>
+	/// __FILE__, __LINE__, __func__ and the text of the condition go into a static Site, which is constant initialised
+	/// and only touched once the condition has failed, so a passing check is just the test of the condition and
+	/// a failing one passes the Site's address. Its failures are counted and reported by snapshot() like checkAt's.
+	/// It has a static variable, so it cannot be used in a constexpr function.
+	/// </remarks>
+#define INTEGRITY_CHECK(...) \
+	do { \
+		if (!::Integrity::holds(INTEGRITY_EXPAND(INTEGRITY_FIRST_ARG(__VA_ARGS__, ~)))) { \
+			static ::Integrity::Site integritySite(__FILE__, __LINE__, INTEGRITY_EXPAND(INTEGRITY_FIRST_ARG_TEXT(__VA_ARGS__, ~)), __func__); \
+			::Integrity::failAtSiteWith(integritySite, std::forward_as_tuple(INTEGRITY_EXPAND(INTEGRITY_OTHER_ARGS(__VA_ARGS__, ::Integrity::EndOfArgs())))); \
+		} \
+	} while (false)
+// Picking a macro's arguments apart. INTEGRITY_EXPAND is for MSVC's traditional preprocessor, which otherwise passes
+// __VA_ARGS__ on to another macro as a single argument.
+#define INTEGRITY_EXPAND(x) x
+#define INTEGRITY_FIRST_ARG(first, ...) first
+#define INTEGRITY_FIRST_ARG_TEXT(first, ...) #first
+#define INTEGRITY_OTHER_ARGS(first, ...) __VA_ARGS__
+
+	// What checkEveryN and checkSampled do once their countdown gets to 0
+	template<typename P, typename... M>
+	inline void runSampled(SampleState& state, std::uint32_t nextGap, P& predicate, M&... m) {
+		state.countdown = state.gap = nextGap;
+		if (!holds(predicate)) {
+			failWithArgs<PassArg<M>...>(FailureKind::condition, m...);
+		}
+	}
+	template<typename P, typename... M>
+	inline void runSampled(SiteRef at, SampleState& state, std::uint32_t nextGap, P& predicate, M&... m) {
+		at.site.countSampled(at.function, state.gap - 1);
+		state.countdown = state.gap = nextGap;
+		if (!holds(predicate)) {
+			failAtSite<PassArg<M>...>(at.site, at.function, m...);
+		}
+	}
+	template<typename P> using EnableIfPredicate = typename std::enable_if<!std::is_same<typename std::decay<P>::type, bool>::value>::type;
+
+	/// <summary>
+	/// Runs a predicate on one call in every n, on each thread, and raises a logic_error if it returns false
+	/// </summary>
+	/// <param name="n">1 in how many calls run the predicate; 0 is the same as 1</param>
+	/// <param name="predicate">A lambda returning bool. Each lambda has a countdown of its own per thread, which is what
+	/// keeps the call sites apart, so do not share one lambda (or pass a function pointer) between checks.</param>
+	/// <param name="m">Optional strings or primitives, as many as needed</param>
+	/// <example>Integrity::checkEveryN(1000, [&amp;]() { return index.isConsistent(); }, "index of {}", name);</example>
+	/// <remarks>
+	/// A skipped call is one decrement of a thread_local and one branch. The first call on each thread runs the predicate.
+	/// The message args are evaluated by the caller on every call, so keep them cheap.
+	/// </remarks>
+	template<typename P, typename... M, typename = EnableIfPredicate<P>>
+	inline void checkEveryN(std::uint32_t n, P&& predicate, M&&... m) {
+		SampleState& state = sampleState<typename std::decay<P>::type>();
+		if (--state.countdown != 0) {
+			return;
+		}
+		runSampled(state, n == 0 ? 1 : n, predicate, m...);
+	}
+
+	/// <summary>
+	/// The same as checkEveryN, but the runs and the skipped calls are counted against the call site, for snapshot() to report
+	/// </summary>
+	/// <example>Integrity::checkEveryN(INTEGRITY_SITE("index"), 1000, [&amp;]() { return index.isConsistent(); }, "index");</example>
+	/// <remarks>Nothing is counted on a skipped call; the calls skipped since the last run are added on when the predicate runs</remarks>
+	template<typename P, typename... M, typename = EnableIfPredicate<P>>
+	inline void checkEveryN(SiteRef at, std::uint32_t n, P&& predicate, M&&... m) {
+		SampleState& state = sampleState<typename std::decay<P>::type>();
+		if (--state.countdown != 0) {
+			return;
+		}
+		runSampled(at, state, n == 0 ? 1 : n, predicate, m...);
+	}
+
+	/// <summary>
+	/// Runs a predicate on a random sample of the calls, each with probability rate, and raises a logic_error if it returns false
+	/// </summary>
+	/// <param name="rate">From 0 (never, after the first call) to 1 (always)</param>
+	/// <param name="predicate">A lambda returning bool, which as for checkEveryN should not be shared between checks</param>
+	/// <param name="m">Optional strings or primitives, as many as needed</param>
+	/// <example>Integrity::checkSampled(0.001, [&amp;]() { return tree.isBalanced(); }, "tree {}", id);</example>
+	/// <remarks>
+	/// Rather than drawing a random number on every call, the number of calls to the next run is drawn when the predicate
+	/// runs, from a per thread xorshift generator, so a skipped call costs the same as one of checkEveryN.
+	/// </remarks>
+	template<typename P, typename... M, typename = EnableIfPredicate<P>>
+	inline void checkSampled(double rate, P&& predicate, M&&... m) {
+		SampleState& state = sampleState<typename std::decay<P>::type>();
+		if (--state.countdown != 0) {
+			return;
+		}
+		runSampled(state, sampleGap(state, rate), predicate, m...);
+	}
+
+	/// <summary>
+	/// The same as checkSampled, but the runs and the skipped calls are counted against the call site, for snapshot() to report
+	/// </summary>
+	template<typename P, typename... M, typename = EnableIfPredicate<P>>
+	inline void checkSampled(SiteRef at, double rate, P&& predicate, M&&... m) {
+		SampleState& state = sampleState<typename std::decay<P>::type>();
+		if (--state.countdown != 0) {
+			return;
+		}
+		runSampled(at, state, sampleGap(state, rate), predicate, m...);
+	}
+
+	// ******************************************************************************************************************
+	// * -------------------------------------------------- fail ------------------------------------------------------ *
+	// ******************************************************************************************************************
+			
+	/// <summary>
+	/// Raises a logic_error with a default message
+	/// </summary>
+	/// <exception cref="logic_error"></exception>
+	/// <remarks>
+	/// Like the checks, this returns instead of throwing when a Collector::Scope is active on the thread
+	/// </remarks>
+	inline void fail() {
+		failWithMessage(FailureKind::condition, defaultExceptionMessage);
+	}
+
+	inline void fail(const char* message) {
+		failWithMessage(FailureKind::condition, message);
+	}
+
+	/// <summary>
+	/// Raises a logic_error where you can pass a lambda function to build the message
+	/// </summary>
+	/// <param name="messageFunc">Example: [=](Integrity::out out) { out &lt;&lt; whateverYouWant; }</param>
+	/// <exception cref="logic_error">Raised if condition is false</exception>
+	/// <remarks>
+	/// This function exists so that you can control the deferred message building by passing in a lambda function which is called if the condition fails.
+	/// </remarks>
+	inline void failM(const std::function<void(std::stringstream&)>& messageFunc) {
+		failWithMessage(FailureKind::condition, messageFunc);
+	}
+	template<typename F, typename = EnableIfMessageLambda<F>>
+	inline void failM(F&& messageFunc) {
+		failWithLambda(FailureKind::condition, messageFunc);
+	}
+
+	/// <summary>
+	/// Raises a logic_error
+	/// </summary>
+	/// <param name="m">Optional strings or primitives, as many as needed</param>
+	/// <exception cref="logic_error"></exception>
+	template<typename... M>
+	inline void fail(M&&... m) {
+		failWithArgs<PassArg<M>...>(FailureKind::condition, m...);
+	}
+
+	// ******************************************************************************************************************
+	// * -------------------------------------- checkIsValidNumber ---------------------------------------------------- *
+	// ******************************************************************************************************************
+
+
+	template<typename N>
+	constexpr void checkIsValidNumber(const N value, const char* message) {
+		if (!isFiniteNumber(value)) {
+			failWithMessage(invalidNumberKind(value), message);
+		}
+	}
+
+	/// <summary>
+	/// Raises a logic_error if the number is NaN or +-Infinity
+	/// </summary>
+	/// <param name="value">float, double or long double</param>
+	/// <param name="m">Optional strings or primitives, as many as needed</param>
+	/// <exception cref="logic_error"></exception>
+	template<typename N, typename... M>
+	constexpr void checkIsValidNumber(const N value, M&&... m) {
+		// a single compare, NaN vs Infinity is only worked out once we know we are failing
+		if (!isFiniteNumber(value)) {
+			failWithInvalidNumber<N, PassArg<M>...>(value, m...);
+		}
+	}
+
+	/// <summary>
+	/// Raises a logic_error if the number is NaN or +-Infinity
+	/// </summary>
+	/// <param name="value">float, double or long double</param>
+	/// <param name="messageFunc">Example: [=](Integrity::out out) { out &lt;&lt; whateverYouWant; }</param>
+	/// <exception cref="logic_error"></exception>
+	/// <remarks>
+	/// This function exists so that you can control the deferred message building by passing in a lambda function which is called if the condition fails.
+	/// </remarks>
+	template<typename N> 
+	inline void checkIsValidNumberM(const N value, const std::function<void(std::stringstream&)>& messageFunc) {
+		if (!isFiniteNumber(value)) {
+			failWithMessage(invalidNumberKind(value), messageFunc);
+		}
+	}
+	template<typename N, typename F, typename = EnableIfMessageLambda<F>>
+	constexpr void checkIsValidNumberM(const N value, F&& messageFunc) {
+		if (!isFiniteNumber(value)) {
+			failWithLambda(invalidNumberKind(value), messageFunc);
+		}
+	}
+
+	// ******************************************************************************************************************
+	// * ------------------------------------- checkAllValidNumbers --------------------------------------------------- *
+	// ******************************************************************************************************************
+
+	/// <summary>
+	/// Raises a logic_error if any of the numbers is NaN or +-Infinity
+	/// </summary>
+	/// <param name="data">pointer to the first of the floats, doubles or long doubles</param>
+	/// <param name="count">how many numbers to check</param>
+	/// <param name="m">Optional strings or primitives, as many as needed</param>
+	/// <exception cref="logic_error">The message says which was the first invalid number and where it was, e.g. 'NaN at index 12'.
+	/// Any message args are put in front of that, e.g. 'prices: NaN at index 12'</exception>
+	/// <remarks>
+	/// floats and doubles are checked several at a time by looking for an all ones exponent, using the widest of
+	/// SSE2, AVX2 or AVX-512 that the CPU has.
+	/// </remarks>
+	template<typename N, typename... M>
+	INTEGRITY_CONSTEXPR_BULK void checkAllValidNumbers(const N* data, std::size_t count, M&&... m) {
+		std::size_t index = INTEGRITY_CONSTANT_EVALUATED() ? findFirstInvalidNumberConstant(data, count) : findFirstInvalidNumber(data, count);
+		if (index != count) {
+			failWithInvalidNumberAt<N, PassArg<M>...>(data[index], index, m...);
+		}
+	}
+
+	/// <summary>
+	/// Raises a logic_error if any of the numbers in a contiguous container (std::vector, std::array etc.) is NaN or +-Infinity
+	/// </summary>
+	/// <param name="numbers">container of floats, doubles or long doubles</param>
+	/// <param name="m">Optional strings or primitives, as many as needed</param>
+	/// <exception cref="logic_error">The message says which was the first invalid number and where it was, e.g. 'NaN at index 12'</exception>
+	template<typename C, typename... M,
+		typename = decltype(std::declval<const C&>().data() + std::declval<const C&>().size())>
+	INTEGRITY_CONSTEXPR_BULK void checkAllValidNumbers(const C& numbers, M&&... m) {
+		checkAllValidNumbers(numbers.data(), numbers.size(), m...);
+	}
+
+	// ******************************************************************************************************************
+	// * ----------------------------------------- checkAllNotNull ---------------------------------------------------- *
+	// ******************************************************************************************************************
+
+	/// <summary>
+	/// Raises a logic_error if any of the pointers is null
+	/// </summary>
+	/// <param name="pointers">pointer to the first of the pointers to check</param>
+	/// <param name="count">how many pointers to check</param>
+	/// <param name="m">Optional strings or primitives, as many as needed</param>
+	/// <exception cref="logic_error">The message says where the first null was, e.g. 'Null pointer at index 3'.
+	/// Any message args are put in front of that, e.g. 'rows: Null pointer at index 3'</exception>
+	/// <remarks>
+	/// The pointers are compared with zero several at a time, using the widest of SSE2, AVX2 or AVX-512 that the CPU has.
+	/// </remarks>
+	template<typename T, typename... M>
+	inline void checkAllNotNull(const T* const* pointers, std::size_t count, M&&... m) {
+		std::size_t index = findFirstNull((const void* const*) pointers, count);
+		if (index != count) {
+			failAtIndex<PassArg<M>...>(FailureKind::nullPointer, index, m...);
+		}
+	}
+
+	/// <summary>
+	/// Raises a logic_error if any of the pointers in a container is null
+	/// </summary>
+	/// <param name="pointers">container of raw pointers, or of anything that can be compared with nullptr such as std::unique_ptr</param>
+	/// <param name="m">Optional strings or primitives, as many as needed</param>
+	/// <exception cref="logic_error">The message says where the first null was, e.g. 'Null pointer at index 3'</exception>
+	template<typename C, typename... M,
+		typename = decltype(std::declval<const C&>().begin() != std::declval<const C&>().end())>
+	inline void checkAllNotNull(const C& pointers, M&&... m) {
+		std::size_t index = findFirstNullInRange(pointers);
+		if (index != (std::size_t) -1) {
+			failAtIndex<PassArg<M>...>(FailureKind::nullPointer, index, m...);
+		}
+	}
+
+	// ******************************************************************************************************************
+	// * ------------------------------------- checkAllStringsNotEmpty ------------------------------------------------- *
+	// ******************************************************************************************************************
+
+	/// <summary>
+	/// Raises a logic_error if any of the strings in a container is null or zero length
+	/// </summary>
+	/// <param name="strings">container of std::string, wstring, u16string, u32string, pointers to them, or char*</param>
+	/// <param name="m">Optional strings or primitives, as many as needed</param>
+	/// <exception cref="logic_error">The message says where the first null or empty string was, e.g. 'Empty string at index 7'.
+	/// Any message args are put in front of that, e.g. 'names: Empty string at index 7'</exception>
+	/// <remarks>
+	/// The strings are tested a block at a time with the results ORed together, so there is one branch per block
+	/// rather than one per string.
+	/// </remarks>
+	template<typename C, typename... M,
+		typename = decltype(std::declval<const C&>().begin() != std::declval<const C&>().end())>
+	inline void checkAllStringsNotEmpty(const C& strings, M&&... m) {
+		const char* problem = nullptr;
+		std::size_t index = findFirstNullOrEmptyString(strings, strings.size(), problem);
+		if (problem != nullptr) {
+			failAtIndex<PassArg<M>...>(problem == defaultNullPointerMessage ? FailureKind::nullPointer : FailureKind::emptyString, index, m...);
+		}
+	}
+
+	// ******************************************************************************************************************
+	// * ------------------------------------------- checkEach, checkAllOf -------------------------------------------- *
+	// ******************************************************************************************************************
+
+	template<typename I, typename P> using EnableIfElementPredicate =
+		decltype((void) static_cast<bool>(std::declval<P&>()(*std::declval<I&>())));
+
+	/// <summary>
+	/// Raises a logic_error if a predicate is false for any of the elements from first up to last
+	/// </summary>
+	/// <param name="predicate">Called with each element, returning bool. For a large range it is called from several threads
+	/// at once, so it has to be safe to. If it throws, the first exception is rethrown on the calling thread.</param>
+	/// <param name="m">Optional strings or primitives, as many as needed</param>
+	/// <exception cref="logic_error">The message says where the first failure was, e.g. 'Integrity check failed at index 3'.
+	/// Any message args are put in front of that, e.g. 'orders: Integrity check failed at index 3'</exception>
+	/// <example>Integrity::checkAllOf(orders.begin(), orders.end(), [](const Order&amp; o) { return o.quantity &gt; 0; }, "orders");</example>
+	/// <remarks>
+	/// With random access iterators, a range of at least INTEGRITY_PARALLEL_MIN elements is shared between parallelThreads()
+	/// threads, which stop early once one has found a failure. The index reported is still the lowest failing one, so it is
+	/// the same however many threads there were.
+	/// </remarks>
+	template<typename I, typename P, typename... M, typename = EnableIfElementPredicate<I, P>>
+	inline void checkAllOf(I first, I last, P&& predicate, M&&... m) {
+		std::size_t count = (std::size_t) std::distance(first, last);
+		std::size_t index = findFirstFailure(first, count, predicate, typename std::iterator_traits<I>::iterator_category());
+		if (index != count) {
+			failAtIndex<PassArg<M>...>(FailureKind::condition, index, m...);
+		}
+	}
+
+	/// <summary>
+	/// Raises a logic_error if a predicate is false for any of the elements of a container (or array), checking large
+	/// ones on several threads, as checkAllOf
+	/// </summary>
+	/// <example>Integrity::checkEach(prices, [](double price) { return price &gt;= 0; }, "prices of {}", day);</example>
+	template<typename C, typename P, typename... M, typename = EnableIfElementPredicate<decltype(std::begin(std::declval<const C&>())), P>>
+	inline void checkEach(const C& range, P&& predicate, M&&... m) {
+		checkAllOf(std::begin(range), std::end(range), predicate, std::forward<M>(m)...);
+	}
+
+	// ******************************************************************************************************************
+	// * ------------------------------- checkSorted, checkAllInRange, checkUnique ------------------------------------ *
+	// ******************************************************************************************************************
+
+	// Contiguous containers of numbers use the kernels, anything else is looped over with its iterators
+	template<typename C, typename = void> struct IsContiguousNumbers : std::false_type {};
+	template<typename C> struct IsContiguousNumbers<C, typename std::enable_if<std::is_arithmetic<typename std::remove_cv<
+		typename std::remove_reference<decltype(*std::declval<const C&>().data())>::type>::type>::value,
+		decltype(std::declval<const C&>().size(), void())>::type> : std::true_type {};
+	template<typename C> using EnableIfRange = decltype(std::declval<const C&>().begin() != std::declval<const C&>().end());
+	template<typename C> using ElementOf = typename std::decay<decltype(*std::declval<const C&>().begin())>::type;
+	template<typename T> struct NotDeduced {
+		using type = T;
+	};
+
+	template<bool Strict, typename C> std::size_t findFirstUnsortedInRange(const C& values, std::true_type) {
+		return findFirstUnsorted<Strict>(values.data(), values.size());
+	}
+	template<bool Strict, typename C> std::size_t findFirstUnsortedInRange(const C& values, std::false_type) {
+		std::size_t index = 0;
+		auto previous = values.begin();
+		for (auto it = values.begin(); it != values.end(); ++it, ++index) {
+			if (index != 0 && (Strict ? !(*previous < *it) : *it < *previous)) {
+				return index;
+			}
+			previous = it;
+		}
+		return index;
+	}
+	template<typename C, typename T> std::size_t findFirstOutOfRangeInRange(const C& values, const T& lo, const T& hi, std::true_type) {
+		return findFirstOutOfRange(values.data(), values.size(), lo, hi);
+	}
+	template<typename C, typename T> std::size_t findFirstOutOfRangeInRange(const C& values, const T& lo, const T& hi, std::false_type) {
+		std::size_t index = 0;
+		for (const auto& value : values) {
+			if (!(lo <= value && value <= hi)) {
+				return index;
+			}
+			++index;
+		}
+		return index;
+	}
+
+	/// <summary>
+	/// Raises a logic_error if any of the values is less than the one before it
+	/// </summary>
+	/// <param name="data">pointer to the first of the values, which can be of any type with an operator&lt;</param>
+	/// <param name="count">how many values to check</param>
+	/// <param name="m">Optional strings or primitives, as many as needed</param>
+	/// <exception cref="logic_error">The message says where the first value out of order was, e.g. 'Out of order at index 5'
+	/// when values[5] &lt; values[4]. Any message args are put in front of that, e.g. 'keys: Out of order at index 5'</exception>
+	/// <remarks>
+	/// 32 and 64 bit integers, floats and doubles are compared with the next one several at a time, using SSE2 or AVX2.
+	/// As with std::is_sorted, a NaN is not out of order.
+	/// </remarks>
+	template<typename T, typename... M>
+	inline void checkSorted(const T* data, std::size_t count, M&&... m) {
+		std::size_t index = findFirstUnsorted<false>(data, count);
+		if (index != count) {
+			failAtIndex<PassArg<M>...>(FailureKind::outOfOrder, index, m...);
+		}
+	}
+
+	/// <summary>
+	/// Raises a logic_error if any of the values in a container is less than the one before it
+	/// </summary>
+	/// <exception cref="logic_error">The message says where the first value out of order was, e.g. 'Out of order at index 5'</exception>
+	template<typename C, typename... M, typename = EnableIfRange<C>>
+	inline void checkSorted(const C& values, M&&... m) {
+		std::size_t index = findFirstUnsortedInRange<false>(values, IsContiguousNumbers<C>());
+		if (index != (std::size_t) std::distance(values.begin(), values.end())) {
+			failAtIndex<PassArg<M>...>(FailureKind::outOfOrder, index, m...);
+		}
+	}
+
+	/// <summary>
+	/// Raises a logic_error unless each of the values is greater than the one before it, so that they are sorted with no repeats
+	/// </summary>
+	/// <exception cref="logic_error">The message says where the first value not greater than the one before was, e.g. 'Out of order at index 5'</exception>
+	/// <remarks>The same kernels as checkSorted. A NaN is never greater than anything, so one fails the check.</remarks>
+	template<typename T, typename... M>
+	inline void checkStrictlyIncreasing(const T* data, std::size_t count, M&&... m) {
+		std::size_t index = findFirstUnsorted<true>(data, count);
+		if (index != count) {
+			failAtIndex<PassArg<M>...>(FailureKind::outOfOrder, index, m...);
+		}
+	}
+
+	template<typename C, typename... M, typename = EnableIfRange<C>>
+	inline void checkStrictlyIncreasing(const C& values, M&&... m) {
+		std::size_t index = findFirstUnsortedInRange<true>(values, IsContiguousNumbers<C>());
+		if (index != (std::size_t) std::distance(values.begin(), values.end())) {
+			failAtIndex<PassArg<M>...>(FailureKind::outOfOrder, index, m...);
+		}
+	}
+
+	/// <summary>
+	/// Raises a logic_error if any of the values is outside [lo, hi]
+	/// </summary>
+	/// <param name="lo">the lowest value allowed</param>
+	/// <param name="hi">the highest value allowed</param>
+	/// <exception cref="logic_error">The message says where the first value out of range was, e.g. 'Out of range at index 3'.
+	/// Any message args are put in front of that, e.g. 'percentages: Out of range at index 3'</exception>
+	/// <remarks>
+	/// 32 and 64 bit integers, floats and doubles are compared with both bounds several at a time, using SSE2 or AVX2.
+	/// A NaN is not in any range.
+	/// </remarks>
+	template<typename T, typename... M>
+	inline void checkAllInRange(const T* data, std::size_t count, const typename NotDeduced<T>::type& lo, const typename NotDeduced<T>::type& hi, M&&... m) {
+		std::size_t index = findFirstOutOfRange(data, count, lo, hi);
+		if (index != count) {
+			failAtIndex<PassArg<M>...>(FailureKind::outOfRange, index, m...);
+		}
+	}
+
+	template<typename C, typename... M, typename = EnableIfRange<C>>
+	inline void checkAllInRange(const C& values, const typename NotDeduced<ElementOf<C>>::type& lo, const typename NotDeduced<ElementOf<C>>::type& hi, M&&... m) {
+		std::size_t index = findFirstOutOfRangeInRange(values, lo, hi, IsContiguousNumbers<C>());
+		if (index != (std::size_t) std::distance(values.begin(), values.end())) {
+			failAtIndex<PassArg<M>...>(FailureKind::outOfRange, index, m...);
+		}
+	}
+
+	/// <summary>
+	/// Raises a logic_error if any two of the values are equal
+	/// </summary>
+	/// <param name="data">pointer to the first of the values, which can be of any type with std::hash and operator==</param>
+	/// <exception cref="logic_error">The message says where the first repeat was, e.g. 'Duplicate at index 7' when values[7] is
+	/// equal to one before it. Any message args are put in front of that, e.g. 'ids: Duplicate at index 7'</exception>
+	/// <remarks>
+	/// The values' indices are put into an open addressing hash table, which is kept per thread and only grows, so once it
+	/// is big enough checking does not allocate. It takes 8 bytes per value checked (16 beyond 2^31 values).
+	/// </remarks>
+	template<typename T, typename... M>
+	inline void checkUnique(const T* data, std::size_t count, M&&... m) {
+		std::size_t index = findFirstDuplicate(data, count);
+		if (index != count) {
+			failAtIndex<PassArg<M>...>(FailureKind::duplicate, index, m...);
+		}
+	}
+
+	/// <summary>
+	/// Raises a logic_error if any two of the values in a random access container (std::vector, std::deque etc.) are equal
+	/// </summary>
+	template<typename C, typename... M, typename = EnableIfRange<C>>
+	inline void checkUnique(const C& values, M&&... m) {
+		static_assert(std::is_base_of<std::random_access_iterator_tag, typename std::iterator_traits<decltype(values.begin())>::iterator_category>::value,
+			"checkUnique needs a container with random access, such as a std::vector");
+		std::size_t count = (std::size_t) (values.end() - values.begin());
+		std::size_t index = findFirstDuplicate(values.begin(), count);
+		if (index != count) {
+			failAtIndex<PassArg<M>...>(FailureKind::duplicate, index, m...);
+		}
+	}
+
+	// ******************************************************************************************************************
+	// * ------------------------------------------- checked arithmetic ----------------------------------------------- *
+	// ******************************************************************************************************************
+
+	/// <summary>
+	/// a + b, raising a logic_error if it does not fit in T
+	/// </summary>
+	/// <param name="b">any integer type, converted to the type of a; one which does not fit in it is an overflow</param>
+	/// <param name="m">Optional strings or primitives, as many as needed</param>
+	/// <exception cref="logic_error">The message has both operands, e.g. 'Overflow in 4294967295 + 1'.
+	/// Any message args are put in front of that, e.g. 'offset of row 7: Overflow in 4294967295 + 1'</exception>
+	/// <example>std::size_t end = Integrity::checkedAdd(offset, length, "end of {}", name);</example>
+	/// <remarks>
+	/// With g++ and clang this is __builtin_add_overflow, which is the add and a branch on the overflow or carry flag.
+	/// If the failure policy carries on, the result is what unsigned arithmetic would give, i.e. it wraps.
+	/// </remarks>
+	template<typename T, typename B, typename... M, typename = EnableIfInteger<T>, typename = EnableIfInteger<B>>
+	inline T checkedAdd(T a, B b, M&&... m) {
+		T operand;
+		T result;
+		bool cutDown = operandOverflows(b, operand);
+		if (addOverflows(a, operand, result) || cutDown) {
+			failWithOperands<T, B, PassArg<M>...>(FailureKind::overflow, additionSite(), a, b, noFailureIndex, m...);
+		}
+		return result;
+	}
+
+	/// <summary>
+	/// a - b, raising a logic_error if it does not fit in T (for unsigned types, if b is greater than a)
+	/// </summary>
+	/// <exception cref="logic_error">The message has both operands, e.g. 'Overflow in 3 - 5'</exception>
+	template<typename T, typename B, typename... M, typename = EnableIfInteger<T>, typename = EnableIfInteger<B>>
+	inline T checkedSub(T a, B b, M&&... m) {
+		T operand;
+		T result;
+		bool cutDown = operandOverflows(b, operand);
+		if (subOverflows(a, operand, result) || cutDown) {
+			failWithOperands<T, B, PassArg<M>...>(FailureKind::overflow, subtractionSite(), a, b, noFailureIndex, m...);
+		}
+		return result;
+	}
+
+	/// <summary>
+	/// a * b, raising a logic_error if it does not fit in T
+	/// </summary>
+	/// <exception cref="logic_error">The message has both operands, e.g. 'Overflow in 4294967296 * 4294967296'</exception>
+	/// <remarks>No division is needed, unlike checking that (a * b) / a == b</remarks>
+	template<typename T, typename B, typename... M, typename = EnableIfInteger<T>, typename = EnableIfInteger<B>>
+	inline T checkedMul(T a, B b, M&&... m) {
+		T operand;
+		T result;
+		bool cutDown = operandOverflows(b, operand);
+		if (mulOverflows(a, operand, result) || cutDown) {
+			failWithOperands<T, B, PassArg<M>...>(FailureKind::overflow, multiplicationSite(), a, b, noFailureIndex, m...);
+		}
+		return result;
+	}
+
+	/// <summary>
+	/// value converted to T, raising a logic_error if that changes it
+	/// </summary>
+	/// <param name="value">an integer or floating point number</param>
+	/// <param name="m">Optional strings or primitives, as many as needed</param>
+	/// <exception cref="logic_error">The message has the value and the type, e.g. 'Narrowing 300 to uint8'</exception>
+	/// <example>std::uint16_t port = Integrity::narrow&lt;std::uint16_t&gt;(parsed, "port");</example>
+	/// <remarks>
+	/// A value changes if it is out of range of T, has a fraction T cannot hold, or (between integers) changes sign.
+	/// A floating point value out of range of an integer T is never converted, as that would be undefined behaviour.
+	/// </remarks>
+	template<typename T, typename F, typename... M>
+	inline T narrow(F value, M&&... m) {
+		T result;
+		if (narrowingChanges(value, result)) {
+			failWithOperands<F, const char*, PassArg<M>...>(FailureKind::narrowing, narrowSite(), value, numberTypeName<T>(), noFailureIndex, m...);
+		}
+		return result;
+	}
+
+	/// <summary>
+	/// The sum of the values, raising a logic_error if it does not fit in T at any point
+	/// </summary>
+	/// <exception cref="logic_error">The message has the operands and where it overflowed, e.g. 'Overflow in 4294967295 + 2 at index 7'</exception>
+	/// <example>std::size_t total = Integrity::checkedSum(sizes, "sizes of {}", name);</example>
+	/// <remarks>
+	/// Each addition is the add and a branch on its carry or overflow flag, so this costs the same as a loop which tests
+	/// each value against the limit. ORing the overflows together to branch once per span was tried and is slower, as it
+	/// adds a second chain of dependent instructions to a loop already bound by the one through the total.
+	/// When the failure policy carries on, only the first overflow is reported and the sum wraps.
+	/// </remarks>
+	template<typename T, typename... M, typename = EnableIfInteger<T>>
+	inline T checkedSum(const T* data, std::size_t count, M&&... m) {
+		T total = 0;
+		for (std::size_t i = 0; i < count; ++i) {
+			if (addOverflows(total, data[i], total)) {
+				return failSumOverflow<T, PassArg<M>...>(total, data, i, count, m...);
+			}
+		}
+		return total;
+	}
+
+	template<typename C, typename... M, typename = decltype(std::declval<const C&>().data() + std::declval<const C&>().size())>
+	inline auto checkedSum(const C& values, M&&... m) -> typename std::decay<decltype(*values.data())>::type {
+		return checkedSum(values.data(), values.size(), m...);
+	}
+
+	/// <summary>
+	/// Converts each value to T into out, raising a logic_error if any of them changes
+	/// </summary>
+	/// <exception cref="logic_error">The message has the first value which changed and where it was, e.g. 'Narrowing -1 to uint32 at index 4'</exception>
+	/// <remarks>The values are all converted and checked without a branch, which lets the compiler vectorise the loop for most
+	/// pairs of types, and only a failure goes back to find which value it was.</remarks>
+	template<typename T, typename F, typename... M>
+	inline void narrowAll(const F* data, std::size_t count, T* out, M&&... m) {
+		// out may alias data when T is a char type, so each value goes through a local, and an unsigned rather than a bool
+		// collects the failures so the loop has no branch to stop it vectorising
+		unsigned changed = 0;
+		for (std::size_t i = 0; i < count; ++i) {
+			T result;
+			changed |= narrowingChanges(data[i], result);
+			out[i] = result;
+		}
+		if (changed != 0) {
+			std::size_t i = 0;
+			T result;
+			while (!narrowingChanges(data[i], result)) {
+				++i;
+			}
+			failWithOperands<F, const char*, PassArg<M>...>(FailureKind::narrowing, narrowAllSite(), data[i], numberTypeName<T>(), i, m...);
+		}
+	}
+
+	// ******************************************************************************************************************
+	// * ------------------------------------------ checked_span, checked_stride -------------------------------------- *
+	// ******************************************************************************************************************
+
+	template<typename T, bool CheckEveryAccess> class checked_stride;
+
+	/// <summary>
+	/// A pointer and a size whose windows are checked once, when they are taken, so that a loop over one has no check in it
+	/// </summary>
+	/// <param name="T">The element type, const for a read only span</param>
+	/// <param name="CheckEveryAccess">Whether operator[] checks its index too, while isActive(Level::debug); off by default, and
+	/// on for debug_checked_span. It does not follow INTEGRITY_LEVEL, so that the type is the same in every translation unit</param>
+	/// <example>
+	/// auto in = Integrity::checked_span&lt;const float&gt;(samples).window(offset, count, "samples of {}", name);
+	/// auto out = Integrity::checked_span&lt;float&gt;(result).window(offset, count);
+	/// for (std::size_t i = 0; i &lt; count; ++i) out[i] = in[i] * gain;
+	/// </example>
+	/// <remarks>
+	/// With the per access check off, operator[] is a plain pointer access, so the compiler can vectorise a loop over a
+	/// window as it would one over a raw pointer, where Integrity::check(i &lt; n) on each access would stop it.
+	/// The span does not own what it points at. The name follows std::span, which it can be used alongside.
+	/// </remarks>
+	template<typename T, bool CheckEveryAccess = false>
+	class checked_span {
+	public:
+		typedef T element_type;
+		typedef typename std::remove_cv<T>::type value_type;
+		typedef T* iterator;
+
+		constexpr checked_span() noexcept : start(nullptr), count(0) {}
+		constexpr checked_span(T* data, std::size_t size) noexcept : start(data), count(size) {}
+		template<std::size_t N>
+		constexpr checked_span(T(&array)[N]) noexcept : start(array), count(N) {}
+		template<typename C, typename = typename std::enable_if<std::is_convertible<decltype(std::declval<C&>().data()), T*>::value>::type>
+		constexpr checked_span(C& container) noexcept : start(container.data()), count(container.size()) {}
+		// from a span of non const elements, or one with the other access mode
+		template<typename U, bool E, typename = typename std::enable_if<std::is_convertible<U(*)[], T(*)[]>::value>::type>
+		constexpr checked_span(const checked_span<U, E>& other) noexcept : start(other.data()), count(other.size()) {}
+
+		/// <summary>
+		/// The length elements from offset on, raising a logic_error unless they are all in this span
+		/// </summary>
+		/// <exception cref="logic_error">e.g. 'Window 8 + 4 out of bounds for size 10', after the message args if there are any</exception>
+		template<typename... M>
+		checked_span window(std::size_t offset, std::size_t length, M&&... m) const {
+			if (offset > count || length > count - offset) {
+				failWindowOutOfBounds<PassArg<M>...>(offset, length, 1, count, m...);
+				return checked_span();
+			}
+			return checked_span(start + offset, length);
+		}
+
+		/// <summary>
+		/// The length elements from offset on, stride apart, such as one column of a row major matrix, raising a logic_error
+		/// unless they are all in this span
+		/// </summary>
+		/// <exception cref="logic_error">e.g. 'Window 2 + 4 x 3 out of bounds for size 10', for 4 elements 3 apart from index 2</exception>
+		template<typename... M>
+		checked_stride<T, CheckEveryAccess> strided(std::size_t offset, std::size_t length, std::size_t stride, M&&... m) const {
+			// the last element is (length - 1) * stride past the first, and that product can overflow
+			std::size_t extent = 0;
+			if (length == 0 ? offset > count : offset >= count || mulOverflows(length - 1, stride, extent) || extent >= count - offset) {
+				failWindowOutOfBounds<PassArg<M>...>(offset, length, stride, count, m...);
+				return checked_stride<T, CheckEveryAccess>();
+			}
+			return checked_stride<T, CheckEveryAccess>(start + offset, length, stride);
+		}
+
+		/// <summary>
+		/// The element at index, which is only checked when CheckEveryAccess is on
+		/// </summary>
+		/// <remarks>If the check fails and the failure policy carries on, this is a stand in element, as for at()</remarks>
+		T& operator[](std::size_t index) const {
+			if (CheckEveryAccess && isActive(Level::debug) && index >= count) {
+				return failIndexOutOfBounds<T>(index, count);
+			}
+			return start[index];
+		}
+
+		/// <summary>
+		/// The element at index, which is always checked
+		/// </summary>
+		/// <exception cref="logic_error">e.g. 'Index 12 out of bounds for size 10', after the message args if there are any</exception>
+		/// <remarks>
+		/// If the failure policy carries on (INTEGRITY_LOG, INTEGRITY_COUNT, INTEGRITY_IGNORE or INTEGRITY_ASYNC), an index out of
+		/// bounds gives a value initialised element of the thread's own rather than one past the end, so a read gets zero and a
+		/// write changes nothing in the span. An element type which cannot be value initialised and assigned aborts instead.
+		/// </remarks>
+		template<typename... M>
+		T& at(std::size_t index, M&&... m) const {
+			if (index >= count) {
+				return failIndexOutOfBounds<T, PassArg<M>...>(index, count, m...);
+			}
+			return start[index];
+		}
+
+		constexpr T* data() const noexcept {
+			return start;
+		}
+		constexpr std::size_t size() const noexcept {
+			return count;
+		}
+		constexpr bool empty() const noexcept {
+			return count == 0;
+		}
+		constexpr T* begin() const noexcept {
+			return start;
+		}
+		constexpr T* end() const noexcept {
+			return start + count;
+		}
+
+	private:
+		T* start;
+		std::size_t count;
+	};
+
+	/// <summary>
+	/// Elements a fixed distance apart, as checked_span::strided returns them, checked as a whole when they were taken
+	/// </summary>
+	template<typename T, bool CheckEveryAccess = false>
+	class checked_stride {
+	public:
+		constexpr checked_stride() noexcept : start(nullptr), count(0), step(1) {}
+		constexpr checked_stride(T* data, std::size_t size, std::size_t stride) noexcept : start(data), count(size), step(stride) {}
+
+		/// <summary>
+		/// The element index strides along, which is only checked when CheckEveryAccess is on
+		/// </summary>
+		/// <remarks>If the check fails and the failure policy carries on, this is a stand in element, as for checked_span::at</remarks>
+		T& operator[](std::size_t index) const {
+			if (CheckEveryAccess && isActive(Level::debug) && index >= count) {
+				return failIndexOutOfBounds<T>(index, count);
+			}
+			return start[index * step];
+		}
+
+		/// <summary>
+		/// The element index strides along, which is always checked
+		/// </summary>
+		/// <remarks>If the check fails and the failure policy carries on, this is a stand in element, as for checked_span::at</remarks>
+		template<typename... M>
+		T& at(std::size_t index, M&&... m) const {
+			if (index >= count) {
+				return failIndexOutOfBounds<T, PassArg<M>...>(index, count, m...);
+			}
+			return start[index * step];
+		}
+
+		constexpr std::size_t size() const noexcept {
+			return count;
+		}
+		constexpr std::size_t stride() const noexcept {
+			return step;
+		}
+		constexpr bool empty() const noexcept {
+			return count == 0;
+		}
+
+	private:
+		T* start;
+		std::size_t count;
+		std::size_t step;
+	};
+
+	/// <summary>
+	/// A checked_span whose operator[] checks its index as well, while isActive(Level::debug), as do its windows and strides
+	/// </summary>
+	template<typename T>
+	using debug_checked_span = checked_span<T, true>;
+
+	/// <summary>
+	/// A checked_stride whose operator[] checks its index as well, while isActive(Level::debug)
+	/// </summary>
+	template<typename T>
+	using debug_checked_stride = checked_stride<T, true>;
+
+	// ******************************************************************************************************************
+	// * ---------------------------------------------- checkNotNull -------------------------------------------------- *
+	// ******************************************************************************************************************
+
+	/// <summary>
+	/// Raises a logic_error if the pointer is null (i.e. 0)
+	/// </summary>
+	/// <param name="pointer">a pointer to check for nullness</param>
+	/// <exception cref="logic_error">message will be 'Null pointer'</exception>
+	constexpr void checkNotNull(const void* pointer) {
+		if (pointer == nullptr) {
+			failWithMessage(FailureKind::nullPointer, defaultNullPointerMessage);
+		}
+	}
+
+	/// <summary>
+	/// Raises a logic_error if the pointer is null (i.e. 0)
+	/// </summary>
+	/// <param name="pointer">a pointer to check for nullness</param>
+	/// <param name="message">message to use in the exception</param>
+	/// <exception cref="logic_error"></exception>
+	constexpr void checkNotNull(const void* pointer, const char* message) {
+		if (pointer == nullptr) {
+			failWithMessage(FailureKind::nullPointer, message);
+		}
+	}
+
+	/// <summary>
+	/// Raises a logic_error if the pointer is null (i.e. 0)
+	/// </summary>
+	/// <param name="pointer">a pointer to check for nullness</param>
+	/// <param name="m">Optional strings or primitives, as many as needed</param>
+	/// <exception cref="logic_error"></exception>
+	template<typename... M>
+	constexpr void checkNotNull(const void* pointer, M&&... m) {
+		if (pointer == nullptr) {
+			failWithArgs<PassArg<M>...>(FailureKind::nullPointer, m...);
+		}
+	}
+
+	/// <summary>
+	/// Raises a logic_error if the pointer is null (i.e. 0)
+	/// </summary>
+	/// <param name="pointer">a pointer to check for nullness</param>
+	/// <param name="messageFunc">Example: [=](Integrity::out out) { out &lt;&lt; whateverYouWant; }</param>
+	/// <exception cref="logic_error"></exception>
+	/// <remarks>
+	/// This function exists so that you can control the deferred message building by passing in a lambda function which is called if the condition fails.
+	/// </remarks>
+	inline void checkNotNullM(const void* pointer, const std::function<void(std::stringstream&)>& messageFunc) {
+		if (pointer == nullptr) {
+			failWithMessage(FailureKind::nullPointer, messageFunc);
+		}
+	}
+	template<typename F, typename = EnableIfMessageLambda<F>>
+	constexpr void checkNotNullM(const void* pointer, F&& messageFunc) {
+		if (pointer == nullptr) {
+			failWithLambda(FailureKind::nullPointer, messageFunc);
+		}
+	}
+
+	// ******************************************************************************************************************
+	// * ---------------------------------------- checkStringNotNullOrEmpty ------------------------------------------- *
+	// ******************************************************************************************************************
+
+	/// <summary>
+	/// Checks whether a string is null or zero length.
+	/// </summary>
+	/// <param name="s">The (wstring, std::string, u16string, u32string) to check for zero length.</param>
+	/// <exception cref="logic_error">Raised if s is empty</exception>
+	/// <remarks>
+	/// Note that an exception is only raised if the string has exactly zero length; a string with a single space (for example) would be fine
+	/// </remarks>
+	template<typename... M>
+	constexpr void checkStringNotNullOrEmpty(const char* s, M&&... m) {
+		// only the first character needs to be looked at to know whether the string is empty
+		if (s == nullptr || *s == '\0') {
+			failWithArgs<PassArg<M>...>(s == nullptr ? FailureKind::nullPointer : FailureKind::emptyString, m...);
+		}
+	}
+	template<typename... M>
+	constexpr void checkStringNotNullOrEmpty(char* s, M&&... m) {
+		if (s == nullptr || *s == '\0') {
+			failWithArgs<PassArg<M>...>(s == nullptr ? FailureKind::nullPointer : FailureKind::emptyString, m...);
+		}
+	}
+
+	template<typename S, typename... M>
+	constexpr void checkStringNotNullOrEmpty(const S& s, M&&... m) {
+		// If you get a compiler error like: left of .empty must have class/struct/union
+		// in the line below, then you have not passed a string as firt param to checkStringNotNullOrEmpty 
+		if (s.empty()) {
+			failWithArgs<PassArg<M>...>(FailureKind::emptyString, m...);
+		}
+	}
+
+	template<typename S, typename... M>
+	constexpr void checkStringNotNullOrEmpty(S* s, M&&... m) {
+		if (s == 0 || s->empty()) {
+			failWithArgs<PassArg<M>...>(s == 0 ? FailureKind::nullPointer : FailureKind::emptyString, m...);
+		}
+	}
+
+	inline void checkStringNotNullOrEmptyM(const char* s, const std::function<void(std::stringstream&)>& messageFunc) {
+		if (s == 0 || *s == '\0') {
+			failWithMessage(s == 0 ? FailureKind::nullPointer : FailureKind::emptyString, messageFunc);
+		}
+	}
+	template <typename S>
+	inline void checkStringNotNullOrEmptyM(const S& s, const std::function<void(std::stringstream&)>& messageFunc) {
+		if (s.empty()) {
+			failWithMessage(FailureKind::emptyString, messageFunc);
+		}
+	}
+	template <typename S>
+	inline void checkStringNotNullOrEmptyM(const S* s, const std::function<void(std::stringstream&)>& messageFunc) {
+		if (s == 0 || s->empty()) {
+			failWithMessage(s == 0 ? FailureKind::nullPointer : FailureKind::emptyString, messageFunc);
+		}
+	}
+
+	template<typename F, typename = EnableIfMessageLambda<F>>
+	constexpr void checkStringNotNullOrEmptyM(const char* s, F&& messageFunc) {
+		if (s == 0 || *s == '\0') {
+			failWithLambda(s == 0 ? FailureKind::nullPointer : FailureKind::emptyString, messageFunc);
+		}
+	}
+	template <typename S, typename F, typename = EnableIfMessageLambda<F>>
+	constexpr void checkStringNotNullOrEmptyM(const S& s, F&& messageFunc) {
 		if (s.empty()) {
-			throwWithMessage(defaultEmptyStringMessage, { toTypeValue(m1), toTypeValue(m2), toTypeValue(m3), toTypeValue(m4) });
+			failWithLambda(FailureKind::emptyString, messageFunc);
+		}
+	}
+	template <typename S, typename F, typename = EnableIfMessageLambda<F>>
+	constexpr void checkStringNotNullOrEmptyM(const S* s, F&& messageFunc) {
+		if (s == 0 || s->empty()) {
+			failWithLambda(s == 0 ? FailureKind::nullPointer : FailureKind::emptyString, messageFunc);
+		}
+	}
+
+	} // inline namespace INTEGRITY_POLICY_NAMESPACE
+
+	// ******************************************************************************************************************
+	// * ------------------------------------------------ tryCheck ---------------------------------------------------- *
+	// ******************************************************************************************************************
+
+	/// <summary>
+	/// What a tryCheck found: that the check passed, or the kind of failure and, from tryCheckAt, its call site.
+	/// It is trivially copyable and two words long, so it comes back in registers, and nothing is formatted unless
+	/// message() or raise() is called. The tryCheck functions never throw, so they can be used with -fno-exceptions.
+	/// </summary>
+	/// <example>
+	/// Integrity::Result result = Integrity::tryCheckNotNull(row);
+	/// if (!result) {
+	///     log(result.message("row {} of {}", i, table.name()));
+	///     return false;
+	/// }
+	/// </example>
+	class Result {
+	public:
+		constexpr Result() : failedSite(nullptr), failureKind(FailureKind::condition), failed(false) {
+		}
+		constexpr explicit Result(FailureKind kind, Site* site = nullptr) : failedSite(site), failureKind(kind), failed(true) {
+		}
+
+		constexpr bool ok() const {
+			return !failed;
+		}
+		constexpr explicit operator bool() const {
+			return !failed;
+		}
+		/// <summary>
+		/// What the check found, which is only meaningful if it failed
+		/// </summary>
+		constexpr FailureKind kind() const {
+			return failureKind;
+		}
+		/// <summary>
+		/// The call site of a failed tryCheckAt, or nullptr
+		/// </summary>
+		constexpr Site* site() const {
+			return failedSite;
+		}
+
+		/// <summary>
+		/// The message the check would have raised with these message args, built now
+		/// </summary>
+		template<typename... M> std::string message(const M&... m) const;
+
+	private:
+		Site* failedSite;
+		FailureKind failureKind;
+		bool failed;
+	};
+	static_assert(std::is_trivially_copyable<Result>::value, "Result has to stay trivially copyable");
+
+	/// <summary>
+	/// Checks whether a condition is true, returning a failed Result if not
+	/// </summary>
+	/// <example>if (!Integrity::tryCheck(count &lt;= capacity)) { return false; }</example>
+	constexpr Result tryCheck(bool condition) {
+		return condition ? Result() : Result(FailureKind::condition);
+	}
+	template<typename NONBOOL>
+	inline Result tryCheck(NONBOOL youNeedABoolHere) = delete;
+
+	INTEGRITY_COLD inline Result failedAt(SiteRef at) {
+		at.site.countFailure(at.function);
+		return Result(FailureKind::condition, &at.site);
+	}
+
+	/// <summary>
+	/// Checks whether a condition is true, returning a failed Result which points at the call site if not
+	/// </summary>
+	/// <example>Integrity::Result result = Integrity::tryCheckAt(INTEGRITY_SITE("balance {}"), balance &gt;= 0);</example>
+	/// <remarks>The failure is counted against the site straight away, whatever the failure policy, as it may never be raised</remarks>
+	inline Result tryCheckAt(SiteRef at, bool condition) {
+		return condition ? Result() : failedAt(at);
+	}
+	template<typename NONBOOL>
+	inline Result tryCheckAt(SiteRef at, NONBOOL youNeedABoolHere) = delete;
+
+	/// <summary>
+	/// Checks that a pointer is not null, returning a failed Result of kind nullPointer if it is
+	/// </summary>
+	constexpr Result tryCheckNotNull(const void* pointer) {
+		return pointer != nullptr ? Result() : Result(FailureKind::nullPointer);
+	}
+
+	/// <summary>
+	/// Checks that a number is not NaN or +/-Infinity, returning a failed Result of the kind it was if it is
+	/// </summary>
+	template<typename N>
+	constexpr Result tryCheckIsValidNumber(const N value) {
+		return isFiniteNumber(value) ? Result() : Result(invalidNumberKind(value));
+	}
+
+	/// <summary>
+	/// Checks that a string is neither null nor empty, returning a failed Result of kind nullPointer or emptyString if it is
+	/// </summary>
+	constexpr Result tryCheckStringNotNullOrEmpty(const char* s) {
+		return s == nullptr ? Result(FailureKind::nullPointer) : *s == '\0' ? Result(FailureKind::emptyString) : Result();
+	}
+	constexpr Result tryCheckStringNotNullOrEmpty(char* s) {
+		return tryCheckStringNotNullOrEmpty(static_cast<const char*>(s));
+	}
+	template<typename S>
+	constexpr Result tryCheckStringNotNullOrEmpty(const S& s) {
+		return s.empty() ? Result(FailureKind::emptyString) : Result();
+	}
+	template<typename S>
+	constexpr Result tryCheckStringNotNullOrEmpty(S* s) {
+		return s == nullptr ? Result(FailureKind::nullPointer) : s->empty() ? Result(FailureKind::emptyString) : Result();
+	}
+
+	inline namespace INTEGRITY_POLICY_NAMESPACE {
+
+	/// <summary>
+	/// Hands a failed Result to the failure policy, as the check it came from would have failed, and does nothing if it passed
+	/// </summary>
+	/// <param name="m">Optional strings or primitives, as many as needed</param>
+	/// <example>Integrity::raise(result, "row {} of {}", i, table.name());</example>
+	template<typename... M>
+	inline void raise(const Result& result, M&&... m) {
+		if (!result.ok()) {
+			failWithResult<PassArg<M>...>(result, m...);
+		}
+	}
+
+	} // inline namespace INTEGRITY_POLICY_NAMESPACE
+
+	// ******************************************************************************************************************
+	// * ------------------------------------------------ Collector --------------------------------------------------- *
+	// ******************************************************************************************************************
+
+#ifndef INTEGRITY_CAPTURED_ARGS
+#define INTEGRITY_CAPTURED_ARGS 8 // how many message args an integrity_error or an async failure record can keep, and a Collector makes room for
+#endif
+	// the most args an operation adds after the message args: its template and up to four operands,
+	// e.g. 'Window {} + {} x {} out of bounds for size {}'
+	static constexpr std::size_t maxOperationArgs = 5;
+
+	enum class ArgKind : unsigned char {
+		boolean,
+		character, // char and unsigned char
+		char16,
+		char32,
+		wideChar,
+		signedInteger,
+		unsignedInteger,
+		singleFloating, // float, kept as a double but written as the float it was
+		floating, // double and long double (which is kept as a double)
+		charStar,
+		string, // std::string, and wstring, u16string and u32string which are narrowed when captured
+	};
+
+	/// <summary>
+	/// A message argument kept as the value that was passed in, rather than as text, so that nothing is formatted until the message is needed
+	/// </summary>
+	struct CapturedArg {
+		struct Text {
+			std::uint32_t offset; // where the characters are in the text buffer they were copied into
+			std::uint32_t length;
+		};
+		ArgKind kind;
+		union {
+			bool boolean;
+			char32_t character;
+			long long signedInteger;
+			unsigned long long unsignedInteger;
+			double floating;
+			Text text;
+		};
+	};
+
+	/// <summary>
+	/// Captures message arguments as CapturedArgs, copying their text into a fixed size buffer and truncating what does not fit
+	/// </summary>
+	class ArgCapture {
+	public:
+		ArgCapture(char* buffer, std::size_t capacity, std::size_t used) : buffer(buffer), capacity(capacity), textUsed(used) {
+		}
+		std::size_t used() const {
+			return textUsed;
+		}
+
+		template<typename T> typename std::enable_if<std::is_arithmetic<T>::value, CapturedArg>::type arg(T value) {
+			CapturedArg arg;
+			if (std::is_floating_point<T>::value) {
+				arg.kind = std::is_same<T, float>::value ? ArgKind::singleFloating : ArgKind::floating;
+				arg.floating = (double) value;
+			}
+			else if (std::is_signed<T>::value) {
+				arg.kind = ArgKind::signedInteger;
+				arg.signedInteger = (long long) value;
+			}
+			else {
+				arg.kind = ArgKind::unsignedInteger;
+				arg.unsignedInteger = (unsigned long long) value;
+			}
+			return arg;
+		}
+		CapturedArg arg(bool value) {
+			CapturedArg arg;
+			arg.kind = ArgKind::boolean;
+			arg.boolean = value;
+			return arg;
+		}
+		CapturedArg arg(char value) {
+			return character(ArgKind::character, (unsigned char) value);
+		}
+		CapturedArg arg(unsigned char value) {
+			return character(ArgKind::character, value);
+		}
+		CapturedArg arg(char16_t value) {
+			return character(ArgKind::char16, value);
+		}
+		CapturedArg arg(char32_t value) {
+			return character(ArgKind::char32, value);
+		}
+		CapturedArg arg(wchar_t value) {
+			return character(ArgKind::wideChar, (char32_t) value);
+		}
+		CapturedArg arg(const char* value) {
+			return text(ArgKind::charStar, value, std::strlen(value));
+		}
+		CapturedArg arg(const std::string& value) {
+			return text(ArgKind::string, value.data(), value.length());
+		}
+		CapturedArg arg(const std::wstring& value) {
+			return wideText(value);
+		}
+		CapturedArg arg(const std::u16string& value) {
+			return wideText(value);
+		}
+		CapturedArg arg(const std::u32string& value) {
+			return wideText(value);
+		}
+		template<std::size_t Placeholders> CapturedArg arg(const Format<Placeholders>& format) {
+			return arg(format.text);
+		}
+
+		// also for a message which has already been built, e.g. by a lambda
+		CapturedArg text(ArgKind kind, const char* s, std::size_t length) {
+			std::size_t fits = length < capacity - textUsed ? length : capacity - textUsed;
+			if (fits > 0) {
+				std::memcpy(buffer + textUsed, s, fits);
+			}
+			return copied(kind, fits);
+		}
+
+	private:
+		CapturedArg character(ArgKind kind, char32_t value) {
+			CapturedArg arg;
+			arg.kind = kind;
+			arg.character = value;
+			return arg;
+		}
+		template<typename S> CapturedArg wideText(const S& s) {
+			// narrowed a character at a time, the same as toStdString does
+			std::size_t fits = s.length() < capacity - textUsed ? s.length() : capacity - textUsed;
+			for (std::size_t i = 0; i < fits; ++i) {
+				buffer[textUsed + i] = (char) s[i];
+			}
+			return copied(ArgKind::string, fits);
+		}
+		CapturedArg copied(ArgKind kind, std::size_t length) {
+			CapturedArg arg;
+			arg.kind = kind;
+			arg.text.offset = (std::uint32_t) textUsed;
+			arg.text.length = (std::uint32_t) length;
+			textUsed += length;
+			return arg;
+		}
+
+		char* buffer;
+		std::size_t capacity;
+		std::size_t textUsed;
+	};
+
+	/// <summary>
+	/// Captures the first limit message args into args, followed by the operation and its operands if operation is not nullptr,
+	/// and returns how many args that was. The operation's text is copied first, so that long message args cannot crowd it out.
+	/// </summary>
+	/// <param name="messageArgCount">set to how many of the args are message args</param>
+	template<typename... O, typename... M>
+	std::size_t captureFailureArgs(ArgCapture& capture, CapturedArg* args, std::size_t limit, std::size_t& messageArgCount,
+		const char* operation, const std::tuple<O...>& operands, const M&... m) {
+		static_assert(1 + sizeof...(O) <= maxOperationArgs, "More operands than a failure keeps");
+		CapturedArg operationArgs[1 + sizeof...(O)];
+		std::size_t operationCount = 0;
+		if (operation != nullptr) {
+			operationArgs[operationCount++] = capture.arg(operation);
+			applyOperands([&](const O&... o) { forEachArg([&](const auto& operand) { operationArgs[operationCount++] = capture.arg(operand); }, o...); }, operands);
+		}
+		std::size_t count = 0;
+		forEachArg([&](const auto& arg) {
+			if (count < limit) {
+				args[count++] = capture.arg(arg);
+			}
+			}, m...);
+		messageArgCount = count;
+		for (std::size_t i = 0; i < operationCount; ++i) {
+			args[count++] = operationArgs[i];
+		}
+		return count;
+	}
+
+	/// <summary>
+	/// Text written into a fixed size buffer, which is cut short rather than grown so that writing to it never allocates
+	/// </summary>
+	class FixedText {
+	public:
+		/// <param name="capacity">the size of the buffer, including the '\0' which always ends the text</param>
+		FixedText(char* buffer, std::size_t capacity) : buffer(buffer), capacity(capacity), written(0), cut(false) {
+			buffer[0] = '\0';
+		}
+		void append(const char* s, std::size_t length) {
+			if (length > capacity - 1 - written) {
+				length = capacity - 1 - written;
+				cut = true;
+			}
+			std::memcpy(buffer + written, s, length);
+			written += length;
+			buffer[written] = '\0';
+		}
+		std::size_t length() const {
+			return written;
+		}
+		bool truncated() const {
+			return cut;
+		}
+		// ends text which was cut short with ... so that it does not look complete
+		void markTruncation() {
+			if (cut && written >= 3) {
+				std::memcpy(buffer + written - 3, "...", 3);
+			}
+		}
+
+	private:
+		char* buffer;
+		std::size_t capacity;
+		std::size_t written;
+		bool cut;
+	};
+
+	/// <summary>
+	/// Appends the message a failure with these captured args would have thrown with, to anything with append(const char*, length)
+	/// such as a std::string or a FixedText. Built the same way as makeString, but from the captured values.
+	/// </summary>
+	/// <param name="text">the buffer the args' text was copied into</param>
+	template<typename Out>
+	void appendCapturedMessage(Out& out, const char* defaultMessage, const CapturedArg* args, std::size_t count, const char* text);
+
+	/// <summary>
+	/// As appendCapturedMessage, with " at index N" after the default message when a bulk check found the failure at index N
+	/// </summary>
+	template<typename Out>
+	void appendFailureMessage(Out& out, const char* defaultMessage, std::size_t index, const CapturedArg* args, std::size_t count, const char* text);
+
+	/// <summary>
+	/// As appendFailureMessage, where the args after the first messageArgCount are an operation and its operands, such as
+	/// 'Overflow in {} + {}', 3, 5, which are written in place of the default message, e.g. 'rows: Overflow in 3 + 5 at index 2'
+	/// </summary>
+	template<typename Out>
+	void appendFailureMessage(Out& out, const char* defaultMessage, std::size_t index, const CapturedArg* args, std::size_t messageArgCount,
+		std::size_t count, const char* text);
+
+	/// <summary>
+	/// The message a failure with these captured args would have thrown with
+	/// </summary>
+	/// <param name="text">the buffer the args' text was copied into</param>
+	inline std::string capturedMessage(const char* defaultMessage, const CapturedArg* args, std::size_t count, const char* text);
+
+	/// <summary>
+	/// Collects failures instead of throwing them, for validating a batch where unwinding for every bad row would cost more than the checks.
+	/// </summary>
+	/// <example>
+	/// Integrity::Collector collector(1000);
+	/// for (auto&amp; batch : batches) {
+	///     collector.clear();
+	///     {
+	///         Integrity::Collector::Scope scope(collector);
+	///         for (auto&amp; row : batch) {
+	///             Integrity::check(row.price > 0, "row {} has price {}", row.id, row.price);
+	///         }
+	///     }
+	///     collector.throwIfAny();
+	/// }
+	/// </example>
+	/// <remarks>
+	/// While a Scope is alive every failing check on that thread appends a compact record (the kind, the index and the
+	/// message args as they were passed in) to the collector, and returns instead of throwing. So code after a check has to
+	/// be able to cope with the check having failed. The records, args and copied string text are all kept in buffers which
+	/// are allocated once by the constructor; clear() empties them for the next batch without freeing them. Failures which
+	/// do not fit are counted in dropped() and strings which do not fit are truncated.
+	/// </remarks>
+	class Collector {
+	public:
+		struct Failure {
+			const char* defaultMessage;
+			std::uint32_t firstArg; // index of the first of this failure's args
+			std::uint32_t argCount;
+			// how many of the args are message args; any after them are an operation and its operands, e.g. 'Overflow in {} + {}', 3, 5
+			std::uint32_t messageArgCount;
+			FailureKind kind;
+			const Site* site; // where the check is, for failures from checkAt, else nullptr
+			std::size_t index; // where a bulk check found the failure, else noFailureIndex
+		};
+
+		/// <summary>
+		/// Makes failing checks on this thread go to the collector, for as long as the Scope is alive
+		/// </summary>
+		class Scope {
+		public:
+			explicit Scope(Collector& collector) : previous(active()) {
+				active() = &collector;
+			}
+			~Scope() {
+				active() = previous;
+			}
+			Scope(const Scope&) = delete;
+			Scope& operator=(const Scope&) = delete;
+		private:
+			Collector* previous;
+		};
+
+		/// <param name="maxFailures">how many failures can be recorded before they are only counted</param>
+		/// <param name="maxTextBytes">how much space there is for copies of string message args</param>
+		explicit Collector(std::size_t maxFailures = 1024, std::size_t maxTextBytes = 64 * 1024) : maxFailures(maxFailures), textUsed(0), droppedCount(0) {
+			failures.reserve(maxFailures);
+			args.reserve(maxFailures * maxArgsPerFailure);
+			text.resize(maxTextBytes);
+		}
+
+		std::size_t size() const {
+			return failures.size();
+		}
+		bool empty() const {
+			return failures.empty() && droppedCount == 0;
+		}
+		/// <summary>
+		/// How many failures there were after the collector was full
+		/// </summary>
+		std::size_t dropped() const {
+			return droppedCount;
+		}
+		const Failure& operator[](std::size_t i) const {
+			return failures[i];
+		}
+		const CapturedArg& arg(const Failure& failure, std::size_t i) const {
+			return args[failure.firstArg + i];
+		}
+
+		/// <summary>
+		/// The message the i'th failure would have thrown with
+		/// </summary>
+		inline std::string message(std::size_t i) const;
+
+		/// <summary>
+		/// Raises a logic_error if there were any failures, with the message of the first and how many more there were
+		/// </summary>
+		/// <remarks>Without exceptions the message goes to logHandler() and the program aborts</remarks>
+		inline void throwIfAny() const;
+
+		/// <summary>
+		/// Empties the collector for the next batch, keeping its buffers
+		/// </summary>
+		void clear() {
+			failures.clear();
+			args.clear();
+			textUsed = 0;
+			droppedCount = 0;
+		}
+
+		/// <summary>
+		/// The collector failing checks on this thread go to, or nullptr if they throw
+		/// </summary>
+		static Collector*& active() {
+			static thread_local Collector* collector = nullptr;
+			return collector;
+		}
+
+		// Called by the failing checks...
+
+		template<typename... M>
+		void add(const Site* site, FailureKind kind, std::size_t index, const M&... m) {
+			if (startFailure(kind, site, index)) {
+				captureArgs(m...);
+				failures.back().messageArgCount = failures.back().argCount;
+			}
+		}
+		// for a failure whose message is an operation on its operands, e.g. 'rows: Overflow in 3 + 5 at index 2'
+		template<typename... O, typename... M>
+		void addOperation(FailureKind kind, std::size_t index, const char* operation, const std::tuple<O...>& operands, const M&... m) {
+			if (startFailure(kind, nullptr, index)) {
+				captureArgs(m...);
+				failures.back().messageArgCount = failures.back().argCount;
+				captureArgs(operation);
+				applyOperands([&](const O&... o) { captureArgs(o...); }, operands);
+			}
+		}
+		// for failures whose message has already been built, e.g. by a lambda. The text is copied, so it need not outlive the call.
+		void addMessage(FailureKind kind, const std::string& message) {
+			addMessage(kind, message.data(), message.length());
+		}
+		void addMessage(FailureKind kind, const char* message) {
+			// the default message is a literal, so there is no need to copy it
+			if (message == defaultMessageFor(kind)) {
+				startFailure(kind, nullptr, noFailureIndex);
+				return;
+			}
+			addMessage(kind, message, std::strlen(message));
+		}
+		void addMessage(FailureKind kind, const char* message, std::size_t length) {
+			if (startFailure(kind, nullptr, noFailureIndex)) {
+				ArgCapture capture(text.data(), text.size(), textUsed);
+				addArg(capture.text(ArgKind::charStar, message, length));
+				textUsed = capture.used();
+				failures.back().messageArgCount = 1;
+			}
+		}
+
+	private:
+		// as many message args as an integrity_error keeps, and for an operation its template and operands
+		static const std::size_t maxArgsPerFailure = INTEGRITY_CAPTURED_ARGS + maxOperationArgs;
+
+		bool startFailure(FailureKind kind, const Site* site, std::size_t index) {
+			if (failures.size() == maxFailures) {
+				++droppedCount;
+				return false;
+			}
+			failures.push_back(Failure{ defaultMessageFor(kind), (std::uint32_t) args.size(), 0, 0, kind, site, index });
+			return true;
+		}
+		template<typename... M>
+		void captureArgs(const M&... m) {
+			ArgCapture capture(text.data(), text.size(), textUsed);
+			forEachArg([&](const auto& arg) { addArg(capture.arg(arg)); }, m...);
+			textUsed = capture.used();
+		}
+		void addArg(const CapturedArg& arg) {
+			args.push_back(arg);
+			++failures.back().argCount;
+		}
+
+		std::size_t maxFailures;
+		std::vector<Failure> failures;
+		std::vector<CapturedArg> args;
+		std::vector<char> text;
+		std::size_t textUsed;
+		std::size_t droppedCount;
+	};
+
+	// ******************************************************************************************************************
+	// * --------------------------------------------- integrity_error ------------------------------------------------ *
+	// ******************************************************************************************************************
+
+#ifndef INTEGRITY_ERROR_TEXT_BYTES
+#define INTEGRITY_ERROR_TEXT_BYTES 256 // room in an integrity_error for copies of string args
+#endif
+#ifndef INTEGRITY_ERROR_MESSAGE_BYTES
+#define INTEGRITY_ERROR_MESSAGE_BYTES 256 // room in an integrity_error for its message, which is cut short with ... beyond that
+#endif
+
+	/// <summary>
+	/// Appends the message for more message args than an integrity_error or a FailureRecord keeps, capturing them all on the
+	/// stack, along with the operation and its operands if operation is not nullptr
+	/// </summary>
+	template<typename... O, typename... M>
+	void appendArgsMessage(FixedText& out, const char* defaultMessage, std::size_t index, const char* operation, const std::tuple<O...>& operands, const M&... m) {
+		CapturedArg args[sizeof...(M) + 1 + sizeof...(O)];
+		char text[INTEGRITY_ERROR_TEXT_BYTES];
+		ArgCapture capture(text, sizeof(text), 0);
+		std::size_t messageArgCount;
+		std::size_t count = captureFailureArgs(capture, args, sizeof...(M), messageArgCount, operation, operands, m...);
+		appendFailureMessage(out, defaultMessage, index, args, messageArgCount, count, text);
+	}
+
+	/// <summary>
+	/// The exception a failing check throws. It is a std::logic_error, so catching logic_error still works.
+	/// </summary>
+	/// <remarks>
+	/// Everything is kept in fixed size buffers inside the exception, so neither throwing it nor calling what() allocates
+	/// (only the exception object itself is allocated, by the C++ runtime, which has an emergency pool for when memory runs out).
+	/// The message args are kept as the values that were passed in and the message is only built the first time what()
+	/// is called, so a failure which is caught and handled without looking at its message never pays for formatting it.
+	/// A handler can look at kind(), file(), line(), index() and the args rather than parsing the message.
+	/// Strings longer than the buffers are truncated. Only the first INTEGRITY_CAPTURED_ARGS message args are kept; a failure
+	/// with more than that has its message built when it is thrown instead, from all of them.
+	/// A failed operation such as checkedAdd keeps its template and operands as the args after the message args, e.g.
+	/// "Overflow in {} + {}", 3, 5 for 'Overflow in 3 + 5', so that a handler can read them too.
+	/// what() can be called on the same exception from several threads, e.g. one rethrown from a shared std::exception_ptr:
+	/// the first call builds the message and any others wait for it.
+	/// </remarks>
+	class integrity_error : public std::logic_error {
+	public:
+		template<typename... M>
+		integrity_error(const Site* site, FailureKind kind, const char* defaultMessage, std::size_t index, const M&... m)
+			: integrity_error(Captured(), site, kind, defaultMessage, index, nullptr, std::tuple<>(), m...) {
+		}
+		// for a failed operation, e.g. 'rows: Overflow in 3 + 5 at index 2' from "Overflow in {} + {}", (3, 5) and "rows"
+		template<typename... O, typename... M>
+		integrity_error(FailureKind kind, std::size_t index, const char* operation, const std::tuple<O...>& operands, const M&... m)
+			: integrity_error(Captured(), nullptr, kind, defaultMessageFor(kind), index, operation, operands, m...) {
+		}
+		integrity_error(FailureKind kind, const char* message) : integrity_error(kind, message, std::strlen(message)) {
+		}
+		integrity_error(FailureKind kind, const std::string& message) : integrity_error(kind, message.data(), message.length()) {
+		}
+		explicit integrity_error(const char* message) : integrity_error(FailureKind::condition, message) {
+		}
+		explicit integrity_error(const std::string& message) : integrity_error(FailureKind::condition, message) {
+		}
+
+		integrity_error(const integrity_error& other) noexcept : std::logic_error(other), formatState(unformatted) {
+			copyFrom(other);
+		}
+		integrity_error& operator=(const integrity_error& other) noexcept {
+			std::logic_error::operator=(other);
+			copyFrom(other);
+			return *this;
+		}
+
+		const char* what() const noexcept override {
+			if (formatState.load(std::memory_order_acquire) != formatted) {
+				format();
+			}
+			return message;
+		}
+
+		FailureKind kind() const {
+			return failureKind;
+		}
+		/// <summary>
+		/// The call site of the check, if it was a checkAt, else nullptr
+		/// </summary>
+		const Site* site() const {
+			return failureSite;
+		}
+		/// <summary>
+		/// The file of the check, or nullptr if it was not made at a call site
+		/// </summary>
+		const char* file() const {
+			return failureSite != nullptr ? failureSite->file : nullptr;
+		}
+		/// <summary>
+		/// The line of the check, or 0 if it was not made at a call site
+		/// </summary>
+		int line() const {
+			return failureSite != nullptr ? failureSite->line : 0;
+		}
+		/// <summary>
+		/// Where one of the bulk checks found the failure, else noFailureIndex
+		/// </summary>
+		std::size_t index() const {
+			return failureIndex;
+		}
+		const char* defaultMessage() const {
+			return defaultText;
+		}
+		std::size_t argCount() const {
+			return argTotal;
+		}
+		/// <summary>
+		/// How many of the args are message args, rather than the operation and its operands which follow them
+		/// </summary>
+		std::size_t messageArgCount() const {
+			return messageArgTotal;
+		}
+		const CapturedArg& arg(std::size_t i) const {
+			return args[i];
+		}
+		/// <summary>
+		/// The text of a string arg, which is not '\0' terminated
+		/// </summary>
+		const char* argData(std::size_t i) const {
+			return text + args[i].text.offset;
+		}
+		/// <summary>
+		/// The text of a string arg
+		/// </summary>
+		std::string argText(std::size_t i) const {
+			return std::string(argData(i), args[i].text.length);
+		}
+
+	private:
+		struct Captured {};
+		template<typename... O, typename... M>
+		integrity_error(Captured, const Site* site, FailureKind kind, const char* defaultMessage, std::size_t index, const char* operation, const std::tuple<O...>& operands, const M&... m)
+			: std::logic_error(""), failureSite(site), defaultText(defaultMessage), failureIndex(index), failureKind(kind), formatState(unformatted) {
+			ArgCapture capture(text, sizeof(text), 0);
+			std::size_t messageArgs;
+			argTotal = (unsigned char) captureFailureArgs(capture, args, INTEGRITY_CAPTURED_ARGS, messageArgs, operation, operands, m...);
+			messageArgTotal = (unsigned char) messageArgs;
+			formatArgsNotKept(std::integral_constant<bool, (sizeof...(M) > INTEGRITY_CAPTURED_ARGS)>(), operation, operands, m...);
+		}
+		// a message which has already been built, e.g. by a lambda, is kept as it is for what() to return
+		integrity_error(FailureKind kind, const char* built, std::size_t length)
+			: std::logic_error(""), failureSite(nullptr), defaultText(defaultMessageFor(kind)), failureIndex(noFailureIndex), failureKind(kind), argTotal(0), messageArgTotal(0), formatState(formatted) {
+			FixedText out(message, sizeof(message));
+			out.append(built, length);
+			out.markTruncation();
+		}
+
+		static constexpr unsigned char unformatted = 0;
+		static constexpr unsigned char formatting = 1;
+		static constexpr unsigned char formatted = 2;
+
+		// with more message args than are kept, the message is built now, while they can all still be seen
+		template<typename... O, typename... M>
+		void formatArgsNotKept(std::true_type, const char* operation, const std::tuple<O...>& operands, const M&... m) {
+			FixedText out(message, sizeof(message));
+			appendArgsMessage(out, defaultText, failureIndex, operation, operands, m...);
+			out.markTruncation();
+			formatState.store(formatted, std::memory_order_relaxed);
+		}
+		template<typename... O, typename... M>
+		void formatArgsNotKept(std::false_type, const char*, const std::tuple<O...>&, const M&...) {
+		}
+
+		// the first thread to get here builds the message, and any others wait until it has been published
+		void format() const noexcept {
+			unsigned char expected = unformatted;
+			if (formatState.compare_exchange_strong(expected, formatting, std::memory_order_acquire)) {
+				FixedText out(message, sizeof(message));
+				appendFailureMessage(out, defaultText, failureIndex, args, messageArgTotal, argTotal, text);
+				out.markTruncation();
+				formatState.store(formatted, std::memory_order_release);
+				return;
+			}
+			while (formatState.load(std::memory_order_acquire) != formatted) {
+				std::this_thread::yield();
+			}
+		}
+
+		void copyFrom(const integrity_error& other) noexcept {
+			failureSite = other.failureSite;
+			defaultText = other.defaultText;
+			failureIndex = other.failureIndex;
+			failureKind = other.failureKind;
+			argTotal = other.argTotal;
+			messageArgTotal = other.messageArgTotal;
+			std::memcpy(args, other.args, sizeof(args));
+			std::memcpy(text, other.text, sizeof(text));
+			// a message still being built by another thread is left for this copy to build for itself
+			if (other.formatState.load(std::memory_order_acquire) == formatted) {
+				std::memcpy(message, other.message, sizeof(message));
+				formatState.store(formatted, std::memory_order_relaxed);
+			}
+			else {
+				formatState.store(unformatted, std::memory_order_relaxed);
+			}
+		}
+
+		const Site* failureSite;
+		const char* defaultText;
+		std::size_t failureIndex;
+		FailureKind failureKind;
+		unsigned char argTotal;
+		unsigned char messageArgTotal;
+		mutable std::atomic<unsigned char> formatState;
+		CapturedArg args[INTEGRITY_CAPTURED_ARGS + maxOperationArgs];
+		char text[INTEGRITY_ERROR_TEXT_BYTES];
+		mutable char message[INTEGRITY_ERROR_MESSAGE_BYTES];
+	};
+
+	// ******************************************************************************************************************
+	// * ----------------------------------------------- async sink --------------------------------------------------- *
+	// ******************************************************************************************************************
+
+#ifndef INTEGRITY_ASYNC_CAPACITY
+#define INTEGRITY_ASYNC_CAPACITY 4096 // how many failure records the async sink can hold before it drops or blocks
+#endif
+#ifndef INTEGRITY_RECORD_TEXT_BYTES
+#define INTEGRITY_RECORD_TEXT_BYTES 128 // room in each failure record for copies of string args
+#endif
+
+	/// <summary>
+	/// A bounded lock-free queue which any number of threads can push to and one thread pops from
+	/// </summary>
+	/// <remarks>
+	/// Each slot has a sequence number saying whether it is free for the push at a given position or holds the value for
+	/// the pop at it (after Dmitry Vyukov's bounded queue). A push claims a position with a compare and swap, fills the
+	/// slot in place and then publishes it by moving the sequence number on, so producers only ever retry a failed claim.
+	/// </remarks>
+	template<typename T> class MpscRing {
+	public:
+		explicit MpscRing(std::size_t minimumCapacity) : capacity(roundUpToPowerOf2(minimumCapacity)), cells(new Cell[capacity]), pushPosition(0), popPosition(0) {
+			for (std::size_t i = 0; i < capacity; ++i) {
+				cells[i].sequence.store(i, std::memory_order_relaxed);
+			}
+		}
+
+		/// <summary>
+		/// Calls fill with the slot to fill in, unless the ring is full
+		/// </summary>
+		template<typename F> bool tryPush(F&& fill) {
+			std::size_t position = pushPosition.load(std::memory_order_relaxed);
+			Cell* cell;
+			for (;;) {
+				cell = &cells[position & (capacity - 1)];
+				std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+				std::ptrdiff_t difference = (std::ptrdiff_t) sequence - (std::ptrdiff_t) position;
+				if (difference == 0) {
+					if (pushPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+						break;
+					}
+				}
+				else if (difference < 0) {
+					return false;
+				}
+				else {
+					position = pushPosition.load(std::memory_order_relaxed);
+				}
+			}
+			fill(cell->value);
+			cell->sequence.store(position + 1, std::memory_order_release);
+			return true;
+		}
+
+		/// <summary>
+		/// Calls consume with the oldest value, unless the ring is empty. Only one thread may pop.
+		/// </summary>
+		template<typename F> bool tryPop(F&& consume) {
+			std::size_t position = popPosition.load(std::memory_order_relaxed);
+			Cell& cell = cells[position & (capacity - 1)];
+			if (cell.sequence.load(std::memory_order_acquire) != position + 1) {
+				return false;
+			}
+			consume(cell.value);
+			cell.sequence.store(position + capacity, std::memory_order_release);
+			popPosition.store(position + 1, std::memory_order_release);
+			return true;
+		}
+
+		/// <summary>
+		/// How many pushes have claimed a slot so far
+		/// </summary>
+		std::size_t pushed() const {
+			return pushPosition.load(std::memory_order_acquire);
+		}
+		std::size_t popped() const {
+			return popPosition.load(std::memory_order_acquire);
+		}
+
+	private:
+		struct Cell {
+			std::atomic<std::size_t> sequence;
+			T value;
+		};
+
+		static std::size_t roundUpToPowerOf2(std::size_t n) {
+			std::size_t power = 2;
+			while (power < n) {
+				power *= 2;
+			}
+			return power;
+		}
+
+		const std::size_t capacity;
+		std::unique_ptr<Cell[]> cells;
+		// on cache lines of their own, as the producers all hammer the one and the consumer the other
+		alignas(64) std::atomic<std::size_t> pushPosition;
+		alignas(64) std::atomic<std::size_t> popPosition;
+	};
+
+	/// <summary>
+	/// A failure as the async sink queues it: where and when, and the message args as they were passed in
+	/// </summary>
+	struct FailureRecord {
+		const Site* site; // nullptr unless the failure came from checkAt
+		const char* defaultMessage;
+		std::size_t index; // where a bulk check found the failure, else noFailureIndex
+		std::uint64_t milliseconds; // since the epoch
+		std::uint64_t thread;
+		std::uint32_t argCount;
+		std::uint32_t messageArgCount; // the args after these are an operation and its operands
+		CapturedArg args[INTEGRITY_CAPTURED_ARGS + maxOperationArgs];
+		char text[INTEGRITY_RECORD_TEXT_BYTES];
+	};
+
+	/// <summary>
+	/// Writes failures to a file descriptor from a background thread, so that a failing check does not wait for formatting or I/O
+	/// </summary>
+	/// <remarks>
+	/// A failing check only fills in a FailureRecord in a lock-free ring. The writer thread formats the records the same
+	/// way the exceptions would be and writes them out in batches, one line each:
+	///     milliseconds-since-epoch thread-id file:line message
+	/// When the ring is full a failure is either dropped and counted (the default) or waits for room. The sink is flushed
+	/// and its thread stopped when it is destroyed, which for asyncSink() is at exit.
+	/// </remarks>
+	class AsyncSink {
+	public:
+		enum class Overflow {
+			drop,
+			block,
+		};
+
+		explicit AsyncSink(std::size_t capacity = INTEGRITY_ASYNC_CAPACITY, int fileDescriptor = 2) : ring(capacity), descriptor(fileDescriptor), overflowPolicy(Overflow::drop),
+			droppedCount(0), writtenCount(0), stopping(false), writer(&AsyncSink::writeLoop, this) {
+		}
+		~AsyncSink() {
+			stopping.store(true, std::memory_order_release);
+			writer.join();
+		}
+		AsyncSink(const AsyncSink&) = delete;
+		AsyncSink& operator=(const AsyncSink&) = delete;
+
+		void setFileDescriptor(int fileDescriptor) {
+			descriptor.store(fileDescriptor, std::memory_order_relaxed);
+		}
+		void setOverflow(Overflow overflow) {
+			overflowPolicy.store(overflow, std::memory_order_relaxed);
+		}
+		/// <summary>
+		/// How many failures were dropped because the ring was full
+		/// </summary>
+		unsigned long long dropped() const {
+			return droppedCount.load(std::memory_order_relaxed);
+		}
+
+		/// <summary>
+		/// Waits until every failure queued before the call has been written
+		/// </summary>
+		void flush() {
+			std::size_t queued = ring.pushed();
+			while (writtenCount.load(std::memory_order_acquire) < queued) {
+				std::this_thread::yield();
+			}
+		}
+
+		template<typename... M>
+		void push(const Site* site, const char* defaultMessage, const M&... m) {
+			push(site, defaultMessage, noFailureIndex, m...);
+		}
+		// for a failure which one of the bulk checks found at index
+		template<typename... M>
+		void push(const Site* site, const char* defaultMessage, std::size_t index, const M&... m) {
+			pushArgs(std::integral_constant<bool, (sizeof...(M) > INTEGRITY_CAPTURED_ARGS)>(), site, defaultMessage, index, nullptr, std::tuple<>(), m...);
+		}
+		// for a failed operation, e.g. 'rows: Overflow in 3 + 5' from "Overflow in {} + {}", (3, 5) and "rows"
+		template<typename... O, typename... M>
+		void pushOperation(const char* defaultMessage, std::size_t index, const char* operation, const std::tuple<O...>& operands, const M&... m) {
+			pushArgs(std::integral_constant<bool, (sizeof...(M) > INTEGRITY_CAPTURED_ARGS)>(), nullptr, defaultMessage, index, operation, operands, m...);
+		}
+		// for failures whose message has already been built, e.g. by a lambda
+		void pushMessage(const Site* site, const std::string& message) {
+			pushMessage(site, message.data(), message.length());
+		}
+		void pushMessage(const Site* site, const char* message) {
+			pushMessage(site, message, std::strlen(message));
+		}
+		void pushMessage(const Site* site, const char* message, std::size_t length) {
+			std::uint64_t milliseconds = now();
+			std::uint64_t thread = threadId();
+			enqueue([&](FailureRecord& record) {
+				record.site = site;
+				record.defaultMessage = defaultExceptionMessage;
+				record.index = noFailureIndex;
+				record.milliseconds = milliseconds;
+				record.thread = thread;
+				ArgCapture capture(record.text, sizeof(record.text), 0);
+				record.args[0] = capture.text(ArgKind::charStar, message, length);
+				record.argCount = 1;
+				record.messageArgCount = 1;
+				});
+		}
+
+	private:
+		template<typename... O, typename... M>
+		void pushArgs(std::false_type, const Site* site, const char* defaultMessage, std::size_t index, const char* operation, const std::tuple<O...>& operands, const M&... m) {
+			std::uint64_t milliseconds = now();
+			std::uint64_t thread = threadId();
+			enqueue([&](FailureRecord& record) {
+				record.site = site;
+				record.defaultMessage = defaultMessage;
+				record.index = index;
+				record.milliseconds = milliseconds;
+				record.thread = thread;
+				ArgCapture capture(record.text, sizeof(record.text), 0);
+				std::size_t messageArgs;
+				record.argCount = (std::uint32_t) captureFailureArgs(capture, record.args, INTEGRITY_CAPTURED_ARGS, messageArgs, operation, operands, m...);
+				record.messageArgCount = (std::uint32_t) messageArgs;
+				});
+		}
+		// with more message args than a record keeps, this one failure is formatted on the calling thread, and cut to fit the
+		// record's text
+		template<typename... O, typename... M>
+		void pushArgs(std::true_type, const Site* site, const char* defaultMessage, std::size_t index, const char* operation, const std::tuple<O...>& operands, const M&... m) {
+			char built[INTEGRITY_ERROR_MESSAGE_BYTES];
+			FixedText out(built, sizeof(built));
+			appendArgsMessage(out, defaultMessage, index, operation, operands, m...);
+			pushMessage(site, built, out.length());
+		}
+		template<typename F> void enqueue(F&& fill) {
+			while (!ring.tryPush(fill)) {
+				if (overflowPolicy.load(std::memory_order_relaxed) == Overflow::drop) {
+					droppedCount.fetch_add(1, std::memory_order_relaxed);
+					return;
+				}
+				std::this_thread::yield();
+			}
+		}
+		static std::uint64_t now() {
+			return (std::uint64_t) std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		}
+		static std::uint64_t threadId() {
+			static thread_local std::uint64_t id = 0;
+			if (id == 0) {
+				id = (std::uint64_t) std::hash<std::thread::id>()(std::this_thread::get_id());
+			}
+			return id;
+		}
+
+		inline void writeLoop();
+
+		MpscRing<FailureRecord> ring;
+		std::atomic<int> descriptor;
+		std::atomic<Overflow> overflowPolicy;
+		std::atomic<unsigned long long> droppedCount;
+		std::atomic<std::size_t> writtenCount;
+		std::atomic<bool> stopping;
+		std::thread writer;
+	};
+
+	/// <summary>
+	/// The sink INTEGRITY_ASYNC sends failures to. It writes to stderr unless given another file descriptor.
+	/// </summary>
+	/// <example>
+	/// Integrity::asyncSink().setFileDescriptor(logFd);
+	/// Integrity::asyncSink().setOverflow(Integrity::AsyncSink::Overflow::block);
+	/// </example>
+	inline AsyncSink& asyncSink() {
+		static AsyncSink sink;
+		return sink;
+	}
+
+	// "private" functions... -----------------------------------------------------------------------------------------------
+
+	enum class DispType {
+		isBool,
+		isString, // std::string, std::wstring, std::u16string, std::u32string
+		isCharStar,
+		isNumber, // short, int, long, long long & unsigned variants, and float, double and long double
+		isChar,
+	};
+	struct TypeValue {
+		DispType type;
+		std::string value;
+		TypeValue(DispType theType, const std::string& theValue) {
+			type = theType;
+			value = theValue;
+		}
+		std::string representationImplyingType() const {
+			std::string representation;
+			appendRepresentationImplyingType(representation);
+			return representation;
+		}
+		// the character put either side of the value to imply its type, or 0 if the value is shown as is
+		char quote() const {
+			switch (this->type) {
+			case DispType::isChar:
+				return '\''; // use ' to imply char
+			case DispType::isString:
+				return '"'; // use " to imply string
+			case DispType::isCharStar:
+				return '`'; // use ` (backtick) to imply char*
+			default:
+				return 0; // bools are True or False, ints, longs, floats etc. are all just represented as their value
+			}
+		}
+		std::size_t representationLength() const {
+			return this->value.length() + (quote() != 0 ? 2 : 0);
+		}
+		void appendRepresentationImplyingType(std::string& out) const {
+			char q = quote();
+			if (q != 0) {
+				out += q;
+			}
+			out += this->value;
+			if (q != 0) {
+				out += q;
+			}
+		}
+	};
+
+	/*
+	* The first message argument is the template: a char* is used as is and anything else is shown with quotes
+	* implying its type. Each {} in the template is replaced by the raw value of the next argument and once the
+	* {}s run out the remaining arguments are appended with ", " between them, showing their type.
+	* The message is built in two linear passes, the first works out its length so the second fills a string
+	* that never has to grow.
+	*/
+	static std::string makeString(const char* defaultMessage, const TypeValue* items, std::size_t count) {
+		std::size_t first = 0;
+		// skip an empty char*, which would not show up in the message anyway
+		while (first < count && items[first].type == DispType::isCharStar && items[first].value.empty()) {
+			++first;
+		}
+		if (first == count) {
+			return defaultMessage;
+		}
+
+		const TypeValue& templateItem = items[first];
+		const std::string& templateText = templateItem.value;
+		const char quote = templateItem.type == DispType::isCharStar ? 0 : templateItem.quote();
+
+		std::size_t length = templateText.length() + (quote != 0 ? 2 : 0);
+		std::size_t searchFrom = 0;
+		for (std::size_t i = first + 1; i < count; ++i) {
+			const TypeValue& item = items[i];
+			std::size_t braces = searchFrom == std::string::npos ? std::string::npos : templateText.find("{}", searchFrom);
+			if (braces != std::string::npos) {
+				length += item.value.length() - 2;
+				searchFrom = braces + 2;
+			}
+			else {
+				length += 2 + item.representationLength();
+				searchFrom = std::string::npos;
+			}
+		}
+
+		std::string retString;
+		retString.reserve(length);
+		if (quote != 0) {
+			retString += quote;
+		}
+		std::size_t copiedTo = 0;
+		bool appending = false;
+		for (std::size_t i = first + 1; i < count; ++i) {
+			const TypeValue& item = items[i];
+			std::size_t braces = appending ? std::string::npos : templateText.find("{}", copiedTo);
+			if (braces != std::string::npos) {
+				retString.append(templateText, copiedTo, braces - copiedTo);
+				retString += item.value;
+				copiedTo = braces + 2;
+				continue;
+			}
+			if (!appending) {
+				retString.append(templateText, copiedTo, std::string::npos);
+				if (quote != 0) {
+					retString += quote;
+				}
+				appending = true;
+			}
+			retString += ", ";
+			item.appendRepresentationImplyingType(retString);
+		}
+		if (!appending) {
+			retString.append(templateText, copiedTo, std::string::npos);
+			if (quote != 0) {
+				retString += quote;
+			}
+		}
+		return retString;
+	}
+
+	template<std::size_t Placeholders>
+	static std::string makeString(const Format<Placeholders>& format, const TypeValue* items) {
+		std::size_t length = format.literalLength;
+		for (std::size_t i = 0; i < Placeholders; ++i) {
+			length += items[i].value.length();
+		}
+
+		std::string retString;
+		retString.reserve(length);
+		std::size_t segment = 0;
+		for (std::size_t i = 0; i < Placeholders; ++i) {
+			const TypeValue& item = items[i];
+			retString.append(format.text + format.segments[segment].offset, format.segments[segment].length);
+			retString += item.value;
+			++segment;
+		}
+		retString.append(format.text + format.segments[segment].offset, format.segments[segment].length);
+		return retString;
+	}
+
+	template<typename F> static std::string makeStringFromLambda(F& messageFunc) {
+#if INTEGRITY_EXCEPTIONS
+		try {
+#endif
+			std::stringstream ss;
+
+			messageFunc(ss);
+
+			return ss.str();
+#if INTEGRITY_EXCEPTIONS
+		}
+		catch (...) {
+			return std::string(defaultExceptionMessage) + ": [error]";
+		}
+#endif
+	}
+	// a lambda taking an Integrity::out writes straight into the Writer, one written for a std::stringstream& gets one as before
+	template<typename F> const char* writeMessage(Writer& writer, F& messageFunc, std::true_type) {
+#if INTEGRITY_EXCEPTIONS
+		try {
+			messageFunc(writer);
+		}
+		catch (...) {
+			writer.clear();
+			writer << defaultExceptionMessage << ": [error]";
+		}
+#else
+		messageFunc(writer);
+#endif
+		return writer.c_str();
+	}
+	template<typename F> const char* writeMessage(Writer& writer, F& messageFunc, std::false_type) {
+		writer << makeStringFromLambda(messageFunc);
+		return writer.c_str();
+	}
+	static std::string makeString(const std::function<void(std::stringstream&)>& messageFunc) {
+		if (messageFunc == nullptr) {
+			return defaultExceptionMessage;
+		}
+		return makeStringFromLambda(messageFunc);
+	}
+
+	template<typename T> inline TypeValue toTypeValue(T primitive) {
+		char digits[numberTextSize];
+		return TypeValue(DispType::isNumber, std::string(digits, formatNumber(digits, primitive)));
+	}
+	template<> inline TypeValue toTypeValue<bool>(const bool value) {
+		return TypeValue(DispType::isBool, value ? "True" : "False");
+	}
+	template<> inline TypeValue toTypeValue<char>(const char value) {
+		return TypeValue(DispType::isChar, std::string(1, value));
+	}
+	template<> inline TypeValue toTypeValue<unsigned char>(const unsigned char value) {
+		return TypeValue(DispType::isChar, std::string(1, value));
+	}
+	template<> inline TypeValue toTypeValue<char16_t>(const char16_t value) {
+		char digits[numberTextSize];
+		return TypeValue(DispType::isChar, std::string(digits, formatWideChar(digits, (char32_t) value, 2 * sizeof(char16_t))));
+	}
+	template<> inline TypeValue toTypeValue<char32_t>(const char32_t value) {
+		char digits[numberTextSize];
+		return TypeValue(DispType::isChar, std::string(digits, formatWideChar(digits, (char32_t) value, 2 * sizeof(char32_t))));
+	}
+	template<> inline TypeValue toTypeValue<wchar_t>(const wchar_t value) {
+		char digits[numberTextSize];
+		return TypeValue(DispType::isChar, std::string(digits, formatWideChar(digits, (char32_t) value, 2 * sizeof(wchar_t))));
+	}
+	template<std::size_t Placeholders> inline TypeValue toTypeValue(const Format<Placeholders>& format) {
+		static_assert(sizeof(format) == 0, "An Integrity::Format has to be the first message argument");
+		return TypeValue(DispType::isCharStar, "");
+	}
+	inline TypeValue toTypeValue(const std::string& value) {
+		return TypeValue(DispType::isString, value);
+	}
+	// string conversions...
+	/*
+	* see https://dbj.org/c17-codecvt-deprecated-panic/
+	*/
+	template<typename F> inline std::string toStdString(F str) {
+		if (str.empty())
+			return {};
+		return { std::begin(str), std::end(str) };
+	};
+	template<> inline TypeValue toTypeValue<std::wstring>(std::wstring value) {
+		return TypeValue(DispType::isString, toStdString(value));
+	}
+	template<> inline TypeValue toTypeValue<std::u16string>(std::u16string value) {
+		return TypeValue(DispType::isString, toStdString(value));
+	}
+	template<> inline TypeValue toTypeValue<std::u32string>(std::u32string value) {
+		return TypeValue(DispType::isString, toStdString(value));
+	}
+	template<> inline TypeValue toTypeValue<const char*>(const char* str) {
+		return TypeValue(DispType::isCharStar, std::string(str));
+	}
+	/*
+	* The text of a captured arg, as toTypeValue would have made it. Numbers and characters are formatted into the
+	* buffer here, and strings are pointed at where they were captured.
+	*/
+	struct CapturedText {
+		const char* data;
+		std::size_t length;
+		char quote; // as TypeValue::quote, implying the type
+		char digits[numberTextSize];
+
+		CapturedText(const CapturedArg& arg, const char* text) : data(digits), length(0), quote(0) {
+			switch (arg.kind) {
+			case ArgKind::boolean:
+				data = arg.boolean ? "True" : "False";
+				length = arg.boolean ? 4 : 5;
+				return;
+			case ArgKind::character:
+				digits[0] = (char) arg.character;
+				length = 1;
+				quote = '\'';
+				return;
+			case ArgKind::char16:
+				length = formatWideChar(digits, arg.character, 2 * sizeof(char16_t));
+				quote = '\'';
+				return;
+			case ArgKind::char32:
+				length = formatWideChar(digits, arg.character, 2 * sizeof(char32_t));
+				quote = '\'';
+				return;
+			case ArgKind::wideChar:
+				length = formatWideChar(digits, arg.character, 2 * sizeof(wchar_t));
+				quote = '\'';
+				return;
+			case ArgKind::signedInteger:
+				length = formatNumber(digits, arg.signedInteger);
+				return;
+			case ArgKind::unsignedInteger:
+				length = formatNumber(digits, arg.unsignedInteger);
+				return;
+			case ArgKind::singleFloating:
+				length = formatNumber(digits, (float) arg.floating);
+				return;
+			case ArgKind::floating:
+				length = formatNumber(digits, arg.floating);
+				return;
+			case ArgKind::charStar:
+				data = text + arg.text.offset;
+				length = arg.text.length;
+				quote = '`';
+				return;
+			case ArgKind::string:
+				data = text + arg.text.offset;
+				length = arg.text.length;
+				quote = '"';
+				return;
+			default:
+				return;
+			}
+		}
+		CapturedText(const CapturedText&) = delete; // data can point into digits
+	};
+
+	inline std::size_t findPlaceholder(const char* text, std::size_t length, std::size_t from) {
+		for (std::size_t i = from; i + 1 < length; ++i) {
+			if (text[i] == '{' && text[i + 1] == '}') {
+				return i;
+			}
+		}
+		return std::string::npos;
+	}
+
+	template<typename Out> inline void appendQuoted(Out& out, const CapturedText& item, char quote) {
+		if (quote != 0) {
+			out.append(&quote, 1);
+		}
+		out.append(item.data, item.length);
+		if (quote != 0) {
+			out.append(&quote, 1);
+		}
+	}
+
+	// the same passes over the args as makeString, see there for the rules
+	template<typename Out>
+	void appendCapturedMessage(Out& out, const char* defaultMessage, const CapturedArg* args, std::size_t count, const char* text) {
+		std::size_t first = 0;
+		while (first < count && args[first].kind == ArgKind::charStar && args[first].text.length == 0) {
+			++first;
+		}
+		if (first == count) {
+			out.append(defaultMessage, std::strlen(defaultMessage));
+			return;
+		}
+
+		const CapturedText templateText(args[first], text);
+		const char quote = args[first].kind == ArgKind::charStar ? 0 : templateText.quote;
+		if (quote != 0) {
+			out.append(&quote, 1);
+		}
+		std::size_t copiedTo = 0;
+		bool appending = false;
+		for (std::size_t i = first + 1; i < count; ++i) {
+			const CapturedText item(args[i], text);
+			std::size_t braces = appending ? std::string::npos : findPlaceholder(templateText.data, templateText.length, copiedTo);
+			if (braces != std::string::npos) {
+				out.append(templateText.data + copiedTo, braces - copiedTo);
+				out.append(item.data, item.length);
+				copiedTo = braces + 2;
+				continue;
+			}
+			if (!appending) {
+				out.append(templateText.data + copiedTo, templateText.length - copiedTo);
+				if (quote != 0) {
+					out.append(&quote, 1);
+				}
+				appending = true;
+			}
+			out.append(", ", 2);
+			appendQuoted(out, item, item.quote);
+		}
+		if (!appending) {
+			out.append(templateText.data + copiedTo, templateText.length - copiedTo);
+			if (quote != 0) {
+				out.append(&quote, 1);
+			}
+		}
+	}
+
+	template<typename Out>
+	void appendFailureMessage(Out& out, const char* defaultMessage, std::size_t index, const CapturedArg* args, std::size_t count, const char* text) {
+		if (index == noFailureIndex) {
+			appendCapturedMessage(out, defaultMessage, args, count, text);
+			return;
+		}
+		// any message args go in front, e.g. 'rows: Null pointer at index 3'
+		if (count != 0) {
+			appendCapturedMessage(out, defaultExceptionMessage, args, count, text);
+			out.append(": ", 2);
+		}
+		out.append(defaultMessage, std::strlen(defaultMessage));
+		out.append(" at index ", 10);
+		char digits[numberTextSize];
+		out.append(digits, formatNumber(digits, index));
+	}
+
+	template<typename Out>
+	void appendFailureMessage(Out& out, const char* defaultMessage, std::size_t index, const CapturedArg* args, std::size_t messageArgCount,
+		std::size_t count, const char* text) {
+		if (messageArgCount == count) {
+			appendFailureMessage(out, defaultMessage, index, args, count, text);
+			return;
+		}
+		// the message args go in front of the operation
+		if (messageArgCount != 0) {
+			appendCapturedMessage(out, defaultExceptionMessage, args, messageArgCount, text);
+			out.append(": ", 2);
+		}
+		appendCapturedMessage(out, defaultMessage, args + messageArgCount, count - messageArgCount, text);
+		if (index != noFailureIndex) {
+			out.append(" at index ", 10);
+			char digits[numberTextSize];
+			out.append(digits, formatNumber(digits, index));
+		}
+	}
+
+	inline std::string capturedMessage(const char* defaultMessage, const CapturedArg* args, std::size_t count, const char* text) {
+		std::string message;
+		appendCapturedMessage(message, defaultMessage, args, count, text);
+		return message;
+	}
+
+	inline void AsyncSink::writeLoop() {
+		std::string lines;
+		for (;;) {
+			bool stop = stopping.load(std::memory_order_acquire);
+			lines.clear();
+			std::size_t popped = 0;
+			while (lines.size() < 64 * 1024 && ring.tryPop([&](const FailureRecord& record) {
+				lines += std::to_string(record.milliseconds);
+				lines += ' ';
+				lines += std::to_string(record.thread);
+				lines += ' ';
+				if (record.site != nullptr) {
+					lines += record.site->file;
+					lines += ':';
+					lines += std::to_string(record.site->line);
+					lines += ' ';
+				}
+				appendFailureMessage(lines, record.defaultMessage, record.index, record.args, record.messageArgCount, record.argCount, record.text);
+				lines += '\n';
+				})) {
+				++popped;
+			}
+			if (popped == 0) {
+				if (stop) {
+					return;
+				}
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				continue;
+			}
+			std::size_t done = 0;
+			while (done < lines.size()) {
+#if defined(_WIN32)
+				int n = _write(descriptor.load(std::memory_order_relaxed), lines.data() + done, (unsigned) (lines.size() - done));
+#else
+				ssize_t n = ::write(descriptor.load(std::memory_order_relaxed), lines.data() + done, lines.size() - done);
+#endif
+				if (n <= 0) {
+					break; // nowhere to report a failure to write the failures, so they are lost
+				}
+				done += (std::size_t) n;
+			}
+			writtenCount.fetch_add(popped, std::memory_order_release);
+		}
+	}
+
+	inline std::string Collector::message(std::size_t i) const {
+		const Failure& failure = failures[i];
+		const CapturedArg* failureArgs = args.data() + failure.firstArg;
+		std::string message;
+		appendFailureMessage(message, failure.defaultMessage, failure.index, failureArgs, failure.messageArgCount, failure.argCount, text.data());
+		return message;
+	}
+
+	inline void Collector::throwIfAny() const {
+		if (empty()) {
+			return;
+		}
+		std::size_t total = size() + dropped();
+		std::string summary = size() == 0 ? std::to_string(total) + " integrity checks failed" :
+			total == 1 ? message(0) : message(0) + " (and " + std::to_string(total - 1) + " more)";
+#if INTEGRITY_EXCEPTIONS
+		throw std::logic_error(summary);
+#else
+		logHandler()(summary.c_str());
+		std::abort();
+#endif
+	}
+
+	/*
+	* It is tempting to have a specialisation for T* (i.e. any pointer) which prints out the
+	* address of the pointer, but actually having the memory address of a pointer is not very
+	* helpful, and it is more likely that the developer intended to print the value of the
+	* item being pointed to. (So for example if the have an int* they probably want to print the
+	* value of the int rather than the memory address). By not having a T* specialisation then the
+	* developer will get a compile error if they don't dereference the pointer (which is probably
+	* better)
+	*/
+
+	// the args are converted into an array on the stack, sized by how many there are
+	inline std::string makeMessage(const char* defaultMessage) {
+		return defaultMessage;
+	}
+	template<typename M, typename... Rest>
+	static std::string makeMessage(const char* defaultMessage, const M& m, const Rest&... rest) {
+		const std::array<TypeValue, 1 + sizeof...(Rest)> items{ { toTypeValue(m), toTypeValue(rest)... } };
+		return makeString(defaultMessage, items.data(), items.size());
+	}
+	template<std::size_t Placeholders>
+	static std::string makeMessage(const char*, const Format<Placeholders>& format) {
+		return makeString(format, nullptr);
+	}
+	template<std::size_t Placeholders, typename M, typename... Rest>
+	static std::string makeMessage(const char*, const Format<Placeholders>& format, const M& m, const Rest&... rest) {
+		const std::array<TypeValue, 1 + sizeof...(Rest)> items{ { toTypeValue(m), toTypeValue(rest)... } };
+		return makeString(format, items.data());
+	}
+
+	template<typename... M>
+	inline std::string Result::message(const M&... m) const {
+		checkFormatArgs<typename std::decay<M>::type...>();
+		return makeMessage(defaultMessageFor(failureKind), m...);
+	}
+
+	inline const char* cString(const char* s) {
+		return s;
+	}
+	inline const char* cString(const std::string& s) {
+		return s.c_str();
+	}
+
+	// The summary line for the failures of a site which reportLimit() kept from being reported
+	inline std::string suppressedSummary(const Site& site, unsigned long long suppressed) {
+		std::string summary = std::to_string(suppressed) + " failures not reported at " + site.file + ":" + std::to_string(site.line);
+		if (site.format != nullptr && site.format[0] != '\0') {
+			summary += std::string(" \"") + site.format + "\"";
+		}
+		return summary;
+	}
+
+	/*
+	* The failure policies. Each is handed a function which builds the message, so that the policies which do not
+	* use the message never pay for building it. Unless the policy ignores failures, an active Collector gets them
+	* first, and a call site counts them. A rate limited policy only gets a site's failures that reportLimit() lets
+	* through, and a summary of the rest; as only the policies that carry on can be rate limited, they also have summarise.
+	* A policy which captures args is handed the message args themselves, to record, rather than a function to build the message,
+	* and for a failed operation such as checkedAdd its template and operands too, to recordOperation.
+	*/
+#if INTEGRITY_EXCEPTIONS
+	struct ThrowOnFailure {
+		static constexpr bool ignores = false;
+		static constexpr bool rateLimited = false;
+		static constexpr bool capturesArgs = true; // so the message is only built if what() is called
+		template<typename B> static void fail(FailureKind kind, B&& buildMessage) {
+			throw integrity_error(kind, buildMessage());
+		}
+		template<typename... M>
+		static void record(const Site* site, FailureKind kind, const char* defaultMessage, std::size_t index, const M&... m) {
+			throw integrity_error(site, kind, defaultMessage, index, m...);
+		}
+		template<typename... O, typename... M>
+		static void recordOperation(FailureKind kind, std::size_t index, const char* operation, const std::tuple<O...>& operands, const M&... m) {
+			throw integrity_error(kind, index, operation, operands, m...);
+		}
+	};
+#endif
+	struct AbortOnFailure {
+		static constexpr bool ignores = false;
+		static constexpr bool rateLimited = false;
+		static constexpr bool capturesArgs = false;
+		template<typename B> static void fail(FailureKind, B&& buildMessage) {
+			logHandler()(cString(buildMessage()));
+			std::abort();
+		}
+	};
+	struct LogOnFailure {
+		static constexpr bool ignores = false;
+		static constexpr bool rateLimited = true;
+		static constexpr bool capturesArgs = false;
+		template<typename B> static void fail(FailureKind, B&& buildMessage) {
+			logHandler()(cString(buildMessage()));
+		}
+		static void summarise(const Site& site, unsigned long long suppressed) {
+			logHandler()(suppressedSummary(site, suppressed).c_str());
+		}
+	};
+	struct CountFailures {
+		static constexpr bool ignores = false;
+		static constexpr bool rateLimited = false; // there is nothing to limit, as the message is never built
+		static constexpr bool capturesArgs = false;
+		template<typename B> static void fail(FailureKind, B&&) {
+			failureCounter().fetch_add(1, std::memory_order_relaxed);
+		}
+	};
+	struct AsyncLogOnFailure {
+		static constexpr bool ignores = false;
+		static constexpr bool rateLimited = true;
+		static constexpr bool capturesArgs = true; // so the message is built by the writer thread
+		template<typename B> static void fail(FailureKind, B&& buildMessage) {
+			asyncSink().pushMessage(nullptr, buildMessage());
+		}
+		template<typename... M>
+		static void record(const Site* site, FailureKind, const char* defaultMessage, std::size_t index, const M&... m) {
+			asyncSink().push(site, defaultMessage, index, m...);
+		}
+		template<typename... O, typename... M>
+		static void recordOperation(FailureKind kind, std::size_t index, const char* operation, const std::tuple<O...>& operands, const M&... m) {
+			asyncSink().pushOperation(defaultMessageFor(kind), index, operation, operands, m...);
+		}
+		static void summarise(const Site& site, unsigned long long suppressed) {
+			asyncSink().pushMessage(&site, suppressedSummary(site, suppressed));
+		}
+	};
+	struct IgnoreFailures {
+		static constexpr bool ignores = true;
+		static constexpr bool rateLimited = false;
+		static constexpr bool capturesArgs = false;
+		template<typename B> static void fail(FailureKind, B&&) {
+		}
+	};
+
+	inline namespace INTEGRITY_POLICY_NAMESPACE {
+
+#if INTEGRITY_FAILURE_POLICY == INTEGRITY_THROW
+	using FailurePolicy = ThrowOnFailure;
+#elif INTEGRITY_FAILURE_POLICY == INTEGRITY_ABORT
+	using FailurePolicy = AbortOnFailure;
+#elif INTEGRITY_FAILURE_POLICY == INTEGRITY_LOG
+	using FailurePolicy = LogOnFailure;
+#elif INTEGRITY_FAILURE_POLICY == INTEGRITY_COUNT
+	using FailurePolicy = CountFailures;
+#elif INTEGRITY_FAILURE_POLICY == INTEGRITY_ASYNC
+	using FailurePolicy = AsyncLogOnFailure;
+#else
+	using FailurePolicy = IgnoreFailures;
+#endif
+
+	template<typename Policy, typename... M>
+	inline void raiseWithArgs(const Site*, FailureKind kind, std::false_type, const M&... m) {
+		Policy::fail(kind, [&]() { return makeMessage(defaultMessageFor(kind), m...); });
+	}
+	template<typename Policy, typename... M>
+	inline void raiseWithArgs(const Site* site, FailureKind kind, std::true_type, const M&... m) {
+		Policy::record(site, kind, defaultMessageFor(kind), noFailureIndex, m...);
+	}
+
+	/*
+	* Everything a failing check does is kept in the functions below, which are marked cold and
+	* never inlined. That way the only thing inlined into the caller is the test of the condition
+	* and a call, and the compiler lays the call out of line as the unlikely branch.
+	* (With INTEGRITY_IGNORE they are empty and inlined, so the whole branch goes.)
+	*/
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+	INTEGRITY_FAILURE_PATH static void failWithMessage(FailureKind kind, const char* message) {
+		if (!FailurePolicy::ignores) {
+			if (Collector* collector = Collector::active()) {
+				collector->addMessage(kind, message);
+				return;
+			}
+		}
+		FailurePolicy::fail(kind, [=]() { return message; });
+	}
+	INTEGRITY_FAILURE_PATH static void failWithMessage(FailureKind kind, const std::function<void(std::stringstream&)>& messageFunc) {
+		if (!FailurePolicy::ignores) {
+			if (Collector* collector = Collector::active()) {
+				collector->addMessage(kind, makeString(messageFunc));
+				return;
+			}
 		}
+		FailurePolicy::fail(kind, [&]() { return makeString(messageFunc); });
+	}
+#pragma GCC diagnostic pop
+
+	template<typename F> INTEGRITY_FAILURE_PATH void failWithLambda(FailureKind kind, F& messageFunc) {
+		if (FailurePolicy::ignores) {
+			return;
+		}
+		// the message is written into the thread's Writer, which is held until the policy is done with it
+		Writer::Lease writer;
+		auto buildMessage = [&]() { return writeMessage(*writer, messageFunc, TakesWriter<F>()); };
+		if (Collector* collector = Collector::active()) {
+			collector->addMessage(kind, buildMessage());
+			return;
+		}
+		FailurePolicy::fail(kind, buildMessage);
+	}
+
+	template<typename... M>
+	INTEGRITY_FAILURE_PATH void failWithArgs(FailureKind kind, M... m) {
+		checkFormatArgs<typename std::decay<M>::type...>();
+		if (!FailurePolicy::ignores) {
+			if (Collector* collector = Collector::active()) {
+				collector->add(nullptr, kind, noFailureIndex, m...);
+				return;
+			}
+		}
+		raiseWithArgs<FailurePolicy>(nullptr, kind, std::integral_constant<bool, FailurePolicy::capturesArgs>(), m...);
+	}
+
+	template<typename N, typename... M>
+	INTEGRITY_FAILURE_PATH void failWithInvalidNumber(const N value, M... m) {
+		failWithArgs<M...>(invalidNumberKind(value), m...);
+	}
+
+	template<typename Policy, typename B, typename... M>
+	inline void raiseAtIndex(FailureKind kind, std::size_t, B& buildMessage, std::false_type, const M&...) {
+		Policy::fail(kind, buildMessage);
+	}
+	template<typename Policy, typename B, typename... M>
+	inline void raiseAtIndex(FailureKind kind, std::size_t index, B&, std::true_type, const M&... m) {
+		Policy::record(nullptr, kind, defaultMessageFor(kind), index, m...);
+	}
+
+	template<typename... M>
+	INTEGRITY_FAILURE_PATH void failAtIndex(FailureKind kind, std::size_t index, M... m) {
+		checkFormatArgs<typename std::decay<M>::type...>();
+		auto buildMessage = [&]() {
+			std::string message = std::string(defaultMessageFor(kind)) + " at index " + std::to_string(index);
+			if (sizeof...(M) != 0) {
+				message = makeMessage(defaultExceptionMessage, m...) + ": " + message;
+			}
+			return message;
+		};
+		if (!FailurePolicy::ignores) {
+			if (Collector* collector = Collector::active()) {
+				collector->add(nullptr, kind, index, m...);
+				return;
+			}
+		}
+		raiseAtIndex<FailurePolicy>(kind, index, buildMessage, std::integral_constant<bool, FailurePolicy::capturesArgs>(), m...);
+	}
+
+	template<typename N, typename... M>
+	INTEGRITY_FAILURE_PATH void failWithInvalidNumberAt(const N value, std::size_t index, M... m) {
+		failAtIndex<M...>(invalidNumberKind(value), index, m...);
+	}
+
+	template<typename Policy, typename R> inline void reportAtSite(Site&, R&& report, std::false_type) {
+		report();
+	}
+	template<typename Policy, typename R> inline void reportAtSite(Site& site, R&& report, std::true_type) {
+		unsigned long long summarise;
+		bool reportThis = site.shouldReport(summarise);
+		if (summarise != 0) {
+			Policy::summarise(site, summarise);
+		}
+		if (reportThis) {
+			report();
+		}
+	}
+
+	template<typename Policy> inline void reportSuppressedBy(std::false_type) {
+	}
+	template<typename Policy> inline void reportSuppressedBy(std::true_type) {
+		for (Site* site = Site::first(); site != nullptr; site = site->nextSite()) {
+			unsigned long long taken = site->takeSuppressed();
+			if (taken != 0) {
+				Policy::summarise(*site, taken);
+			}
+		}
+	}
+
+	/// <summary>
+	/// Reports the summary of every site's failures which reportLimit() has suppressed since its last summary
+	/// </summary>
+	/// <remarks>
+	/// A summary is otherwise only reported by the site's first failure of a new interval, so the failures of a site's last
+	/// interval are never summarised if it stops failing. Call this at shutdown, or now and then, to report them.
+	/// It does nothing unless the failure policy is rate limited.
+	/// </remarks>
+	inline void reportSuppressed() {
+		reportSuppressedBy<FailurePolicy>(std::integral_constant<bool, FailurePolicy::rateLimited>());
+	}
+
+	// a failure at a site which has already been counted, from failAtSite or a failed tryCheckAt
+	template<typename... M>
+	inline void reportFailureAt(Site& site, const M&... m) {
+		checkFormatArgs<typename std::decay<M>::type...>();
+		if (!FailurePolicy::ignores) {
+			if (Collector* collector = Collector::active()) {
+				collector->add(&site, FailureKind::condition, noFailureIndex, m...);
+				return;
+			}
+		}
+		reportAtSite<FailurePolicy>(site, [&]() {
+			raiseWithArgs<FailurePolicy>(&site, FailureKind::condition, std::integral_constant<bool, FailurePolicy::capturesArgs>(), m...);
+			}, std::integral_constant<bool, FailurePolicy::rateLimited>());
+	}
+
+	template<typename... M>
+	INTEGRITY_FAILURE_PATH void failAtSite(Site& site, const char* function, M... m) {
+		if (!FailurePolicy::ignores) {
+			site.countFailure(function);
+		}
+		reportFailureAt(site, m...);
+	}
+
+	template<typename Policy, typename... O, typename... M>
+	inline void raiseOperation(FailureKind kind, const char* operation, const std::tuple<O...>& operands, std::size_t index, std::false_type, const M&... m) {
+		Policy::fail(kind, [&]() {
+			std::string message = applyOperands([&](const O&... o) { return makeMessage(defaultExceptionMessage, operation, o...); }, operands);
+			if (index != noFailureIndex) {
+				message += " at index " + std::to_string(index);
+			}
+			if (sizeof...(M) != 0) {
+				message = makeMessage(defaultExceptionMessage, m...) + ": " + message;
+			}
+			return message;
+			});
+	}
+	template<typename Policy, typename... O, typename... M>
+	inline void raiseOperation(FailureKind kind, const char* operation, const std::tuple<O...>& operands, std::size_t index, std::true_type, const M&... m) {
+		Policy::recordOperation(kind, index, operation, operands, m...);
+	}
+
+	// the failure of an operation on its operands, e.g. 'rows: Overflow in 3 + 5 at index 2', counted and rate limited at
+	// the operation's Site, whose format is the operation
+	template<typename... O, typename... M>
+	inline void reportOperationFailure(FailureKind kind, Site& operation, const std::tuple<O...>& operands, std::size_t index, const M&... m) {
+		checkFormatArgs<typename std::decay<M>::type...>();
+		if (!FailurePolicy::ignores) {
+			operation.countFailure(operation.function());
+			if (Collector* collector = Collector::active()) {
+				collector->addOperation(kind, index, operation.format, operands, m...);
+				return;
+			}
+		}
+		reportAtSite<FailurePolicy>(operation, [&]() {
+			raiseOperation<FailurePolicy>(kind, operation.format, operands, index, std::integral_constant<bool, FailurePolicy::capturesArgs>(), m...);
+			}, std::integral_constant<bool, FailurePolicy::rateLimited>());
+	}
+
+	template<typename A, typename B, typename... M>
+	INTEGRITY_FAILURE_PATH void failWithOperands(FailureKind kind, Site& operation, A a, B b, std::size_t index, M... m) {
+		reportOperationFailure(kind, operation, std::tuple<A, B>(a, b), index, m...);
+	}
+
+	// the rest of a checkedSum which overflowed at index, with total the wrapped sum up to and including it. It reports that
+	// overflow, and goes on adding up the rest for a policy which carries on.
+	template<typename T, typename... M>
+	INTEGRITY_FAILURE_PATH T failSumOverflow(T total, const T* data, std::size_t index, std::size_t count, M... m) {
+		// the total before data[index] is worked back from the wrapped one, rather than kept by the loop, where copying it
+		// would put a move in the chain of additions on CPUs which do not eliminate moves
+		T previous;
+		subOverflows(total, data[index], previous);
+		failWithOperands<T, T, M...>(FailureKind::overflow, sumSite(), previous, data[index], index, m...);
+		for (std::size_t i = index + 1; i < count; ++i) {
+			addOverflows(total, data[i], total);
+		}
+		return total;
+	}
+
+	template<typename... M>
+	INTEGRITY_FAILURE_PATH void failWindowOutOfBounds(std::size_t offset, std::size_t length, std::size_t stride, std::size_t size, M... m) {
+		if (stride == 1) {
+			reportOperationFailure(FailureKind::outOfBounds, windowSite(), std::make_tuple(offset, length, size), noFailureIndex, m...);
+		}
+		else {
+			reportOperationFailure(FailureKind::outOfBounds, strideSite(), std::make_tuple(offset, length, stride, size), noFailureIndex, m...);
+		}
+	}
+
+	// the element a checked_span gives for an index out of bounds when the failure policy carries on, in place of the one
+	// past the end. It is the thread's own, so that a write to it races with nothing, and is value initialised each time.
+	template<typename T>
+	inline T& outOfBoundsElement(std::true_type) {
+		static thread_local T element;
+		element = T();
+		return element;
+	}
+	template<typename T>
+	[[noreturn]] inline T& outOfBoundsElement(std::false_type) {
+		std::abort(); // there is no element to give
+	}
+
+	template<typename T, typename... M>
+	INTEGRITY_FAILURE_PATH T& failIndexOutOfBounds(std::size_t index, std::size_t size, M... m) {
+		typedef typename std::remove_cv<T>::type Element;
+		failWithOperands<std::size_t, std::size_t, M...>(FailureKind::outOfBounds, indexSite(), index, size, noFailureIndex, m...);
+		return outOfBoundsElement<Element>(std::integral_constant<bool, std::is_default_constructible<Element>::value && std::is_move_assignable<Element>::value>());
 	}
 
-	template<typename S, typename M1 = NonType, typename M2 = NonType, typename M3 = NonType, typename M4 = NonType>
-	inline void checkStringNotNullOrEmpty(S* s, const M1& m1 = NonType::Singleton(), const M2& m2 = NonType::Singleton(), const M3& m3 = NonType::Singleton(), const M4& m4 = NonType::Singleton()) {
-		if (s == 0) {
-			throwWithMessage(defaultNullPointerMessage, { toTypeValue(m1), toTypeValue(m2), toTypeValue(m3), toTypeValue(m4) });
-		} else if (s->empty()) {
-			throwWithMessage(defaultEmptyStringMessage, { toTypeValue(m1), toTypeValue(m2), toTypeValue(m3), toTypeValue(m4) });
+	template<typename... M>
+	INTEGRITY_FAILURE_PATH void failWithResult(const Result& result, M... m) {
+		if (result.site() != nullptr) {
+			reportFailureAt(*result.site(), m...);
+		}
+		else {
+			failWithArgs<M...>(result.kind(), m...);
 		}
 	}
 
-	inline void checkStringNotNullOrEmptyM(const char* s, const std::function<void(std::stringstream&)>& messageFunc) {
-		if (s == 0 || std::strlen(s) == 0) {
-			throw std::logic_error(makeString(messageFunc));
+	} // inline namespace INTEGRITY_POLICY_NAMESPACE
+
+	/*
+	* Bulk NaN / Infinity search. A float or double is NaN or +-Infinity exactly when all the bits of its exponent are set,
+	* so the kernels mask out the exponent of several numbers at a time and compare it with the all ones exponent.
+	* They work through the data a block at a time, ORing the comparisons together so that there is a single branch per
+	* block, and once a block has a hit the plain loop finds which element it was. Each returns count if all are valid.
+	*/
+	template<typename N, typename Bits, Bits exponentMask>
+	inline std::size_t findFirstInvalidNumberScalar(const N* data, std::size_t from, std::size_t count) {
+		static_assert(sizeof(N) == sizeof(Bits), "Bits has to be the same size as the floating point type");
+		for (std::size_t i = from; i < count; ++i) {
+			Bits bits;
+			std::memcpy(&bits, data + i, sizeof(bits));
+			if ((bits & exponentMask) == exponentMask) {
+				return i;
+			}
 		}
+		return count;
 	}
-	template <typename S>
-	inline void checkStringNotNullOrEmptyM(const S& s, const std::function<void(std::stringstream&)>& messageFunc) {
-		if (s.empty()) {
-			throw std::logic_error(makeString(messageFunc));
+	inline std::size_t findFirstInvalidNumberScalar(const float* data, std::size_t from, std::size_t count) {
+		return findFirstInvalidNumberScalar<float, std::uint32_t, 0x7F800000u>(data, from, count);
+	}
+	inline std::size_t findFirstInvalidNumberScalar(const double* data, std::size_t from, std::size_t count) {
+		return findFirstInvalidNumberScalar<double, std::uint64_t, 0x7FF0000000000000ull>(data, from, count);
+	}
+
+#ifdef INTEGRITY_X86_SIMD
+	inline std::size_t findFirstInvalidNumberSSE2(const float* data, std::size_t count) {
+		const __m128i mask = _mm_set1_epi32(0x7F800000);
+		std::size_t i = 0;
+		for (; i + 16 <= count; i += 16) {
+			__m128i hit = _mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128((const __m128i*) (data + i)), mask), mask);
+			hit = _mm_or_si128(hit, _mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128((const __m128i*) (data + i + 4)), mask), mask));
+			hit = _mm_or_si128(hit, _mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128((const __m128i*) (data + i + 8)), mask), mask));
+			hit = _mm_or_si128(hit, _mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128((const __m128i*) (data + i + 12)), mask), mask));
+			if (_mm_movemask_epi8(hit) != 0) {
+				break;
+			}
 		}
+		return findFirstInvalidNumberScalar(data, i, count);
 	}
-	template <typename S>
-	inline void checkStringNotNullOrEmptyM(const S* s, const std::function<void(std::stringstream&)>& messageFunc) {
-		if (s == 0 || s->empty()) {
-			throw std::logic_error(makeString(messageFunc));
+	inline std::size_t findFirstInvalidNumberSSE2(const double* data, std::size_t count) {
+		// SSE2 has no 64 bit compare, but the low half of the exponent mask is 0 so comparing 32 bit lanes is enough
+		const __m128i mask = _mm_set1_epi64x(0x7FF0000000000000ll);
+		const __m128i highHalves = _mm_set1_epi64x(0xFFFFFFFF00000000ll);
+		std::size_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+			__m128i hit = _mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128((const __m128i*) (data + i)), mask), mask);
+			hit = _mm_or_si128(hit, _mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128((const __m128i*) (data + i + 2)), mask), mask));
+			hit = _mm_or_si128(hit, _mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128((const __m128i*) (data + i + 4)), mask), mask));
+			hit = _mm_or_si128(hit, _mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128((const __m128i*) (data + i + 6)), mask), mask));
+			if (_mm_movemask_epi8(_mm_and_si128(hit, highHalves)) != 0) {
+				break;
+			}
 		}
+		return findFirstInvalidNumberScalar(data, i, count);
 	}
+#endif
 
-	// "private" functions... -----------------------------------------------------------------------------------------------
-
-	enum class DispType {
-		isBool,
-		isString, // std::string, std::wstring, std::u16string, std::u32string
-		isCharStar,
-		isNumber, // short, int, long, long long & unsigned variants, and float, double and long double
-		isChar,
-		nonType, // placeholder for when no message argument was passed in
-	};
-	struct TypeValue {
-		DispType type;
-		std::string value;
-		TypeValue(DispType theType, const std::string& theValue) {
-			type = theType;
-			value = theValue;
+#ifdef INTEGRITY_X86_RUNTIME_DISPATCH
+	__attribute__((target("avx2"))) inline std::size_t findFirstInvalidNumberAVX2(const float* data, std::size_t count) {
+		const __m256i mask = _mm256_set1_epi32(0x7F800000);
+		std::size_t i = 0;
+		for (; i + 32 <= count; i += 32) {
+			__m256i hit = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_loadu_si256((const __m256i*) (data + i)), mask), mask);
+			hit = _mm256_or_si256(hit, _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_loadu_si256((const __m256i*) (data + i + 8)), mask), mask));
+			hit = _mm256_or_si256(hit, _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_loadu_si256((const __m256i*) (data + i + 16)), mask), mask));
+			hit = _mm256_or_si256(hit, _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_loadu_si256((const __m256i*) (data + i + 24)), mask), mask));
+			if (!_mm256_testz_si256(hit, hit)) {
+				break;
+			}
 		}
-		std::string representationImplyingType() {
-			switch (this->type) {
-			case DispType::isBool:
-				return this->value; // will be True or False
-			case DispType::isChar:
-				return "'" + this->value + "'"; // use ' to imply char
-			case DispType::isString:
-				return "\"" + this->value + "\""; // use ' to imply string
-			case DispType::isCharStar:
-				return "`" + this->value + "`"; // use ` (backtick) to imply char*
-			case DispType::isNumber:
-				return this->value; // ints, longs, floats etc. are all just represented as their value 
-			default:
-				return "Invalid DispType";
+		return findFirstInvalidNumberScalar(data, i, count);
+	}
+	__attribute__((target("avx2"))) inline std::size_t findFirstInvalidNumberAVX2(const double* data, std::size_t count) {
+		const __m256i mask = _mm256_set1_epi64x(0x7FF0000000000000ll);
+		std::size_t i = 0;
+		for (; i + 16 <= count; i += 16) {
+			__m256i hit = _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_loadu_si256((const __m256i*) (data + i)), mask), mask);
+			hit = _mm256_or_si256(hit, _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_loadu_si256((const __m256i*) (data + i + 4)), mask), mask));
+			hit = _mm256_or_si256(hit, _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_loadu_si256((const __m256i*) (data + i + 8)), mask), mask));
+			hit = _mm256_or_si256(hit, _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_loadu_si256((const __m256i*) (data + i + 12)), mask), mask));
+			if (!_mm256_testz_si256(hit, hit)) {
+				break;
+			}
+		}
+		return findFirstInvalidNumberScalar(data, i, count);
+	}
+	__attribute__((target("avx512f"))) inline std::size_t findFirstInvalidNumberAVX512(const float* data, std::size_t count) {
+		const __m512i mask = _mm512_set1_epi32(0x7F800000);
+		std::size_t i = 0;
+		for (; i + 64 <= count; i += 64) {
+			__mmask16 hit = _mm512_cmpeq_epi32_mask(_mm512_and_si512(_mm512_loadu_si512(data + i), mask), mask);
+			hit |= _mm512_cmpeq_epi32_mask(_mm512_and_si512(_mm512_loadu_si512(data + i + 16), mask), mask);
+			hit |= _mm512_cmpeq_epi32_mask(_mm512_and_si512(_mm512_loadu_si512(data + i + 32), mask), mask);
+			hit |= _mm512_cmpeq_epi32_mask(_mm512_and_si512(_mm512_loadu_si512(data + i + 48), mask), mask);
+			if (hit != 0) {
+				break;
+			}
+		}
+		return findFirstInvalidNumberScalar(data, i, count);
+	}
+	__attribute__((target("avx512f"))) inline std::size_t findFirstInvalidNumberAVX512(const double* data, std::size_t count) {
+		const __m512i mask = _mm512_set1_epi64(0x7FF0000000000000ll);
+		std::size_t i = 0;
+		for (; i + 32 <= count; i += 32) {
+			__mmask8 hit = _mm512_cmpeq_epi64_mask(_mm512_and_si512(_mm512_loadu_si512(data + i), mask), mask);
+			hit |= _mm512_cmpeq_epi64_mask(_mm512_and_si512(_mm512_loadu_si512(data + i + 8), mask), mask);
+			hit |= _mm512_cmpeq_epi64_mask(_mm512_and_si512(_mm512_loadu_si512(data + i + 16), mask), mask);
+			hit |= _mm512_cmpeq_epi64_mask(_mm512_and_si512(_mm512_loadu_si512(data + i + 24), mask), mask);
+			if (hit != 0) {
+				break;
 			}
 		}
+		return findFirstInvalidNumberScalar(data, i, count);
+	}
+#endif
+
+	enum class SimdLevel {
+		none,
+		sse2,
+		avx2,
+		avx512,
 	};
 
-	static std::string makeString(const char* defaultMessage, const std::vector<TypeValue>& items) {
-		std::string retString = "";
+	/// <summary>
+	/// The widest SIMD instruction set the bulk checks can use on this CPU, worked out once
+	/// </summary>
+	inline SimdLevel simdLevel() {
+#if defined(INTEGRITY_X86_RUNTIME_DISPATCH)
+		static const SimdLevel level = __builtin_cpu_supports("avx512f") ? SimdLevel::avx512
+			: __builtin_cpu_supports("avx2") ? SimdLevel::avx2
+			: __builtin_cpu_supports("sse2") ? SimdLevel::sse2 : SimdLevel::none;
+		return level;
+#elif defined(INTEGRITY_X86_SIMD)
+		return SimdLevel::sse2;
+#else
+		return SimdLevel::none;
+#endif
+	}
 
-		bool atLeastOne = false;
+	inline std::size_t findFirstInvalidNumber(const float* data, std::size_t count) {
+		switch (simdLevel()) {
+#if defined(INTEGRITY_X86_RUNTIME_DISPATCH)
+		case SimdLevel::avx512:
+			return findFirstInvalidNumberAVX512(data, count);
+		case SimdLevel::avx2:
+			return findFirstInvalidNumberAVX2(data, count);
+#endif
+#if defined(INTEGRITY_X86_SIMD)
+		case SimdLevel::sse2:
+			return findFirstInvalidNumberSSE2(data, count);
+#endif
+		default:
+			return findFirstInvalidNumberScalar(data, 0, count);
+		}
+	}
+	inline std::size_t findFirstInvalidNumber(const double* data, std::size_t count) {
+		switch (simdLevel()) {
+#if defined(INTEGRITY_X86_RUNTIME_DISPATCH)
+		case SimdLevel::avx512:
+			return findFirstInvalidNumberAVX512(data, count);
+		case SimdLevel::avx2:
+			return findFirstInvalidNumberAVX2(data, count);
+#endif
+#if defined(INTEGRITY_X86_SIMD)
+		case SimdLevel::sse2:
+			return findFirstInvalidNumberSSE2(data, count);
+#endif
+		default:
+			return findFirstInvalidNumberScalar(data, 0, count);
+		}
+	}
+	inline std::size_t findFirstInvalidNumber(const long double* data, std::size_t count) {
+		// long double has padding bits (and differs between compilers) so just use the standard library
+		for (std::size_t i = 0; i < count; ++i) {
+			if (!std::isfinite(data[i])) {
+				return i;
+			}
+		}
+		return count;
+	}
 
-		for (TypeValue item : items) {
-			if (item.type == DispType::nonType) {
-				continue;
+	/*
+	* Bulk null pointer search. The pointers are loaded as whole words and compared with zero several at a time,
+	* a block per branch like the NaN search above.
+	*/
+	inline std::size_t findFirstNullScalar(const void* const* pointers, std::size_t from, std::size_t count) {
+		for (std::size_t i = from; i < count; ++i) {
+			if (pointers[i] == nullptr) {
+				return i;
 			}
-			atLeastOne = true;
-			std::size_t braces = retString.find("{}");
-			if (braces != std::string::npos) {
-				retString = retString.replace(braces, 2, item.value);
+		}
+		return count;
+	}
+
+#ifdef INTEGRITY_X86_SIMD
+	// all ones in each pointer sized lane of v which is zero. SSE2 only compares 32 bits at a time, so for 64 bit
+	// pointers a lane is null when both of its halves are
+	inline __m128i nullLanesSSE2(__m128i v) {
+		__m128i zeroHalves = _mm_cmpeq_epi32(v, _mm_setzero_si128());
+		if (sizeof(void*) == 4) {
+			return zeroHalves;
+		}
+		return _mm_and_si128(zeroHalves, _mm_shuffle_epi32(zeroHalves, _MM_SHUFFLE(2, 3, 0, 1)));
+	}
+	inline std::size_t findFirstNullSSE2(const void* const* pointers, std::size_t count) {
+		const std::size_t perVector = 16 / sizeof(void*);
+		std::size_t i = 0;
+		for (; i + 4 * perVector <= count; i += 4 * perVector) {
+			__m128i hit = nullLanesSSE2(_mm_loadu_si128((const __m128i*) (pointers + i)));
+			hit = _mm_or_si128(hit, nullLanesSSE2(_mm_loadu_si128((const __m128i*) (pointers + i + perVector))));
+			hit = _mm_or_si128(hit, nullLanesSSE2(_mm_loadu_si128((const __m128i*) (pointers + i + 2 * perVector))));
+			hit = _mm_or_si128(hit, nullLanesSSE2(_mm_loadu_si128((const __m128i*) (pointers + i + 3 * perVector))));
+			if (_mm_movemask_epi8(hit) != 0) {
+				break;
 			}
-			else {
-				std::string asString;
-				// if the first message argument was a char* then don't stick any quotes around it...
-				if (retString.length() == 0 && item.type == Integrity::DispType::isCharStar) {
-					asString = item.value;
-				}
-				else {
-					asString = item.representationImplyingType();
-				}
-				if (retString.length() == 0) {
-					retString = asString;
-				}
-				else {
-					retString = retString + ", " + asString;
-				}
+		}
+		return findFirstNullScalar(pointers, i, count);
+	}
+#endif
+
+#ifdef INTEGRITY_X86_RUNTIME_DISPATCH
+	__attribute__((target("avx2"))) inline std::size_t findFirstNullAVX2(const void* const* pointers, std::size_t count) {
+		const std::size_t perVector = 32 / sizeof(void*);
+		const __m256i zero = _mm256_setzero_si256();
+		std::size_t i = 0;
+		for (; i + 4 * perVector <= count; i += 4 * perVector) {
+			__m256i v0 = _mm256_loadu_si256((const __m256i*) (pointers + i));
+			__m256i v1 = _mm256_loadu_si256((const __m256i*) (pointers + i + perVector));
+			__m256i v2 = _mm256_loadu_si256((const __m256i*) (pointers + i + 2 * perVector));
+			__m256i v3 = _mm256_loadu_si256((const __m256i*) (pointers + i + 3 * perVector));
+			__m256i hit = sizeof(void*) == 8
+				? _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi64(v0, zero), _mm256_cmpeq_epi64(v1, zero)), _mm256_or_si256(_mm256_cmpeq_epi64(v2, zero), _mm256_cmpeq_epi64(v3, zero)))
+				: _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi32(v0, zero), _mm256_cmpeq_epi32(v1, zero)), _mm256_or_si256(_mm256_cmpeq_epi32(v2, zero), _mm256_cmpeq_epi32(v3, zero)));
+			if (!_mm256_testz_si256(hit, hit)) {
+				break;
 			}
 		}
-		if (!atLeastOne) {
-			return defaultMessage;
+		return findFirstNullScalar(pointers, i, count);
+	}
+	__attribute__((target("avx512f"))) inline std::size_t findFirstNullAVX512(const void* const* pointers, std::size_t count) {
+		const std::size_t perVector = 64 / sizeof(void*);
+		const __m512i zero = _mm512_setzero_si512();
+		std::size_t i = 0;
+		for (; i + 4 * perVector <= count; i += 4 * perVector) {
+			__m512i v0 = _mm512_loadu_si512(pointers + i);
+			__m512i v1 = _mm512_loadu_si512(pointers + i + perVector);
+			__m512i v2 = _mm512_loadu_si512(pointers + i + 2 * perVector);
+			__m512i v3 = _mm512_loadu_si512(pointers + i + 3 * perVector);
+			bool hit = sizeof(void*) == 8
+				? (_mm512_cmpeq_epi64_mask(v0, zero) | _mm512_cmpeq_epi64_mask(v1, zero) | _mm512_cmpeq_epi64_mask(v2, zero) | _mm512_cmpeq_epi64_mask(v3, zero)) != 0
+				: (_mm512_cmpeq_epi32_mask(v0, zero) | _mm512_cmpeq_epi32_mask(v1, zero) | _mm512_cmpeq_epi32_mask(v2, zero) | _mm512_cmpeq_epi32_mask(v3, zero)) != 0;
+			if (hit) {
+				break;
+			}
 		}
-		return retString;
+		return findFirstNullScalar(pointers, i, count);
 	}
-	static std::string makeString(const std::function<void(std::stringstream&)>& messageFunc) {
-		if (messageFunc == nullptr) {
-			return defaultExceptionMessage;
+#endif
+
+	inline std::size_t findFirstNull(const void* const* pointers, std::size_t count) {
+		switch (simdLevel()) {
+#if defined(INTEGRITY_X86_RUNTIME_DISPATCH)
+		case SimdLevel::avx512:
+			return findFirstNullAVX512(pointers, count);
+		case SimdLevel::avx2:
+			return findFirstNullAVX2(pointers, count);
+#endif
+#if defined(INTEGRITY_X86_SIMD)
+		case SimdLevel::sse2:
+			return findFirstNullSSE2(pointers, count);
+#endif
+		default:
+			return findFirstNullScalar(pointers, 0, count);
 		}
+	}
 
-		try {
-			std::stringstream ss;
+	// Contiguous containers of raw pointers use the kernels, anything else (std::list, std::unique_ptr etc.) is looped over.
+	// Both return -1 if there are no nulls.
+	template<typename C> std::size_t findFirstNullInRange(const C& pointers, std::true_type) {
+		std::size_t index = findFirstNull((const void* const*) pointers.data(), pointers.size());
+		return index == pointers.size() ? (std::size_t) -1 : index;
+	}
+	template<typename C> std::size_t findFirstNullInRange(const C& pointers, std::false_type) {
+		std::size_t index = 0;
+		for (const auto& pointer : pointers) {
+			if (pointer == nullptr) {
+				return index;
+			}
+			++index;
+		}
+		return (std::size_t) -1;
+	}
+	template<typename C, typename = void> struct IsContiguousPointers : std::false_type {};
+	template<typename C> struct IsContiguousPointers<C, typename std::enable_if<std::is_pointer<typename std::remove_reference<decltype(*std::declval<const C&>().data())>::type>::value,
+		decltype(std::declval<const C&>().size(), void())>::type> : std::true_type {};
 
-			messageFunc(ss);
+	template<typename C> std::size_t findFirstNullInRange(const C& pointers) {
+		return findFirstNullInRange(pointers, IsContiguousPointers<C>());
+	}
 
-			return ss.str();
+	/*
+	* Sorted and in range search. The kernels compare a block of values at a time, each with the value after it or with
+	* both bounds, and like the searches above only look for which one it was once a block has a hit. They handle 32 and
+	* 64 bit integers, floats and doubles; unsigned integers have their top bit flipped so that the signed compares order
+	* them. Anything else is looped over. There is no AVX-512 version, as AVX2 already keeps up with memory.
+	* Each returns count if none of the values fail.
+	*/
+	template<bool Strict, typename T> inline bool outOfOrder(const T& previous, const T& value) {
+		return Strict ? !(previous < value) : value < previous;
+	}
+	template<bool Strict, typename T>
+	inline std::size_t findFirstUnsortedScalar(const T* data, std::size_t from, std::size_t count) {
+		for (std::size_t i = from == 0 ? 1 : from; i < count; ++i) {
+			if (outOfOrder<Strict>(data[i - 1], data[i])) {
+				return i;
+			}
 		}
-		catch (...) {
-			return std::string(defaultExceptionMessage) + ": [error]";
+		return count;
+	}
+	template<typename T>
+	inline std::size_t findFirstOutOfRangeScalar(const T* data, std::size_t from, std::size_t count, const T& lo, const T& hi) {
+		for (std::size_t i = from; i < count; ++i) {
+			if (!(lo <= data[i] && data[i] <= hi)) {
+				return i;
+			}
 		}
+		return count;
 	}
 
-	template<typename T> inline TypeValue toTypeValue(T primitive) {
-		return TypeValue(DispType::isNumber, std::to_string(primitive));
+	// The lane type a kernel compares T as, or void if there is no kernel for it
+	template<std::size_t Size, bool Signed> struct IntegerLane {
+		using type = void;
+	};
+	template<> struct IntegerLane<4, true> {
+		using type = std::int32_t;
+	};
+	template<> struct IntegerLane<4, false> {
+		using type = std::uint32_t;
+	};
+	template<> struct IntegerLane<8, true> {
+		using type = std::int64_t;
+	};
+	template<> struct IntegerLane<8, false> {
+		using type = std::uint64_t;
+	};
+	template<typename T> using LaneOf = typename std::conditional<std::is_same<T, float>::value || std::is_same<T, double>::value, T,
+		typename std::conditional<std::is_integral<T>::value && !std::is_same<T, bool>::value,
+		typename IntegerLane<sizeof(T), std::is_signed<T>::value>::type, void>::type>::type;
+
+#ifdef INTEGRITY_X86_SIMD
+	// What the SSE2 kernels need for each lane type: all ones in each lane of the result which fails. SSE2 cannot compare
+	// 64 bit integers, so they have no kernel.
+	template<typename L> struct Sse2Lanes {
+		static constexpr bool usable = false;
+	};
+	template<> struct Sse2Lanes<std::int32_t> {
+		static constexpr bool usable = true;
+		static constexpr std::size_t count = 4;
+		using V = __m128i;
+		static V load(const void* p) {
+			return _mm_loadu_si128((const __m128i*) p);
+		}
+		static V set(std::int32_t value) {
+			return _mm_set1_epi32(value);
+		}
+		static V outOfOrder(V previous, V value) {
+			return _mm_cmpgt_epi32(previous, value);
+		}
+		static V notIncreasing(V previous, V value) {
+			return _mm_or_si128(_mm_cmpgt_epi32(previous, value), _mm_cmpeq_epi32(previous, value));
+		}
+		static V outside(V value, V lo, V hi) {
+			return _mm_or_si128(_mm_cmpgt_epi32(lo, value), _mm_cmpgt_epi32(value, hi));
+		}
+		static V either(V a, V b) {
+			return _mm_or_si128(a, b);
+		}
+		static bool any(V hit) {
+			return _mm_movemask_epi8(hit) != 0;
+		}
+	};
+	template<> struct Sse2Lanes<std::uint32_t> : Sse2Lanes<std::int32_t> {
+		static V load(const void* p) {
+			return _mm_xor_si128(_mm_loadu_si128((const __m128i*) p), _mm_set1_epi32(INT32_MIN));
+		}
+		static V set(std::uint32_t value) {
+			return _mm_set1_epi32((std::int32_t) (value ^ 0x80000000u));
+		}
+	};
+	template<> struct Sse2Lanes<float> {
+		static constexpr bool usable = true;
+		static constexpr std::size_t count = 4;
+		using V = __m128;
+		static V load(const void* p) {
+			return _mm_loadu_ps((const float*) p);
+		}
+		static V set(float value) {
+			return _mm_set1_ps(value);
+		}
+		static V outOfOrder(V previous, V value) {
+			return _mm_cmplt_ps(value, previous);
+		}
+		static V notIncreasing(V previous, V value) {
+			return _mm_cmpnlt_ps(previous, value);
+		}
+		static V outside(V value, V lo, V hi) {
+			return _mm_or_ps(_mm_cmpnge_ps(value, lo), _mm_cmpnle_ps(value, hi));
+		}
+		static V either(V a, V b) {
+			return _mm_or_ps(a, b);
+		}
+		static bool any(V hit) {
+			return _mm_movemask_ps(hit) != 0;
+		}
+	};
+	template<> struct Sse2Lanes<double> {
+		static constexpr bool usable = true;
+		static constexpr std::size_t count = 2;
+		using V = __m128d;
+		static V load(const void* p) {
+			return _mm_loadu_pd((const double*) p);
+		}
+		static V set(double value) {
+			return _mm_set1_pd(value);
+		}
+		static V outOfOrder(V previous, V value) {
+			return _mm_cmplt_pd(value, previous);
+		}
+		static V notIncreasing(V previous, V value) {
+			return _mm_cmpnlt_pd(previous, value);
+		}
+		static V outside(V value, V lo, V hi) {
+			return _mm_or_pd(_mm_cmpnge_pd(value, lo), _mm_cmpnle_pd(value, hi));
+		}
+		static V either(V a, V b) {
+			return _mm_or_pd(a, b);
+		}
+		static bool any(V hit) {
+			return _mm_movemask_pd(hit) != 0;
+		}
+	};
+
+	template<typename S, bool Strict> inline typename S::V brokenOrder(typename S::V previous, typename S::V value) {
+		return Strict ? S::notIncreasing(previous, value) : S::outOfOrder(previous, value);
 	}
-	template<> inline TypeValue toTypeValue<NonType>(NonType value) {
-		return TypeValue(DispType::nonType, "");
+	template<bool Strict, typename S, typename T>
+	inline std::size_t findFirstUnsortedSSE2(const T* data, std::size_t count, std::true_type) {
+		const std::size_t n = S::count;
+		std::size_t i = 0;
+		for (; i + 4 * n + 1 <= count; i += 4 * n) {
+			typename S::V hit = brokenOrder<S, Strict>(S::load(data + i), S::load(data + i + 1));
+			hit = S::either(hit, brokenOrder<S, Strict>(S::load(data + i + n), S::load(data + i + n + 1)));
+			hit = S::either(hit, brokenOrder<S, Strict>(S::load(data + i + 2 * n), S::load(data + i + 2 * n + 1)));
+			hit = S::either(hit, brokenOrder<S, Strict>(S::load(data + i + 3 * n), S::load(data + i + 3 * n + 1)));
+			if (S::any(hit)) {
+				break;
+			}
+		}
+		return findFirstUnsortedScalar<Strict>(data, i, count);
 	}
-	template<> inline TypeValue toTypeValue<bool>(const bool value) {
-		return TypeValue(DispType::isBool, value ? "True" : "False");
+	template<bool Strict, typename S, typename T>
+	inline std::size_t findFirstUnsortedSSE2(const T* data, std::size_t count, std::false_type) {
+		return findFirstUnsortedScalar<Strict>(data, 0, count);
 	}
-	template<> inline TypeValue toTypeValue<char>(const char value) {
-		return TypeValue(DispType::isChar, std::string(1, value));
+	template<typename S, typename L, typename T>
+	inline std::size_t findFirstOutOfRangeSSE2(const T* data, std::size_t count, const T& lo, const T& hi, std::true_type) {
+		const std::size_t n = S::count;
+		const typename S::V low = S::set((L) lo);
+		const typename S::V high = S::set((L) hi);
+		std::size_t i = 0;
+		for (; i + 4 * n <= count; i += 4 * n) {
+			typename S::V hit = S::outside(S::load(data + i), low, high);
+			hit = S::either(hit, S::outside(S::load(data + i + n), low, high));
+			hit = S::either(hit, S::outside(S::load(data + i + 2 * n), low, high));
+			hit = S::either(hit, S::outside(S::load(data + i + 3 * n), low, high));
+			if (S::any(hit)) {
+				break;
+			}
+		}
+		return findFirstOutOfRangeScalar(data, i, count, lo, hi);
 	}
-	template<> inline TypeValue toTypeValue<unsigned char>(const unsigned char value) {
-		return TypeValue(DispType::isChar, std::string(1, value));
+	template<typename S, typename L, typename T>
+	inline std::size_t findFirstOutOfRangeSSE2(const T* data, std::size_t count, const T& lo, const T& hi, std::false_type) {
+		return findFirstOutOfRangeScalar(data, 0, count, lo, hi);
 	}
-	template<> inline TypeValue toTypeValue<char16_t>(const char16_t value) {
-		std::stringstream ss;
-		if (value > 0xff) {
-			ss << "0x" << std::hex << std::setfill('0') << std::setw(2 * sizeof(char16_t)) << std::uppercase << (long) value;
+#endif
+
+#ifdef INTEGRITY_X86_RUNTIME_DISPATCH
+	template<typename L> struct Avx2Lanes;
+	template<> struct Avx2Lanes<std::int32_t> {
+		static constexpr std::size_t count = 8;
+		using V = __m256i;
+		__attribute__((target("avx2"))) static V load(const void* p) {
+			return _mm256_loadu_si256((const __m256i*) p);
 		}
-		else {
-			ss << (char) value;
+		__attribute__((target("avx2"))) static V set(std::int32_t value) {
+			return _mm256_set1_epi32(value);
+		}
+		__attribute__((target("avx2"))) static V outOfOrder(V previous, V value) {
+			return _mm256_cmpgt_epi32(previous, value);
+		}
+		__attribute__((target("avx2"))) static V notIncreasing(V previous, V value) {
+			return _mm256_or_si256(_mm256_cmpgt_epi32(previous, value), _mm256_cmpeq_epi32(previous, value));
+		}
+		__attribute__((target("avx2"))) static V outside(V value, V lo, V hi) {
+			return _mm256_or_si256(_mm256_cmpgt_epi32(lo, value), _mm256_cmpgt_epi32(value, hi));
+		}
+		__attribute__((target("avx2"))) static V either(V a, V b) {
+			return _mm256_or_si256(a, b);
 		}
-		return TypeValue(DispType::isChar, ss.str());
+		__attribute__((target("avx2"))) static bool any(V hit) {
+			return !_mm256_testz_si256(hit, hit);
+		}
+	};
+	template<> struct Avx2Lanes<std::uint32_t> : Avx2Lanes<std::int32_t> {
+		__attribute__((target("avx2"))) static V load(const void* p) {
+			return _mm256_xor_si256(_mm256_loadu_si256((const __m256i*) p), _mm256_set1_epi32(INT32_MIN));
+		}
+		__attribute__((target("avx2"))) static V set(std::uint32_t value) {
+			return _mm256_set1_epi32((std::int32_t) (value ^ 0x80000000u));
+		}
+	};
+	template<> struct Avx2Lanes<std::int64_t> {
+		static constexpr std::size_t count = 4;
+		using V = __m256i;
+		__attribute__((target("avx2"))) static V load(const void* p) {
+			return _mm256_loadu_si256((const __m256i*) p);
+		}
+		__attribute__((target("avx2"))) static V set(std::int64_t value) {
+			return _mm256_set1_epi64x(value);
+		}
+		__attribute__((target("avx2"))) static V outOfOrder(V previous, V value) {
+			return _mm256_cmpgt_epi64(previous, value);
+		}
+		__attribute__((target("avx2"))) static V notIncreasing(V previous, V value) {
+			return _mm256_or_si256(_mm256_cmpgt_epi64(previous, value), _mm256_cmpeq_epi64(previous, value));
+		}
+		__attribute__((target("avx2"))) static V outside(V value, V lo, V hi) {
+			return _mm256_or_si256(_mm256_cmpgt_epi64(lo, value), _mm256_cmpgt_epi64(value, hi));
+		}
+		__attribute__((target("avx2"))) static V either(V a, V b) {
+			return _mm256_or_si256(a, b);
+		}
+		__attribute__((target("avx2"))) static bool any(V hit) {
+			return !_mm256_testz_si256(hit, hit);
+		}
+	};
+	template<> struct Avx2Lanes<std::uint64_t> : Avx2Lanes<std::int64_t> {
+		__attribute__((target("avx2"))) static V load(const void* p) {
+			return _mm256_xor_si256(_mm256_loadu_si256((const __m256i*) p), _mm256_set1_epi64x(INT64_MIN));
+		}
+		__attribute__((target("avx2"))) static V set(std::uint64_t value) {
+			return _mm256_set1_epi64x((std::int64_t) (value ^ 0x8000000000000000ull));
+		}
+	};
+	template<> struct Avx2Lanes<float> {
+		static constexpr std::size_t count = 8;
+		using V = __m256;
+		__attribute__((target("avx2"))) static V load(const void* p) {
+			return _mm256_loadu_ps((const float*) p);
+		}
+		__attribute__((target("avx2"))) static V set(float value) {
+			return _mm256_set1_ps(value);
+		}
+		__attribute__((target("avx2"))) static V outOfOrder(V previous, V value) {
+			return _mm256_cmp_ps(value, previous, _CMP_LT_OQ);
+		}
+		__attribute__((target("avx2"))) static V notIncreasing(V previous, V value) {
+			return _mm256_cmp_ps(previous, value, _CMP_NLT_UQ);
+		}
+		__attribute__((target("avx2"))) static V outside(V value, V lo, V hi) {
+			return _mm256_or_ps(_mm256_cmp_ps(value, lo, _CMP_NGE_UQ), _mm256_cmp_ps(value, hi, _CMP_NLE_UQ));
+		}
+		__attribute__((target("avx2"))) static V either(V a, V b) {
+			return _mm256_or_ps(a, b);
+		}
+		__attribute__((target("avx2"))) static bool any(V hit) {
+			return _mm256_movemask_ps(hit) != 0;
+		}
+	};
+	template<> struct Avx2Lanes<double> {
+		static constexpr std::size_t count = 4;
+		using V = __m256d;
+		__attribute__((target("avx2"))) static V load(const void* p) {
+			return _mm256_loadu_pd((const double*) p);
+		}
+		__attribute__((target("avx2"))) static V set(double value) {
+			return _mm256_set1_pd(value);
+		}
+		__attribute__((target("avx2"))) static V outOfOrder(V previous, V value) {
+			return _mm256_cmp_pd(value, previous, _CMP_LT_OQ);
+		}
+		__attribute__((target("avx2"))) static V notIncreasing(V previous, V value) {
+			return _mm256_cmp_pd(previous, value, _CMP_NLT_UQ);
+		}
+		__attribute__((target("avx2"))) static V outside(V value, V lo, V hi) {
+			return _mm256_or_pd(_mm256_cmp_pd(value, lo, _CMP_NGE_UQ), _mm256_cmp_pd(value, hi, _CMP_NLE_UQ));
+		}
+		__attribute__((target("avx2"))) static V either(V a, V b) {
+			return _mm256_or_pd(a, b);
+		}
+		__attribute__((target("avx2"))) static bool any(V hit) {
+			return _mm256_movemask_pd(hit) != 0;
+		}
+	};
+
+	template<typename S, bool Strict> __attribute__((target("avx2"))) inline typename S::V brokenOrderAVX2(typename S::V previous, typename S::V value) {
+		return Strict ? S::notIncreasing(previous, value) : S::outOfOrder(previous, value);
 	}
-	template<> inline TypeValue toTypeValue<char32_t>(const char32_t value) {
-		std::stringstream ss;
-		if (value > 0xff) {
-			ss << "0x" << std::hex << std::setfill('0') << std::setw(2 * sizeof(char32_t)) << std::uppercase << (long) value;
+	template<bool Strict, typename S, typename T>
+	__attribute__((target("avx2"))) inline std::size_t findFirstUnsortedAVX2(const T* data, std::size_t count) {
+		const std::size_t n = S::count;
+		std::size_t i = 0;
+		for (; i + 4 * n + 1 <= count; i += 4 * n) {
+			typename S::V hit = brokenOrderAVX2<S, Strict>(S::load(data + i), S::load(data + i + 1));
+			hit = S::either(hit, brokenOrderAVX2<S, Strict>(S::load(data + i + n), S::load(data + i + n + 1)));
+			hit = S::either(hit, brokenOrderAVX2<S, Strict>(S::load(data + i + 2 * n), S::load(data + i + 2 * n + 1)));
+			hit = S::either(hit, brokenOrderAVX2<S, Strict>(S::load(data + i + 3 * n), S::load(data + i + 3 * n + 1)));
+			if (S::any(hit)) {
+				break;
+			}
 		}
-		else {
-			ss << (char) value;
+		return findFirstUnsortedScalar<Strict>(data, i, count);
+	}
+	template<typename S, typename L, typename T>
+	__attribute__((target("avx2"))) inline std::size_t findFirstOutOfRangeAVX2(const T* data, std::size_t count, const T& lo, const T& hi) {
+		const std::size_t n = S::count;
+		const typename S::V low = S::set((L) lo);
+		const typename S::V high = S::set((L) hi);
+		std::size_t i = 0;
+		for (; i + 4 * n <= count; i += 4 * n) {
+			typename S::V hit = S::outside(S::load(data + i), low, high);
+			hit = S::either(hit, S::outside(S::load(data + i + n), low, high));
+			hit = S::either(hit, S::outside(S::load(data + i + 2 * n), low, high));
+			hit = S::either(hit, S::outside(S::load(data + i + 3 * n), low, high));
+			if (S::any(hit)) {
+				break;
+			}
 		}
-		return TypeValue(DispType::isChar, ss.str());
+		return findFirstOutOfRangeScalar(data, i, count, lo, hi);
 	}
-	template<> inline TypeValue toTypeValue<wchar_t>(const wchar_t value) {
-		std::stringstream ss;
-		if (value > 0xff) {
-			ss << "0x" << std::hex << std::setfill('0') << std::setw(2 * sizeof(wchar_t)) << std::uppercase << (long) value;
+#endif
+
+	template<bool Strict, typename T, typename L>
+	inline std::size_t findFirstUnsorted(const T* data, std::size_t count, L*) {
+		switch (simdLevel()) {
+#if defined(INTEGRITY_X86_RUNTIME_DISPATCH)
+		case SimdLevel::avx512:
+		case SimdLevel::avx2:
+			return findFirstUnsortedAVX2<Strict, Avx2Lanes<L>>(data, count);
+#endif
+#if defined(INTEGRITY_X86_SIMD)
+		case SimdLevel::sse2:
+			return findFirstUnsortedSSE2<Strict, Sse2Lanes<L>>(data, count, std::integral_constant<bool, Sse2Lanes<L>::usable>());
+#endif
+		default:
+			return findFirstUnsortedScalar<Strict>(data, 0, count);
 		}
-		else {
-			ss << (char) value;
+	}
+	template<bool Strict, typename T>
+	inline std::size_t findFirstUnsorted(const T* data, std::size_t count, void*) {
+		return findFirstUnsortedScalar<Strict>(data, 0, count);
+	}
+	template<bool Strict, typename T> std::size_t findFirstUnsorted(const T* data, std::size_t count) {
+		return findFirstUnsorted<Strict>(data, count, (LaneOf<T>*) nullptr);
+	}
+
+	template<typename T, typename L>
+	inline std::size_t findFirstOutOfRange(const T* data, std::size_t count, const T& lo, const T& hi, L*) {
+		switch (simdLevel()) {
+#if defined(INTEGRITY_X86_RUNTIME_DISPATCH)
+		case SimdLevel::avx512:
+		case SimdLevel::avx2:
+			return findFirstOutOfRangeAVX2<Avx2Lanes<L>, L>(data, count, lo, hi);
+#endif
+#if defined(INTEGRITY_X86_SIMD)
+		case SimdLevel::sse2:
+			return findFirstOutOfRangeSSE2<Sse2Lanes<L>, L>(data, count, lo, hi, std::integral_constant<bool, Sse2Lanes<L>::usable>());
+#endif
+		default:
+			return findFirstOutOfRangeScalar(data, 0, count, lo, hi);
 		}
-		return TypeValue(DispType::isChar, ss.str());
 	}
-	inline TypeValue toTypeValue(const std::string& value) {
-		return TypeValue(DispType::isString, value);
+	template<typename T>
+	inline std::size_t findFirstOutOfRange(const T* data, std::size_t count, const T& lo, const T& hi, void*) {
+		return findFirstOutOfRangeScalar(data, 0, count, lo, hi);
 	}
-	// string conversions...
+	template<typename T> std::size_t findFirstOutOfRange(const T* data, std::size_t count, const T& lo, const T& hi) {
+		return findFirstOutOfRange(data, count, lo, hi, (LaneOf<T>*) nullptr);
+	}
+
 	/*
-	* see https://dbj.org/c17-codecvt-deprecated-panic/
+	* Duplicate search. Each value's index (plus one, so that 0 is an empty slot) goes into an open addressing table with
+	* linear probing, at most half full. The table is kept per thread and only grows, so checking does not allocate once
+	* it is big enough; 32 bit slots are used whenever the indices fit, to halve its size.
 	*/
-	template<typename F> inline std::string toStdString(F str) {
-		if (str.empty())
-			return {};
-		return { std::begin(str), std::end(str) };
-	};
-	template<> inline TypeValue toTypeValue<std::wstring>(std::wstring value) {
-		return TypeValue(DispType::isString, toStdString(value));
-	}
-	template<> inline TypeValue toTypeValue<std::u16string>(std::u16string value) {
-		return TypeValue(DispType::isString, toStdString(value));
+	template<typename Slot> inline std::vector<Slot>& duplicateTable() {
+		static thread_local std::vector<Slot> table;
+		return table;
 	}
-	template<> inline TypeValue toTypeValue<std::u32string>(std::u32string value) {
-		return TypeValue(DispType::isString, toStdString(value));
+	template<typename Slot, typename I>
+	inline std::size_t findFirstDuplicate(I first, std::size_t count, Slot) {
+		unsigned bits = 4;
+		while (((std::size_t) 1 << bits) < 2 * count) {
+			++bits;
+		}
+		std::size_t size = (std::size_t) 1 << bits;
+		std::vector<Slot>& table = duplicateTable<Slot>();
+		if (table.size() < size) {
+			table.resize(size);
+		}
+		std::memset(table.data(), 0, size * sizeof(Slot));
+		std::hash<typename std::decay<decltype(first[0])>::type> hash;
+		for (std::size_t i = 0; i < count; ++i) {
+			const auto& value = first[i];
+			// the hash is spread with a multiply, as std::hash of an integer is often the integer itself
+			std::size_t slot = (std::size_t) (((std::uint64_t) hash(value) * 0x9E3779B97F4A7C15ull) >> (64 - bits));
+			while (table[slot] != 0) {
+				if (first[table[slot] - 1] == value) {
+					return i;
+				}
+				slot = (slot + 1) & (size - 1);
+			}
+			table[slot] = (Slot) (i + 1);
+		}
+		return count;
 	}
-	template<> inline TypeValue toTypeValue<const char*>(const char* str) {
-		return TypeValue(DispType::isCharStar, std::string(str));
+	template<typename I> std::size_t findFirstDuplicate(I first, std::size_t count) {
+		if (count < 2) {
+			return count;
+		}
+		if (count < UINT32_MAX / 2) {
+			return findFirstDuplicate(first, count, std::uint32_t());
+		}
+		return findFirstDuplicate(first, count, std::size_t());
 	}
+
 	/*
-	* It is tempting to have a specialisation for T* (i.e. any pointer) which prints out the
-	* address of the pointer, but actually having the memory address of a pointer is not very
-	* helpful, and it is more likely that the developer intended to print the value of the
-	* item being pointed to. (So for example if the have an int* they probably want to print the
-	* value of the int rather than the memory address). By not having a T* specialisation then the
-	* developer will get a compile error if they don't dereference the pointer (which is probably
-	* better)
+	* Bulk empty string search. How a string stores its length is up to the library, so rather than reading the length
+	* fields directly each string is asked whether it is empty, but a block at a time, with the answers ORed into a bit
+	* mask so there is one branch per block. Only once a block has a hit is it looked through in order.
 	*/
-
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wunused-function"
-	static void throwWithMessage(const char* defaultMessage, const std::vector<Integrity::TypeValue>& items) {
-		std::string exceptionMessage = makeString(defaultMessage, items);
-		throw std::logic_error(exceptionMessage);
+	inline const char* stringProblem(const char* s) {
+		return s == nullptr ? defaultNullPointerMessage : *s == '\0' ? defaultEmptyStringMessage : nullptr;
+	}
+	inline const char* stringProblem(char* s) {
+		return stringProblem((const char*) s);
+	}
+	template<typename S> const char* stringProblem(const S* s) {
+		return s == nullptr ? defaultNullPointerMessage : s->empty() ? defaultEmptyStringMessage : nullptr;
+	}
+	template<typename S> const char* stringProblem(const S& s) {
+		return s.empty() ? defaultEmptyStringMessage : nullptr;
 	}
-#pragma GCC diagnostic pop
 
-	template<typename T> static const char* getFloatAppropriateMessage(T value) {
-		if (std::isnan(value)) {
-			return "NaN";
-		}
-		if (std::isinf(value)) {
-			if (value > 0) {
-				return "+Infinity";
+	template<typename C> std::size_t findFirstNullOrEmptyString(const C& strings, std::size_t count, const char*& problem) {
+		const std::size_t blockSize = 16;
+		auto it = strings.begin();
+		std::size_t i = 0;
+		for (; i + blockSize <= count; i += blockSize) {
+			auto blockStart = it;
+			unsigned hits = 0;
+			for (std::size_t j = 0; j < blockSize; ++j, ++it) {
+				hits |= (unsigned) (stringProblem(*it) != nullptr) << j;
 			}
-			else {
-				return "-Infinity";
+			if (hits != 0) {
+				it = blockStart;
+				break;
+			}
+		}
+		for (; i < count; ++i, ++it) {
+			problem = stringProblem(*it);
+			if (problem != nullptr) {
+				return i;
 			}
 		}
-		return "Error: expected invalid float";
+		return count;
+	}
+
+	// only called once the number is known not to be finite
+	template<typename T> inline FailureKind invalidNumberKind(T value) {
+		if (std::isnan(value)) {
+			return FailureKind::notANumber;
+		}
+		return value > 0 ? FailureKind::positiveInfinity : FailureKind::negativeInfinity;
 	}
 }
 
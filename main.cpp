@@ -1,10 +1,49 @@
 #include <iostream>
 #include <sstream>
+#include <list>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <iomanip>
+#include <climits>
 #include "integrity.h"
 
 using namespace std;
 //using namespace Integrity;
 
+// counts heap allocations, for the tests of what should not allocate
+static atomic<size_t> allocationCount(0);
+
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+// g++ does not realise that the operator new below is the one that goes with free
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t size) {
+    allocationCount.fetch_add(1, memory_order_relaxed);
+    void* p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw bad_alloc();
+    }
+    return p;
+}
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+void operator delete(void* p) noexcept {
+    free(p);
+}
+void operator delete[](void* p) noexcept {
+    free(p);
+}
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+void operator delete[](void* p, size_t) noexcept {
+    free(p);
+}
+
 void fail(const char* message) {
     std::cout << "FAIL\n";
     if (message != 0) {
@@ -80,6 +119,8 @@ void tests_which_should_not_throw() {
         Integrity::checkIsValidNumber(d2, d2);
         Integrity::checkIsValidNumber(d2, "d2 is {}", d2);
         Integrity::checkIsValidNumberM(d2, [=](Integrity::out out) { out << "d2 is " << d2; });
+        Integrity::checkStringNotNullOrEmptyM(aCharStar, [&](Integrity::out out) { out << "aCharStar"; });
+        Integrity::checkStringNotNullOrEmptyM(string("abc"), [&](Integrity::out out) { out << "a string"; });
 
         Integrity::checkNotNull(&f1);
 
@@ -116,6 +157,17 @@ void tests_which_should_not_throw() {
     }
 }
 
+// the checks can be used in constant expressions
+constexpr int squareOf(int n) {
+    Integrity::check(n >= 0, "squareOf {} is negative", n);
+    Integrity::checkIsValidNumber(1.0 / (n + 1), "1 / {}", n + 1);
+    Integrity::checkNotNull("pointer");
+    Integrity::checkStringNotNullOrEmpty("string", "name");
+    Integrity::always(n < 1000, "squareOf {} is too big", n);
+    return n * n;
+}
+static_assert(squareOf(3) == 9, "the checks should pass at compile time");
+
 void tests_which_should_not_compile() {
     const char* aCharStarPointer = 0; // prevented by private const void*
     int anInt = -10; // prevented by private long long option
@@ -148,6 +200,11 @@ void tests_which_should_not_compile() {
     //Integrity::checkNotNullM(anInt, [](std::stringstream& ss) {});
 
     //Integrity::checkStringNotNullOrEmpty(1);
+
+    //Integrity::check(false, INTEGRITY_FORMAT("{} and {}"), anInt);
+    //Integrity::check(false, "first", INTEGRITY_FORMAT("{}"), anInt);
+
+    //static_assert(squareOf(-1) == 1, "a check failing at compile time is a compile error, showing its message args");
 }
 
 void expect_throw(function<void()> func, const char* expectMessage) {
@@ -196,6 +253,27 @@ void tests_which_should_throw() {
         Integrity::checkM(x == y, [=](stringstream& ss) { ss << x << " != " << y; });
         }, "1 != 2");
 
+    expect_throw([=]() {
+        function<void(stringstream&)> messageFunc = [=](stringstream& ss) { ss << x << " != " << y; };
+        Integrity::checkM(x == y, messageFunc);
+        }, "1 != 2");
+
+    expect_throw([=]() {
+        Integrity::checkM(x == y, nullptr);
+        }, "Integrity check failed");
+
+    expect_throw([=]() {
+        Integrity::checkNotNullM(nullptr, [&](Integrity::out out) { out << "big capture " << aPointer << x << y << f1; });
+        }, "big capture omg12inf");
+
+    expect_throw([=]() {
+        Integrity::checkStringNotNullOrEmptyM("", [&](Integrity::out) { throw x; });
+        }, "Integrity check failed: [error]");
+
+    expect_throw([=]() {
+        Integrity::failM([&](Integrity::out out) { out << "failM " << x; });
+        }, "failM 1");
+
     expect_throw([=]() {
         Integrity::check(x == y);
         }, "Integrity check failed");
@@ -208,6 +286,60 @@ void tests_which_should_throw() {
         Integrity::check(x == y, "Expected {} to be same as {}", x, y);
         }, "Expected 1 to be same as 2");
 
+    expect_throw([=]() {
+        Integrity::check(x == y, "was ", x == y, x);
+        }, "was , False, 1");
+
+    // floating point numbers are written in the shortest form that reads back the same
+    expect_throw([=]() {
+        Integrity::fail("{} {} {}", 0.1f, 1.0 / 3, 1e20);
+        }, "0.1 0.3333333333333333 1e+20");
+
+    expect_throw([=]() {
+        Integrity::checkIsValidNumber(1.0 / zero, "{}", -2.5L);
+        }, "-2.5");
+
+    expect_throw([=]() {
+        Integrity::check(x == y, INTEGRITY_FORMAT("{} {}"), 16777216.0f, 0.000125);
+        }, "16777216 0.000125");
+
+    // any number of message args
+    expect_throw([=]() {
+        Integrity::check(x == y, "{} {} {} {} {}", 1, 2, 3, 4, 5, "six", 7.5);
+        }, "1 2 3 4 5, `six`, 7.5");
+
+    expect_throw([=]() {
+        Integrity::fail(INTEGRITY_FORMAT("{}-{}-{}-{}-{}"), 'a', 'b', string("c"), true, 5u);
+        }, "a-b-c-True-5");
+
+    expect_throw([=]() {
+        Integrity::checkAllNotNull(vector<const int*>{ &x, nullptr }, "rows", 1, 2, 3, 4, 5);
+        }, "rows, 1, 2, 3, 4, 5: Null pointer at index 1");
+
+    expect_throw([=]() {
+        Integrity::check(x == y, "{} and {} but not {}", x, y);
+        }, "1 and 2 but not {}");
+
+    expect_throw([=]() {
+        Integrity::check(x == y, "{} and", x, y, 'c');
+        }, "1 and, 2, 'c'");
+
+    expect_throw([=]() {
+        Integrity::check(x == y, string("quoted {}"), x);
+        }, "\"quoted 1\"");
+
+    expect_throw([=]() {
+        Integrity::check(x == y, INTEGRITY_FORMAT("Expected {} to be same as {}"), x, y);
+        }, "Expected 1 to be same as 2");
+
+    expect_throw([=]() {
+        Integrity::checkNotNull(nullptr, INTEGRITY_FORMAT("{}{} no gap"), "a", string("b"));
+        }, "ab no gap");
+
+    expect_throw([=]() {
+        Integrity::fail(INTEGRITY_FORMAT("no placeholders"));
+        }, "no placeholders");
+
     expect_throw([=]() {
         Integrity::checkIsValidNumber(f1);
         }, "+Infinity");
@@ -298,6 +430,1143 @@ void tests_which_should_throw() {
 
 }
 
+void tests_bulk_valid_numbers() {
+    cout << "Bulk valid number tests...\n";
+
+    vector<float> floats(200, 1.5f);
+    vector<double> doubles(200, 2.5);
+    Integrity::checkAllValidNumbers(floats);
+    Integrity::checkAllValidNumbers(doubles.data(), doubles.size(), "doubles");
+
+    // put the invalid number at every position, so it is found at the start, middle and end of the SIMD blocks and in the tail
+    for (size_t at = 0; at < floats.size(); ++at) {
+        string expected = "NaN at index " + to_string(at);
+        floats[at] = std::nanf("");
+        expect_throw([&]() { Integrity::checkAllValidNumbers(floats); }, expected.c_str());
+        floats[at] = 1.5f;
+
+        expected = "-Infinity at index " + to_string(at);
+        doubles[at] = -INFINITY;
+        expect_throw([&]() { Integrity::checkAllValidNumbers(doubles); }, expected.c_str());
+        doubles[at] = 2.5;
+    }
+
+    floats[150] = INFINITY;
+    floats[170] = std::nanf("");
+    expect_throw([&]() { Integrity::checkAllValidNumbers(floats, "prices for {}", "today"); }, "prices for today: +Infinity at index 150");
+    Integrity::checkAllValidNumbers(floats.data(), 150);
+    expect_throw([&]() { Integrity::checkAllValidNumbers(floats.data(), 151); }, "+Infinity at index 150");
+
+    long double longDoubles[] = { 1.0L, 2.0L, NAN };
+    expect_throw([&]() { Integrity::checkAllValidNumbers(longDoubles, 3); }, "NaN at index 2");
+
+#ifdef INTEGRITY_X86_RUNTIME_DISPATCH
+    // every kernel the CPU can run has to agree with the plain loop
+    for (size_t at = 0; at < doubles.size(); ++at) {
+        vector<float> f(doubles.size() - 3, 1.0f);
+        vector<double> d(doubles.size() - 3, 1.0);
+        if (at < f.size()) {
+            f[at] = INFINITY;
+            d[at] = std::nan("");
+        }
+        size_t expected = Integrity::findFirstInvalidNumberScalar(f.data(), 0, f.size());
+        if (Integrity::findFirstInvalidNumberSSE2(f.data(), f.size()) != expected || Integrity::findFirstInvalidNumberSSE2(d.data(), d.size()) != expected) {
+            fail("SSE2 kernel disagrees");
+        }
+        if (__builtin_cpu_supports("avx2") && (Integrity::findFirstInvalidNumberAVX2(f.data(), f.size()) != expected || Integrity::findFirstInvalidNumberAVX2(d.data(), d.size()) != expected)) {
+            fail("AVX2 kernel disagrees");
+        }
+        if (__builtin_cpu_supports("avx512f") && (Integrity::findFirstInvalidNumberAVX512(f.data(), f.size()) != expected || Integrity::findFirstInvalidNumberAVX512(d.data(), d.size()) != expected)) {
+            fail("AVX-512 kernel disagrees");
+        }
+    }
+#endif
+
+    cout << "...Bulk valid number tests finished\n";
+}
+
+void tests_bulk_null_and_empty() {
+    cout << "Bulk null and empty tests...\n";
+
+    vector<int> ints(100);
+    vector<int*> pointers;
+    vector<string> strings;
+    for (size_t i = 0; i < ints.size(); ++i) {
+        pointers.push_back(&ints[i]);
+        strings.push_back(to_string(i));
+    }
+    Integrity::checkAllNotNull(pointers);
+    Integrity::checkAllNotNull(pointers.data(), pointers.size(), "pointers");
+    Integrity::checkAllStringsNotEmpty(strings);
+
+    for (size_t at = 0; at < pointers.size(); ++at) {
+        string expected = "Null pointer at index " + to_string(at);
+        pointers[at] = nullptr;
+        expect_throw([&]() { Integrity::checkAllNotNull(pointers); }, expected.c_str());
+        pointers[at] = &ints[at];
+
+        expected = "Empty string at index " + to_string(at);
+        strings[at].clear();
+        expect_throw([&]() { Integrity::checkAllStringsNotEmpty(strings); }, expected.c_str());
+        strings[at] = "x";
+    }
+
+    pointers[40] = nullptr;
+    expect_throw([&]() { Integrity::checkAllNotNull(pointers.data(), pointers.size(), "rows"); }, "rows: Null pointer at index 40");
+    expect_throw([&]() { Integrity::checkAllNotNull(pointers, "rows for {}", 'x'); }, "rows for x: Null pointer at index 40");
+    Integrity::checkAllNotNull(pointers.data(), 40);
+
+    vector<unique_ptr<int>> uniquePointers(3);
+    uniquePointers[0].reset(new int(1));
+    expect_throw([&]() { Integrity::checkAllNotNull(uniquePointers); }, "Null pointer at index 1");
+
+    vector<const char*> charStars = { "a", "b", nullptr, "" };
+    expect_throw([&]() { Integrity::checkAllStringsNotEmpty(charStars); }, "Null pointer at index 2");
+    charStars[2] = "c";
+    expect_throw([&]() { Integrity::checkAllStringsNotEmpty(charStars, "names"); }, "names: Empty string at index 3");
+
+    list<wstring> wstrings = { L"a", L"b", L"" };
+    expect_throw([&]() { Integrity::checkAllStringsNotEmpty(wstrings); }, "Empty string at index 2");
+
+#ifdef INTEGRITY_X86_RUNTIME_DISPATCH
+    // every kernel the CPU can run has to agree with the plain loop
+    for (size_t at = 0; at < pointers.size(); ++at) {
+        // low 32 bits all zero, to make sure the SSE2 kernel looks at both halves of a 64 bit pointer
+        vector<const void*> p(pointers.size() - 3, (const void*) (uintptr_t) (sizeof(void*) == 8 ? 0x100000000ull : 0x10000ull));
+        if (at < p.size()) {
+            p[at] = nullptr;
+        }
+        size_t expected = Integrity::findFirstNullScalar(p.data(), 0, p.size());
+        if (Integrity::findFirstNullSSE2(p.data(), p.size()) != expected) {
+            fail("SSE2 kernel disagrees");
+        }
+        if (__builtin_cpu_supports("avx2") && Integrity::findFirstNullAVX2(p.data(), p.size()) != expected) {
+            fail("AVX2 kernel disagrees");
+        }
+        if (__builtin_cpu_supports("avx512f") && Integrity::findFirstNullAVX512(p.data(), p.size()) != expected) {
+            fail("AVX-512 kernel disagrees");
+        }
+    }
+#endif
+
+    cout << "...Bulk null and empty tests finished\n";
+}
+
+void tests_check_each() {
+    cout << "checkEach tests...\n";
+    // big enough to be shared between threads, with two failures in chunks which are likely to be taken by different threads
+    vector<int> values(1000000, 1);
+    values[700000] = -1;
+    values[300001] = -1;
+    auto positive = [](int value) { return value > 0; };
+    for (unsigned threads : { 1u, 2u, 8u }) {
+        Integrity::setParallelThreads(threads);
+        for (int run = 0; run < 5; ++run) {
+            expect_throw([&]() { Integrity::checkEach(values, positive, "values of {}", threads); }, ("values of " + to_string(threads) + ": Integrity check failed at index 300001").c_str());
+        }
+        expect_throw([&]() { Integrity::checkAllOf(values.begin() + 300002, values.end(), positive); }, "Integrity check failed at index 399998");
+        Integrity::checkAllOf(values.begin(), values.begin() + 300001, positive, "passes");
+    }
+
+    // once a failure is found the threads stop taking chunks past it
+    Integrity::setParallelThreads(4);
+    values[0] = -1;
+    atomic<size_t> calls(0);
+    expect_throw([&]() { Integrity::checkEach(values, [&](int value) { calls.fetch_add(1); return value > 0; }); }, "Integrity check failed at index 0");
+    if (calls > values.size() / 4) {
+        fail("checkEach should stop early once it has found a failure");
+    }
+    values[0] = 1;
+
+    // an exception from the predicate on any thread is rethrown on the calling one, and the pool can still be used after it
+    for (size_t bad : { (size_t) 5, values.size() - 5 }) {
+        try {
+            Integrity::checkEach(values, [&](const int& value) {
+                if (&value == &values[bad]) {
+                    throw runtime_error("predicate threw");
+                }
+                return true;
+                });
+            fail("the predicate's exception should have been rethrown");
+        }
+        catch (const runtime_error& e) {
+            if (string(e.what()) != "predicate threw") {
+                fail("wrong exception rethrown");
+            }
+        }
+    }
+    // a check made inside a predicate, while the pool is busy, runs on the predicate's thread
+    atomic<int> nested(0);
+    Integrity::checkEach(values, [&](const int& value) {
+        if (&value == &values[700000]) {
+            Integrity::checkAllOf(values.begin(), values.begin() + 300001, positive);
+            nested.fetch_add(1);
+        }
+        return true;
+        });
+    if (nested != 1) {
+        fail("a check inside a predicate should have run");
+    }
+    Integrity::setParallelThreads(0);
+
+    list<string> names = { "a", "b", "" };
+    expect_throw([&]() { Integrity::checkEach(names, [](const string& name) { return !name.empty(); }, "names"); }, "names: Integrity check failed at index 2");
+    const double prices[] = { 1.5, 2.5 };
+    Integrity::checkEach(prices, [](double price) { return price > 0; });
+    cout << "...checkEach tests finished\n";
+}
+
+void tests_structure() {
+    cout << "Structure tests...\n";
+    // long enough for the kernels, with the failure after the first few blocks, for each type which has a kernel
+    vector<int> ints(1000);
+    vector<unsigned> unsigneds(1000);
+    vector<long long> longs(1000);
+    vector<float> floats(1000);
+    vector<double> doubles(1000);
+    for (int i = 0; i < 1000; ++i) {
+        ints[i] = i / 2 - 100;
+        unsigneds[i] = 0x7FFFFF00u + i;
+        longs[i] = ((long long) i << 40) - 1;
+        floats[i] = i * 0.5f;
+        doubles[i] = i - 0.25;
+    }
+    Integrity::checkSorted(ints);
+    Integrity::checkSorted(unsigneds, "unsigneds");
+    Integrity::checkStrictlyIncreasing(unsigneds);
+    Integrity::checkStrictlyIncreasing(longs.data(), longs.size());
+    Integrity::checkStrictlyIncreasing(floats);
+    Integrity::checkAllInRange(ints, -100, 399);
+    Integrity::checkAllInRange(doubles, -0.25, 998.75);
+    expect_throw([&]() { Integrity::checkStrictlyIncreasing(ints, "ints"); }, "ints: Out of order at index 1");
+    expect_throw([&]() { Integrity::checkAllInRange(ints, -100, 398, "ints"); }, "ints: Out of range at index 998");
+    expect_throw([&]() { Integrity::checkAllInRange(unsigneds, 0x7FFFFF00u, 0x80000000u); }, "Out of range at index 257");
+
+    ints[700] = -1000;
+    unsigneds[300] = 0;
+    longs[999] = -1;
+    floats[600] = NAN;
+    doubles[555] = -1;
+    expect_throw([&]() { Integrity::checkSorted(ints, "ints"); }, "ints: Out of order at index 700");
+    expect_throw([&]() { Integrity::checkSorted(unsigneds); }, "Out of order at index 300");
+    expect_throw([&]() { Integrity::checkSorted(longs); }, "Out of order at index 999");
+    Integrity::checkSorted(floats); // like std::is_sorted, a NaN is not out of order
+    expect_throw([&]() { Integrity::checkStrictlyIncreasing(floats); }, "Out of order at index 600");
+    expect_throw([&]() { Integrity::checkAllInRange(floats, 0.0f, 500.0f); }, "Out of range at index 600");
+    expect_throw([&]() { Integrity::checkAllInRange(doubles.data(), doubles.size(), -0.25, 998.75, "doubles {}", 1); }, "doubles 1: Out of range at index 555");
+
+    // other types are looped over
+    list<string> names = { "ann", "bob", "bob", "al" };
+    Integrity::checkSorted(vector<string>{ "ann", "bob", "bob" });
+    expect_throw([&]() { Integrity::checkSorted(names, "names"); }, "names: Out of order at index 3");
+    expect_throw([&]() { Integrity::checkStrictlyIncreasing(names); }, "Out of order at index 2");
+    const short shorts[] = { 1, 5, 3 };
+    expect_throw([&]() { Integrity::checkAllInRange(shorts, 3, 1, 4); }, "Out of range at index 1");
+
+    vector<int> ids(100000);
+    for (int i = 0; i < 100000; ++i) {
+        ids[i] = i * 64;
+    }
+    Integrity::checkUnique(ids, "ids");
+    ids[90000] = 64 * 123;
+    expect_throw([&]() { Integrity::checkUnique(ids, "ids"); }, "ids: Duplicate at index 90000");
+    expect_throw([&]() { Integrity::checkUnique(vector<string>{ "x", "y", "z", "y" }); }, "Duplicate at index 3");
+    expect_throw([&]() { Integrity::checkUnique(vector<double>{ 0.0, 1.0, -0.0 }); }, "Duplicate at index 2");
+    try {
+        Integrity::checkUnique(ids.data(), ids.size());
+    }
+    catch (const Integrity::integrity_error& e) {
+        if (e.kind() != Integrity::FailureKind::duplicate || e.index() != 90000) {
+            fail("checkUnique should give the kind and index of the duplicate");
+        }
+    }
+    cout << "...Structure tests finished\n";
+}
+
+void tests_checked_arithmetic() {
+    cout << "Checked arithmetic tests...\n";
+    size_t offset = SIZE_MAX - 2;
+    if (Integrity::checkedAdd(offset, 2) != SIZE_MAX || Integrity::checkedSub(5u, 5) != 0 || Integrity::checkedMul(-46340, 46340) != -2147395600 ||
+        Integrity::checkedMul((short) 100, 300) != 30000 || Integrity::checkedSub(INT_MIN + 1, 1) != INT_MIN) {
+        fail("checked arithmetic should give the result when it fits");
+    }
+    expect_throw([&]() { Integrity::checkedAdd(offset, 3, "end of {}", "rows"); }, "end of rows: Overflow in 18446744073709551613 + 3");
+    expect_throw([]() { Integrity::checkedAdd(INT_MAX, 1); }, "Overflow in 2147483647 + 1");
+    expect_throw([]() { Integrity::checkedSub(3u, 5); }, "Overflow in 3 - 5");
+    expect_throw([]() { Integrity::checkedSub(INT_MIN, 1); }, "Overflow in -2147483648 - 1");
+    expect_throw([]() { Integrity::checkedMul(4294967296LL, 4294967296LL); }, "Overflow in 4294967296 * 4294967296");
+    expect_throw([]() { Integrity::checkedMul(INT_MIN, -1); }, "Overflow in -2147483648 * -1");
+    expect_throw([]() { Integrity::checkedMul((unsigned short) 65535, 2); }, "Overflow in 65535 * 2");
+    // a second operand wider than the first is checked as it is, not cut down to the first's type
+    int one = 1;
+    if (Integrity::checkedAdd(one, 2LL) != 3 || Integrity::checkedSub(offset, 1ULL) != SIZE_MAX - 3 || Integrity::checkedMul((short) 2, 100LL) != 200) {
+        fail("checked arithmetic should take a second operand of another type which fits");
+    }
+    expect_throw([&]() { Integrity::checkedAdd(one, 5000000000LL); }, "Overflow in 1 + 5000000000");
+    expect_throw([&]() { Integrity::checkedSub(one, -4294967296LL); }, "Overflow in 1 - -4294967296");
+    expect_throw([&]() { Integrity::checkedMul(one, 5000000000LL); }, "Overflow in 1 * 5000000000");
+    expect_throw([]() { Integrity::checkedAdd(5u, -1); }, "Overflow in 5 + -1");
+    // the operands are kept after the message args, and nothing is formatted until what()
+    size_t allocations = allocationCount;
+    try {
+        Integrity::checkedAdd(INT_MAX, 1, "row {} of {}", 7, "orders");
+    }
+    catch (const Integrity::integrity_error& e) {
+        if (allocationCount != allocations) {
+            fail("a failed checkedAdd should not allocate before what()");
+        }
+        if (e.kind() != Integrity::FailureKind::overflow || e.argCount() != 6 || e.messageArgCount() != 3 || e.site() != nullptr ||
+            string(e.argData(3), e.arg(3).text.length) != "Overflow in {} + {}" || e.arg(4).signedInteger != INT_MAX || e.arg(5).signedInteger != 1) {
+            fail("checkedAdd should fail with FailureKind::overflow and its operands");
+        }
+        if (string(e.what()) != "row 7 of orders: Overflow in 2147483647 + 1") {
+            fail("wrong checkedAdd message");
+        }
+    }
+
+    if (Integrity::narrow<unsigned char>(255) != 255 || Integrity::narrow<int>(-3.0) != -3 || Integrity::narrow<float>(0.5) != 0.5f ||
+        Integrity::narrow<double>(1LL << 62) != 4611686018427387904.0 || !isnan(Integrity::narrow<float>(NAN))) {
+        fail("narrow should give the value when it fits");
+    }
+    expect_throw([]() { Integrity::narrow<unsigned char>(300, "byte"); }, "byte: Narrowing 300 to uint8");
+    expect_throw([]() { Integrity::narrow<unsigned>(-1); }, "Narrowing -1 to uint32");
+    expect_throw([]() { Integrity::narrow<int>(4294967295u); }, "Narrowing 4294967295 to int32");
+    expect_throw([]() { Integrity::narrow<int>(2.5); }, "Narrowing 2.5 to int32");
+    expect_throw([]() { Integrity::narrow<int>(1e20); }, "Narrowing 1e+20 to int32");
+    expect_throw([]() { Integrity::narrow<float>(0.1); }, "Narrowing 0.1 to float");
+    expect_throw([]() { Integrity::narrow<double>(LLONG_MAX); }, "Narrowing 9223372036854775807 to double");
+
+    // the batched forms say where the first failure was
+    vector<size_t> sizes = { 1, 2, 3 };
+    if (Integrity::checkedSum(sizes) != 6 || Integrity::checkedSum(sizes.data(), 0) != 0) {
+        fail("checkedSum should give the sum");
+    }
+    sizes.push_back(SIZE_MAX - 6);
+    sizes.push_back(1);
+    expect_throw([&]() { Integrity::checkedSum(sizes, "sizes"); }, "sizes: Overflow in 18446744073709551615 + 1 at index 4");
+    const int values[] = { 1, 255, 256, 2 };
+    unsigned char bytes[4];
+    Integrity::narrowAll(values, 2, bytes);
+    if (bytes[0] != 1 || bytes[1] != 255) {
+        fail("narrowAll should convert the values");
+    }
+    expect_throw([&]() { Integrity::narrowAll(values, 4, bytes, "bytes"); }, "bytes: Narrowing 256 to uint8 at index 2");
+    cout << "...Checked arithmetic tests finished\n";
+}
+
+void tests_checked_span() {
+    cout << "Checked span tests...\n";
+    vector<int> values = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+    Integrity::checked_span<int> all(values);
+    auto middle = all.window(2, 3);
+    if (middle.size() != 3 || middle[0] != 2 || middle.at(2) != 4 || all.window(10, 0).size() != 0) {
+        fail("window should give the elements from its offset");
+    }
+    int total = 0;
+    for (int value : middle) {
+        total += value;
+    }
+    if (total != 9) {
+        fail("a window should iterate over its elements");
+    }
+    middle[1] = 30;
+    Integrity::checked_span<const int> readOnly = middle;
+    if (values[3] != 30 || readOnly[1] != 30) {
+        fail("a window should refer to the elements of its span");
+    }
+    values[3] = 3;
+    expect_throw([&]() { all.window(8, 4); }, "Window 8 + 4 out of bounds for size 10");
+    expect_throw([&]() { all.window(11, 0, "rows of {}", "table"); }, "rows of table: Window 11 + 0 out of bounds for size 10");
+    expect_throw([&]() { all.window(1, SIZE_MAX); }, "Window 1 + 18446744073709551615 out of bounds for size 10");
+    expect_throw([&]() { middle.at(3, "middle"); }, "middle: Index 3 out of bounds for size 3");
+    try {
+        all.window(8, 4);
+    }
+    catch (const Integrity::integrity_error& e) {
+        if (e.kind() != Integrity::FailureKind::outOfBounds) {
+            fail("window should fail with FailureKind::outOfBounds");
+        }
+    }
+
+    // a column of a 3 x 3 matrix, and windows whose last element only just fits, or whose extent overflows
+    auto column = all.strided(1, 3, 3);
+    if (column.size() != 3 || column[0] != 1 || column[2] != 7 || all.strided(9, 1, 100)[0] != 9 || all.strided(10, 0, 1).size() != 0) {
+        fail("strided should give every stride'th element from its offset");
+    }
+    expect_throw([&]() { all.strided(2, 4, 3); }, "Window 2 + 4 x 3 out of bounds for size 10");
+    expect_throw([&]() { all.strided(10, 1, 1); }, "Window 10 + 1 out of bounds for size 10");
+    expect_throw([&]() { all.strided(0, 3, SIZE_MAX / 2 + 1); }, "Window 0 + 3 x 9223372036854775808 out of bounds for size 10");
+    expect_throw([&]() { column.at(3); }, "Index 3 out of bounds for size 3");
+
+    // operator[] is checked by a debug_checked_span while the debug level is active, and never by a plain checked_span,
+    // whatever INTEGRITY_LEVEL is, so that checked_span<int> is the same type in every translation unit
+    static_assert(std::is_same<Integrity::checked_span<int>, Integrity::checked_span<int, false>>::value, "checked_span should not check operator[] by default");
+    static_assert(std::is_same<decltype(Integrity::debug_checked_span<int>().strided(0, 0, 1)), Integrity::debug_checked_stride<int>>::value, "a debug_checked_span should give debug_checked_strides");
+    Integrity::debug_checked_span<int> checked(values);
+    Integrity::checked_span<int> unchecked(values);
+    Integrity::Level level = Integrity::activeLevel();
+    Integrity::setActiveLevel(Integrity::Level::debug);
+    expect_throw([&]() { checked.window(2, 3)[3]; }, "Index 3 out of bounds for size 3");
+    expect_throw([&]() { checked.strided(0, 2, 5)[2]; }, "Index 2 out of bounds for size 2");
+    if (unchecked.window(2, 3)[3] != 5 || unchecked.strided(0, 2, 5)[1] != 5) {
+        fail("operator[] should not be checked when CheckEveryAccess is off");
+    }
+    Integrity::setActiveLevel(Integrity::Level::always);
+    if (checked.window(2, 3)[3] != 5) {
+        fail("operator[] should not be checked while the debug level is off");
+    }
+    Integrity::setActiveLevel(level);
+    cout << "...Checked span tests finished\n";
+}
+
+void tests_collector() {
+    cout << "Collector tests...\n";
+
+    Integrity::Collector collector(3, 36);
+    {
+        Integrity::Collector::Scope scope(collector);
+        Integrity::check(true);
+        Integrity::check(false);
+        Integrity::check(false, "row {} has price {}", 7, 1.5);
+        Integrity::checkStringNotNullOrEmpty(string(""), "name", string("0123456789abcdefXYZ"));
+        Integrity::checkNotNull(nullptr, "dropped");
+    }
+    if (collector.size() != 3 || collector.dropped() != 1) {
+        fail("collector should have kept 3 failures and dropped 1");
+    }
+    if (collector.message(0) != "Integrity check failed") {
+        fail("wrong collected default message");
+    }
+    if (collector.message(1) != "row 7 has price 1.5") {
+        fail("wrong collected message");
+    }
+    // the text buffer only had room for 13 characters of the last string
+    if (collector.message(2) != "name, \"0123456789abc\"") {
+        cout << collector.message(2) << endl;
+        fail("collected string should have been truncated");
+    }
+    expect_throw([&]() { collector.throwIfAny(); }, "Integrity check failed (and 3 more)");
+
+    // once the scope has gone the checks throw again
+    expect_throw([]() { Integrity::check(false, "thrown"); }, "thrown");
+
+    collector.clear();
+    collector.throwIfAny();
+
+    Integrity::Collector batch;
+    {
+        Integrity::Collector::Scope scope(batch);
+        Integrity::checkM(false, [](Integrity::out out) { out << "lambda " << 1; });
+        float values[] = { 1, 2, NAN };
+        Integrity::checkAllValidNumbers(values, 3, "values");
+        Integrity::check(false, INTEGRITY_FORMAT("{} of {}"), 'a', L'b');
+    }
+    if (batch.size() != 3) {
+        fail("collector should have 3 failures");
+    }
+    if (batch.message(0) != "lambda 1" || batch.message(1) != "values: NaN at index 2" || batch.message(2) != "a of b") {
+        fail("wrong collected messages");
+    }
+    if (batch[1].kind != Integrity::FailureKind::notANumber || batch[1].index != 2 || batch[2].index != Integrity::noFailureIndex) {
+        fail("collected failures should keep their kind and index");
+    }
+
+    // a message is copied, so it can be built in a string which has gone by the time message() is called, and the
+    // bulk, overflow and span failures are kept as their args, to be formatted by message()
+    Integrity::Collector copies;
+    {
+        Integrity::Collector::Scope scope(copies);
+        for (int i = 0; i < 2; ++i) {
+            string message = "row " + to_string(i) + " is bad";
+            Integrity::check(false, message.c_str());
+            Integrity::fail(string("failed at row " + to_string(i)).c_str());
+        }
+        int value = 1;
+        const int* pointers[] = { &value, nullptr };
+        Integrity::checkAllNotNull(pointers, 2);
+        Integrity::checkedAdd(INT_MAX, 1, "total of {}", string("rows"));
+        vector<size_t> sizes = { 1, SIZE_MAX };
+        Integrity::checkedSum(sizes);
+        Integrity::checked_span<const size_t>(sizes).window(1, 2, "sizes");
+    }
+    if (copies.size() != 8 || copies.message(0) != "row 0 is bad" || copies.message(1) != "failed at row 0" || copies.message(2) != "row 1 is bad" ||
+        copies.message(3) != "failed at row 1" || copies.message(4) != "Null pointer at index 1" ||
+        copies.message(5) != "total of rows: Overflow in 2147483647 + 1" || copies.message(6) != "Overflow in 1 + 18446744073709551615 at index 1" ||
+        copies.message(7) != "sizes: Window 1 + 2 out of bounds for size 2") {
+        for (size_t i = 0; i < copies.size(); ++i) {
+            cout << copies.message(i) << endl;
+        }
+        fail("wrong collected messages");
+    }
+    if (copies[4].kind != Integrity::FailureKind::nullPointer || copies[4].index != 1 || copies[5].kind != Integrity::FailureKind::overflow ||
+        copies[6].index != 1 || copies[7].kind != Integrity::FailureKind::outOfBounds) {
+        fail("collected failures should keep their kind and index");
+    }
+
+    // the buffers are allocated up front for failures with as many args as an integrity_error keeps, so that a full
+    // collector never allocates, however many args its failures have
+    Integrity::Collector reused(3);
+    for (int round = 0; round < 2; ++round) {
+        size_t allocations = allocationCount;
+        {
+            Integrity::Collector::Scope scope(reused);
+            Integrity::check(false, "{} {} {} {} {} {} {}", 1, 2, 3, 4, 5, 6, 7);
+            Integrity::check(false, "{} {} {} {}", 1, 2, 3, 4);
+            Integrity::checkedAdd(INT_MAX, 1, "{} {} {} {} {} {} {}", 1, 2, 3, 4, 5, 6, 7);
+        }
+        if (allocationCount != allocations || reused.size() != 3 || reused.message(0) != "1 2 3 4 5 6 7" ||
+            reused.message(2) != "1 2 3 4 5 6 7: Overflow in 2147483647 + 1") {
+            fail("a collector should not allocate while failures are added");
+        }
+        reused.clear();
+    }
+
+    cout << "...Collector tests finished\n";
+}
+
+const Integrity::SiteCount* findSite(const vector<Integrity::SiteCount>& counts, const char* format) {
+    for (const Integrity::SiteCount& count : counts) {
+        if (count.format != nullptr && string(count.format) == format) {
+            return &count;
+        }
+    }
+    return nullptr;
+}
+
+void tests_call_sites() {
+    cout << "Call site tests...\n";
+
+    for (int i = 0; i < 10; ++i) {
+        Integrity::checkAt(INTEGRITY_SITE("site {} passes"), i >= 0, "site {} passes", i);
+        Integrity::checkAt<true>(INTEGRITY_SITE("site {} is even"), i % 2 == 0 || i % 2 == 1, "site {} is even", i);
+        if (i % 2 == 1) {
+            expect_throw([&]() { Integrity::checkAt(INTEGRITY_SITE("{} is odd"), i % 2 == 0, "{} is odd", i); }, (to_string(i) + " is odd").c_str());
+        }
+    }
+
+    // several threads failing the same check, each collecting rather than throwing
+    vector<thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([]() {
+            Integrity::Collector collector(10);
+            Integrity::Collector::Scope scope(collector);
+            for (int i = 0; i < 1000; ++i) {
+                Integrity::checkAt(INTEGRITY_SITE("threaded"), false, "threaded");
+            }
+        });
+    }
+    for (thread& t : threads) {
+        t.join();
+    }
+
+    vector<Integrity::SiteCount> counts = Integrity::snapshot();
+    const Integrity::SiteCount* passes = findSite(counts, "site {} passes");
+    const Integrity::SiteCount* even = findSite(counts, "site {} is even");
+    const Integrity::SiteCount* odd = findSite(counts, "{} is odd");
+    const Integrity::SiteCount* threaded = findSite(counts, "threaded");
+    // a site which has never counted anything is not listed
+    if (passes != nullptr) {
+        fail("a passing site without evaluation counts should not be listed");
+    }
+    if (even == nullptr || odd == nullptr || threaded == nullptr) {
+        fail("snapshot is missing a call site");
+        return;
+    }
+    if (even->failures != 0 || even->evaluations != 10 || string(even->function) != "tests_call_sites" || even->line <= 0) {
+        fail("evaluations should have been counted");
+    }
+    if (odd->failures != 5) {
+        fail("failures should have been counted");
+    }
+    if (threaded->failures != 8000) {
+        fail("failures from several threads should all have been counted");
+    }
+
+    Integrity::Collector collector;
+    {
+        Integrity::Collector::Scope scope(collector);
+        Integrity::SiteRef at = INTEGRITY_SITE("collected");
+        Integrity::checkAt(at, false, "collected {}", 1);
+        if (collector.size() != 1 || collector[0].site != &at.site || collector.message(0) != "collected 1") {
+            fail("the collector should know the call site");
+        }
+    }
+
+    // INTEGRITY_CHECK only evaluates its message args once the condition has failed
+    int dumps = 0;
+    auto dump = [&dumps]() { ++dumps; return string("dumped"); };
+    for (int i = 0; i < 4; ++i) {
+        INTEGRITY_CHECK(i >= 0, "state {}", dump());
+    }
+    if (dumps != 0) {
+        fail("INTEGRITY_CHECK should not evaluate its message args when it passes");
+    }
+    expect_throw([&]() { INTEGRITY_CHECK(dumps > 0, "state {} for {}", dump(), 7, 'c'); }, "state dumped for 7, 'c'");
+    expect_throw([&]() { INTEGRITY_CHECK(dumps > 1); }, "Integrity check failed");
+    expect_throw([&]() { INTEGRITY_CHECK(dumps > 1, INTEGRITY_FORMAT("{} dumps"), dumps); }, "1 dumps");
+    try {
+        INTEGRITY_CHECK(dumps == 0, "dumps");
+    }
+    catch (const Integrity::integrity_error& e) {
+        if (e.line() != __LINE__ - 3 || string(e.site()->function()) != "tests_call_sites" || string(e.site()->format) != "dumps == 0") {
+            fail("INTEGRITY_CHECK should know its file, line, function and condition");
+        }
+    }
+
+    // checkEveryN runs its predicate on the first call and then one call in every n
+    int runs = 0;
+    for (int i = 0; i < 100; ++i) {
+        Integrity::checkEveryN(10, [&]() { ++runs; return true; }, "every 10");
+    }
+    if (runs != 10) {
+        fail("checkEveryN should have run its predicate 10 times");
+    }
+    int failures = 0;
+    for (int i = 0; i < 9; ++i) {
+        try {
+            Integrity::checkEveryN(4, [&]() { return false; }, "every {}", 4);
+        }
+        catch (const Integrity::integrity_error& e) {
+            if (string(e.what()) == "every 4") {
+                ++failures;
+            }
+        }
+    }
+    if (failures != 3) {
+        fail("checkEveryN should have failed on calls 1, 5 and 9");
+    }
+    int sampled = 0;
+    for (int i = 0; i < 100000; ++i) {
+        Integrity::checkSampled(0.01, [&]() { ++sampled; return true; }, "sampled");
+    }
+    if (sampled < 700 || sampled > 1300) {
+        fail("checkSampled should have run its predicate on about 1 call in 100");
+    }
+    int never = 0;
+    for (int i = 0; i < 100; ++i) {
+        Integrity::checkSampled(0, [&]() { ++never; return true; }, "never");
+    }
+    if (never != 1) {
+        fail("checkSampled with a rate of 0 should only run its predicate on the first call");
+    }
+
+    // with a call site the runs and the skipped calls are reported by snapshot
+    for (int i = 0; i < 25; ++i) {
+        Integrity::checkEveryN(INTEGRITY_SITE("every 5 at {}"), 5, [&]() { return i >= 0; }, "every 5 at {}", i);
+        Integrity::checkSampled(INTEGRITY_SITE("sampled at {}"), 0.5, [&]() { return i >= 0; }, "sampled at {}", i);
+    }
+    counts = Integrity::snapshot();
+    const Integrity::SiteCount* everyFive = findSite(counts, "every 5 at {}");
+    const Integrity::SiteCount* halved = findSite(counts, "sampled at {}");
+    if (everyFive == nullptr || everyFive->evaluations != 5 || everyFive->skipped != 16 || everyFive->failures != 0) {
+        fail("checkEveryN should count the runs and the skipped calls before the last run");
+    }
+    if (halved == nullptr || halved->evaluations == 0 || halved->evaluations + halved->skipped > 25) {
+        fail("checkSampled should count the runs and the skipped calls");
+    }
+
+    cout << "...Call site tests finished\n";
+}
+
+void tests_integrity_error() {
+    cout << "integrity_error tests...\n";
+
+    // the args are kept as they were passed in, and only turned into the message by what()
+    try {
+        Integrity::check(false, "row {} of {} is {}", 7, string("orders"), 1.5);
+        fail("should have thrown");
+    }
+    catch (const Integrity::integrity_error& e) {
+        if (e.argCount() != 4 || e.arg(1).kind != Integrity::ArgKind::signedInteger || e.arg(1).signedInteger != 7 ||
+            e.argText(2) != "orders" || e.arg(3).kind != Integrity::ArgKind::floating || e.arg(3).floating != 1.5) {
+            fail("integrity_error should hold the raw args");
+        }
+        if (string(e.what()) != "row 7 of orders is 1.5" || e.what() != e.what()) {
+            fail("wrong integrity_error message");
+        }
+    }
+
+    // as many args as it has room for
+    try {
+        Integrity::fail("{}{}{}{}{}{}", 1, 2, 3, 4, 5, 6, 7);
+    }
+    catch (const Integrity::integrity_error& e) {
+        if (e.argCount() != INTEGRITY_CAPTURED_ARGS || e.arg(7).signedInteger != 7 || string(e.what()) != "123456, 7") {
+            fail("integrity_error should hold all of the args");
+        }
+    }
+
+    // more than it has room for: the first ones are kept, and the message is built from all of them
+    try {
+        Integrity::fail("{}{}{}{}{}{}{}{}{}", 1, 2, 3, 4, 5, 6, 7, 8, 9, 10);
+    }
+    catch (const Integrity::integrity_error& e) {
+        if (e.argCount() != INTEGRITY_CAPTURED_ARGS || e.arg(7).signedInteger != 7 || string(e.what()) != "123456789, 10") {
+            fail("integrity_error should build the message from every arg");
+        }
+    }
+
+    // still a logic_error, and a copy keeps its args
+    try {
+        Integrity::checkNotNull(nullptr, "customer {}", 'c');
+    }
+    catch (const logic_error& e) {
+        const Integrity::integrity_error* error = dynamic_cast<const Integrity::integrity_error*>(&e);
+        if (error == nullptr) {
+            fail("should have thrown an integrity_error");
+        }
+        else {
+            Integrity::integrity_error copy = *error;
+            if (string(copy.what()) != "customer c") {
+                fail("a copied integrity_error should format the same");
+            }
+        }
+    }
+    expect_throw([]() { Integrity::checkM(false, [](Integrity::out out) { out << "built up front"; }); }, "built up front");
+
+    // one exception rethrown on several threads at once, each of which calls what() on it
+    exception_ptr shared;
+    try {
+        Integrity::check(false, "shared {} of {}", 3, string("rows"));
+    }
+    catch (...) {
+        shared = current_exception();
+    }
+    atomic<int> wrongMessages(0);
+    vector<thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&]() {
+            try {
+                rethrow_exception(shared);
+            }
+            catch (const exception& e) {
+                if (string(e.what()) != "shared 3 of rows") {
+                    ++wrongMessages;
+                }
+            }
+            });
+    }
+    for (thread& t : threads) {
+        t.join();
+    }
+    if (wrongMessages != 0) {
+        fail("what() should give the same message on every thread");
+    }
+
+    // what failed, and where, without parsing the message
+    auto kindOf = [](const std::function<void()>& func) {
+        try {
+            func();
+        }
+        catch (const Integrity::integrity_error& e) {
+            return e.kind();
+        }
+        return (Integrity::FailureKind) 255;
+    };
+    if (kindOf([]() { Integrity::check(false, "x {}", 1); }) != Integrity::FailureKind::condition ||
+        kindOf([]() { Integrity::checkNotNull(nullptr); }) != Integrity::FailureKind::nullPointer ||
+        kindOf([]() { Integrity::checkNotNullM(nullptr, [](Integrity::out out) { out << "customer"; }); }) != Integrity::FailureKind::nullPointer ||
+        kindOf([]() { Integrity::checkStringNotNullOrEmpty(string(), "name"); }) != Integrity::FailureKind::emptyString ||
+        kindOf([]() { Integrity::checkIsValidNumber(std::nan("")); }) != Integrity::FailureKind::notANumber ||
+        kindOf([]() { Integrity::checkIsValidNumber(-INFINITY, "price"); }) != Integrity::FailureKind::negativeInfinity) {
+        fail("wrong integrity_error kind");
+    }
+    try {
+        Integrity::checkAt(INTEGRITY_SITE("{} not found"), false, "{} not found", 5);
+    }
+    catch (const Integrity::integrity_error& e) {
+        if (e.file() == nullptr || string(e.file()) != __FILE__ || e.line() != __LINE__ - 3) {
+            fail("integrity_error should know the file and line of a checkAt");
+        }
+    }
+    try {
+        int row = 0;
+        vector<const int*> pointers(10, &row);
+        pointers[6] = nullptr;
+        Integrity::checkAllNotNull(pointers, "rows");
+    }
+    catch (const Integrity::integrity_error& e) {
+        if (e.kind() != Integrity::FailureKind::nullPointer || e.index() != 6 || e.file() != nullptr || string(e.what()) != "rows: Null pointer at index 6") {
+            fail("integrity_error should know the index a bulk check failed at");
+        }
+    }
+
+    // a message too long for the exception is cut short, and says so
+    try {
+        Integrity::check(false, string(200, 'a'), LLONG_MIN, LLONG_MIN, LLONG_MIN);
+    }
+    catch (const Integrity::integrity_error& e) {
+        string message = e.what();
+        if (message.length() != INTEGRITY_ERROR_MESSAGE_BYTES - 1 || message.compare(message.length() - 3, 3, "...") != 0 || message[0] != '"') {
+            fail("a long integrity_error message should be truncated");
+        }
+    }
+
+    cout << "...integrity_error tests finished\n";
+}
+
+struct Point {
+    int x;
+    int y;
+};
+ostream& operator<<(ostream& os, const Point& p) {
+    return os << "(" << p.x << ", " << p.y << ")";
+}
+void printTo(ostream& os, int value) {
+    os << "[" << value << "]";
+}
+
+void tests_writer() {
+    cout << "Writer tests...\n";
+
+    // the same as a std::ostream with its default settings
+    expect_throw([]() { Integrity::failM([](Integrity::out out) { out << -12 << " " << 34u << " " << LLONG_MIN << " " << (short) -5; }); },
+        "-12 34 -9223372036854775808 -5");
+    expect_throw([]() { Integrity::failM([](Integrity::out out) { out << 1.5 << " " << 0.1f << " " << 1e20 << " " << 1234567.0 << " " << (long double) 2.25; }); },
+        "1.5 0.1 1e+20 1.23457e+06 2.25");
+    expect_throw([]() { Integrity::failM([](Integrity::out out) { out << true << 'c' << (unsigned char) 'd' << string(" str ") << (const char*) nullptr << "end"; }); },
+        "1cd str end");
+
+    // manipulators and types with their own operator<< go through the std::ostream adapter, and apply to what follows
+    expect_throw([]() { Integrity::failM([](Integrity::out out) { out << "id " << std::hex << 255 << " " << std::setw(4) << std::setfill('0') << 7 << " " << Point{ 1, 2 }; }); },
+        "id ff 0007 (1, 2)");
+    expect_throw([]() { Integrity::failM([](Integrity::out out) { out << std::setprecision(3) << 3.14159; }); }, "3.14");
+    expect_throw([]() { Integrity::failM([](Integrity::out out) { printTo(out, 5); out.stream() << "!"; }); }, "[5]!");
+    // and are put back for the next message
+    expect_throw([]() { Integrity::failM([](Integrity::out out) { out << 255 << " " << 3.14159; }); }, "255 3.14159");
+
+    // lambdas written for a std::stringstream still work
+    expect_throw([]() { Integrity::failM([](stringstream& ss) { ss << std::hex << 255; }); }, "ff");
+
+    // a check failing while a message is being written gets a Writer of its own
+    expect_throw([]() {
+        Integrity::failM([](Integrity::out out) {
+            out << "outer ";
+            try {
+                Integrity::failM([](Integrity::out inner) { inner << "inner"; });
+            }
+            catch (const logic_error& e) {
+                out << e.what();
+            }
+            out << " done";
+            });
+        }, "outer inner done");
+
+    cout << "...Writer tests finished\n";
+}
+
+void tests_constexpr() {
+    cout << "constexpr tests...\n";
+    volatile int negative = -2;
+    expect_throw([&]() { squareOf(negative); }, "squareOf -2 is negative");
+#if __cplusplus >= 202002L
+    // the bulk checks are constexpr from C++20
+    struct Table {
+        static constexpr bool valid() {
+            constexpr double values[] = { 0.5, 1.5, 2.5 };
+            Integrity::checkAllValidNumbers(values, 3, "table");
+            return true;
+        }
+    };
+    static_assert(Table::valid(), "checkAllValidNumbers should pass at compile time");
+#endif
+    cout << "...constexpr tests finished\n";
+}
+
+void tests_try_check() {
+    cout << "tryCheck tests...\n";
+    volatile double zero = 0;
+    const char* empty = "";
+    string name = "name";
+    int value = 1;
+
+    static_assert(Integrity::tryCheck(1 + 1 == 2).ok() && !Integrity::tryCheckNotNull(nullptr).ok(), "tryCheck should be usable in constant expressions");
+    if (!Integrity::tryCheck(value > 0) || !Integrity::tryCheckNotNull(&value) || !Integrity::tryCheckIsValidNumber(zero) ||
+        !Integrity::tryCheckStringNotNullOrEmpty(name) || !Integrity::tryCheckStringNotNullOrEmpty(&name)) {
+        fail("tryCheck should pass");
+    }
+    if (Integrity::tryCheck(value < 0).kind() != Integrity::FailureKind::condition ||
+        Integrity::tryCheckIsValidNumber(zero / zero).kind() != Integrity::FailureKind::notANumber ||
+        Integrity::tryCheckIsValidNumber(-1 / zero).kind() != Integrity::FailureKind::negativeInfinity ||
+        Integrity::tryCheckStringNotNullOrEmpty(empty).kind() != Integrity::FailureKind::emptyString ||
+        Integrity::tryCheckStringNotNullOrEmpty((string*) nullptr).kind() != Integrity::FailureKind::nullPointer) {
+        fail("tryCheck should know what kind of failure it was");
+    }
+
+    // the message is only built when asked for, the same as the check would have built it
+    Integrity::Result result = Integrity::tryCheckNotNull(nullptr);
+    if (result.ok() || result.site() != nullptr || result.message() != "Null pointer" || result.message("{} row {}", name, 3) != "name row 3") {
+        fail("a failed Result should build its message when asked");
+    }
+    expect_throw([&]() { Integrity::raise(result, "row {}", 3); }, "row 3");
+    Integrity::raise(Integrity::tryCheck(true), "not raised");
+
+    // tryCheckAt counts the failure straight away, and raising it does not count it again
+    for (int i = 0; i < 3; ++i) {
+        result = Integrity::tryCheckAt(INTEGRITY_SITE("tried {}"), i == 0);
+    }
+    expect_throw([&]() { Integrity::raise(result, "tried {}", 2); }, "tried 2");
+    vector<Integrity::SiteCount> counts = Integrity::snapshot();
+    const Integrity::SiteCount* tried = findSite(counts, "tried {}");
+    if (result.site() == nullptr || tried == nullptr || tried->failures != 2 || string(tried->function) != "tests_try_check") {
+        fail("tryCheckAt should count its failures against its site");
+    }
+    cout << "...tryCheck tests finished\n";
+}
+
+void tests_levels() {
+    cout << "Level tests...\n";
+    int calls = 0;
+    auto counted = [&calls]() { ++calls; return false; };
+    Integrity::Level level = Integrity::activeLevel();
+    // the flag is shared by translation units with different INTEGRITY_LEVELs, so it starts the same in all of them
+    if (level != Integrity::Level::audit) {
+        fail("every level should be active until setActiveLevel is called");
+    }
+    Integrity::setActiveLevel(Integrity::Level::debug);
+
+    expect_throw([]() { Integrity::always(false, "always {}", 1); }, "always 1");
+    expect_throw([&]() { Integrity::debug<true>(counted, "debug {}", 2); }, "debug 2");
+
+    // compiled out, the predicate is never called
+    Integrity::audit<false>(counted, "never");
+    Integrity::debug<false>(false);
+    if (calls != 1) {
+        fail("a level which is compiled out should not call its predicate");
+    }
+
+    // compiled in but switched off at run time, and then on
+    Integrity::audit<true>(counted, "switched off");
+    if (calls != 1 || Integrity::isActive(Integrity::Level::audit) || !Integrity::isActive(Integrity::Level::always)) {
+        fail("a level which is switched off should not run");
+    }
+    Integrity::setActiveLevel(Integrity::Level::audit);
+    expect_throw([&]() { Integrity::audit<true>(counted, "switched on"); }, "switched on");
+    Integrity::setActiveLevel(Integrity::Level::always);
+    Integrity::debug<true>(counted);
+    if (calls != 2) {
+        fail("setActiveLevel should switch levels on and off");
+    }
+
+    // the macros evaluate nothing unless the level is compiled in and switched on
+    int args = 0;
+    INTEGRITY_DEBUG(counted(), "not evaluated {}", ++args);
+    Integrity::setActiveLevel(Integrity::Level::audit);
+    INTEGRITY_AUDIT(calls > 0, "audit {}", ++args);
+    if (calls != 2 || args != (INTEGRITY_LEVEL >= INTEGRITY_LEVEL_AUDIT ? 1 : 0)) {
+        fail("INTEGRITY_AUDIT should only evaluate its arguments when compiled in");
+    }
+    if (INTEGRITY_LEVEL >= INTEGRITY_LEVEL_DEBUG) {
+        expect_throw([]() { INTEGRITY_DEBUG(1 == 2, "debug {}", 3); }, "debug 3");
+    }
+    Integrity::setActiveLevel(level);
+
+    cout << "...Level tests finished\n";
+}
+
+void tests_async_sink() {
+    cout << "Async sink tests...\n";
+
+    Integrity::MpscRing<int> ring(3);
+    int popped = 0;
+    if (!ring.tryPush([](int& slot) { slot = 1; }) || !ring.tryPush([](int& slot) { slot = 2; }) || !ring.tryPush([](int& slot) { slot = 3; }) ||
+        !ring.tryPush([](int& slot) { slot = 4; }) || ring.tryPush([](int& slot) { slot = 5; })) {
+        fail("a ring of 3 should round up to 4 and then be full");
+    }
+    if (!ring.tryPop([&](int& value) { popped = value; }) || popped != 1 || !ring.tryPush([](int& slot) { slot = 5; })) {
+        fail("the ring should be first in first out");
+    }
+
+    // 8 threads writing through a tiny ring which blocks when full, so nothing is lost
+    FILE* file = tmpfile();
+    {
+        Integrity::AsyncSink sink(16, fileno(file));
+        sink.setOverflow(Integrity::AsyncSink::Overflow::block);
+        vector<thread> threads;
+        for (int t = 0; t < 8; ++t) {
+            threads.emplace_back([&sink, t]() {
+                for (int i = 0; i < 1000; ++i) {
+                    sink.push(nullptr, "Integrity check failed", "thread {} failure {}", t, i, wstring(L"wide"));
+                }
+            });
+        }
+        for (thread& t : threads) {
+            t.join();
+        }
+        sink.flush();
+        if (sink.dropped() != 0) {
+            fail("a blocking sink should not drop anything");
+        }
+    }
+    rewind(file);
+    char line[256];
+    size_t lines = 0;
+    size_t last = 0;
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        ++lines;
+        last += string(line).find(" thread 7 failure 999, \"wide\"\n") != string::npos;
+    }
+    fclose(file);
+    if (lines != 8000 || last != 1) {
+        fail("every failure should have been written, formatted as the exception would be");
+    }
+
+    cout << "...Async sink tests finished\n";
+}
+
+static string lastLogged;
+
+// Run when main.cpp is built with -DINTEGRITY_FAILURE_POLICY=INTEGRITY_LOG, INTEGRITY_COUNT, INTEGRITY_IGNORE or INTEGRITY_ASYNC,
+// in place of the other tests which expect the checks to throw
+void tests_failure_policy() {
+    cout << "Failure policy tests...\n";
+
+    Integrity::logHandler() = [](const char* message) { lastLogged = message; };
+#if INTEGRITY_FAILURE_POLICY == INTEGRITY_ASYNC
+    FILE* asyncFile = tmpfile();
+    Integrity::asyncSink().setFileDescriptor(fileno(asyncFile));
+#endif
+    bool messageBuilt = false;
+    float values[] = { 1, INFINITY };
+
+    Integrity::check(false, "i was {}", 1);
+    Integrity::checkM(false, [&](Integrity::out out) { messageBuilt = true; out << "lambda"; });
+    Integrity::checkAllValidNumbers(values, 2);
+    Integrity::checkNotNull(nullptr);
+
+#if INTEGRITY_FAILURE_POLICY == INTEGRITY_LOG
+    if (!messageBuilt || lastLogged != "Null pointer") {
+        fail("log policy should have logged every message");
+    }
+#elif INTEGRITY_FAILURE_POLICY == INTEGRITY_COUNT
+    if (messageBuilt || Integrity::failureCount() != 4) {
+        fail("count policy should count without building messages");
+    }
+#elif INTEGRITY_FAILURE_POLICY == INTEGRITY_IGNORE
+    if (messageBuilt || !lastLogged.empty() || Integrity::failureCount() != 0) {
+        fail("ignore policy should do nothing");
+    }
+#elif INTEGRITY_FAILURE_POLICY == INTEGRITY_ASYNC
+    // the failures are written by the sink's own thread, as "milliseconds thread [file:line ]message" lines
+    Integrity::checkAt(INTEGRITY_SITE("async {} of {}"), false, "async {} of {}", 1, string("two"));
+    Integrity::check(false, "{}{}{}{}{}{}{}{}{}", 1, 2, 3, 4, 5, 6, 7, 8, 9, 10);
+    Integrity::checkedAdd(INT_MAX, 1, "row {}", 7);
+    Integrity::asyncSink().flush();
+    string written;
+    char buffer[256];
+    rewind(asyncFile);
+    while (fgets(buffer, sizeof(buffer), asyncFile) != nullptr) {
+        written += buffer;
+    }
+    fclose(asyncFile);
+    Integrity::asyncSink().setFileDescriptor(2);
+    if (written.find(" i was 1\n") == string::npos || written.find(" lambda\n") == string::npos || written.find(" Null pointer\n") == string::npos ||
+        written.find("main.cpp:") == string::npos || written.find(" async 1 of two\n") == string::npos ||
+        written.find(" 123456789, 10\n") == string::npos || written.find(" row 7: Overflow in 2147483647 + 1\n") == string::npos) {
+        cout << written;
+        fail("async policy should have written every failure");
+    }
+    if (!messageBuilt || !lastLogged.empty() || Integrity::asyncSink().dropped() != 0) {
+        fail("async policy should not have dropped or logged anything");
+    }
+#endif
+
+#if INTEGRITY_FAILURE_POLICY == INTEGRITY_LOG
+    // only reportLimit().perInterval failures of a site are logged each interval, then a summary of the rest
+    static vector<string> logged;
+    Integrity::logHandler() = [](const char* message) { logged.push_back(message); };
+    Integrity::reportLimit().intervalMilliseconds = 60 * 60 * 1000;
+    Integrity::reportLimit().perInterval = 3;
+    for (int i = 0; i < 10; ++i) {
+        Integrity::checkAt(INTEGRITY_SITE("limited {}"), false, "limited {}", i);
+    }
+    if (logged.size() != 3 || logged[2] != "limited 2") {
+        fail("only 3 failures should have been logged");
+    }
+    vector<Integrity::SiteCount> counts = Integrity::snapshot();
+    const Integrity::SiteCount* limited = findSite(counts, "limited {}");
+    if (limited == nullptr || limited->failures != 10 || limited->suppressed != 7) {
+        fail("the suppressed failures should have been counted");
+    }
+    // the site has stopped failing, so only reportSuppressed reports the last interval's summary
+    logged.clear();
+    Integrity::reportSuppressed();
+    Integrity::reportSuppressed();
+    if (logged.size() != 1 || logged[0].find("7 failures not reported at ") != 0 || logged[0].find("\"limited {}\"") == string::npos ||
+        findSite(Integrity::snapshot(), "limited {}") == nullptr) {
+        fail("reportSuppressed should have summarised the suppressed failures once");
+    }
+
+    logged.clear();
+    Integrity::reportLimit().intervalMilliseconds = 10;
+    Integrity::reportLimit().sampleEvery = 4;
+    for (int i = 0; i < 9; ++i) {
+        if (i == 8) {
+            this_thread::sleep_for(chrono::milliseconds(20));
+        }
+        Integrity::checkAt(INTEGRITY_SITE("sampled {}"), false, "sampled {}", i);
+    }
+    // i.e. 0, 4 and 8, and before 8 (the first of a new interval) a summary of the 6 which were left out
+    // (or more than one summary, should the loop have crossed into another interval)
+    vector<string> reported;
+    unsigned long long summarised = 0;
+    for (const string& line : logged) {
+        if (line.find(" failures not reported at ") != string::npos && line.find("\"sampled {}\"") != string::npos) {
+            summarised += stoull(line);
+        }
+        else {
+            reported.push_back(line);
+        }
+    }
+    if (reported != vector<string>{ "sampled 0", "sampled 4", "sampled 8" } || summarised != 6 || logged.back() != "sampled 8") {
+        for (const string& line : logged) {
+            cout << line << endl;
+        }
+        fail("1 in 4 failures should have been logged, with a summary of the rest");
+    }
+
+    // a checked operation is limited at its own Site, as it has no call site
+    logged.clear();
+    Integrity::reportLimit().intervalMilliseconds = 60 * 60 * 1000;
+    Integrity::reportLimit().sampleEvery = 0;
+    for (int i = 0; i < 10; ++i) {
+        Integrity::checkedMul(INT_MAX, 2 + i);
+    }
+    Integrity::reportSuppressed();
+    if (logged.size() != 4 || logged[2] != "Overflow in 2147483647 * 4" || logged[3].find("7 failures not reported at ") != 0 ||
+        logged[3].find("\"Overflow in {} * {}\"") == string::npos || Integrity::multiplicationSite().failures() != 10) {
+        for (const string& line : logged) {
+            cout << line << endl;
+        }
+        fail("only 3 checkedMul failures should have been logged, with a summary of the rest");
+    }
+    Integrity::reportLimit().perInterval = 0;
+    Integrity::reportLimit().sampleEvery = 0;
+#endif
+
+    // an index out of bounds gives a stand in element of the thread's own, rather than reading or writing past the end
+    int row[] = { 1, 2, 3, 4 };
+    Integrity::checked_span<int> span(row, 3);
+    span.at(3) = 9;
+    vector<string> names(2, "name");
+    if (span.at(3) != 0 || span.at(1) != 2 || row[3] != 4 || span.strided(0, 2, 2).at(2) != 0 || span.window(2, 5).size() != 0 ||
+        !Integrity::checked_span<string>(names).at(2).empty() || (Integrity::isActive(Integrity::Level::debug) && Integrity::debug_checked_span<int>(span)[5] != 0)) {
+        fail("checked_span should give a value initialised element for an index out of bounds");
+    }
+
+    // a Collector still gets the failures first (except with INTEGRITY_IGNORE)
+    Integrity::Collector collector;
+    {
+        Integrity::Collector::Scope scope(collector);
+        Integrity::check(false, "collected");
+    }
+    if (collector.size() != (INTEGRITY_FAILURE_POLICY == INTEGRITY_IGNORE ? 0u : 1u)) {
+        fail("wrong number of collected failures");
+    }
+
+    cout << "...Failure policy tests finished\n";
+}
+
 void signalHandler(int sig) {
     cout << "signal raised: " << sig;
 }
@@ -318,6 +1587,24 @@ int main()
     cout << "g++ " << __VERSION__ << endl;
 #endif
        
+#if INTEGRITY_FAILURE_POLICY == INTEGRITY_THROW
     tests_which_should_not_throw();
     tests_which_should_throw();
+    tests_bulk_valid_numbers();
+    tests_bulk_null_and_empty();
+    tests_check_each();
+    tests_structure();
+    tests_checked_arithmetic();
+    tests_checked_span();
+    tests_collector();
+    tests_call_sites();
+    tests_async_sink();
+    tests_integrity_error();
+    tests_writer();
+    tests_levels();
+    tests_constexpr();
+    tests_try_check();
+#else
+    tests_failure_policy();
+#endif
 }